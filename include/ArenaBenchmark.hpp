@@ -0,0 +1,53 @@
+#ifndef ARENA_BENCHMARK_HPP
+#define ARENA_BENCHMARK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Benchmark.hpp"
+#include "InstanceArena.hpp"
+
+// Throughput of many machines kept in InstanceArenas against the same
+// machines on the plain heap.
+//
+// Each of nThreads workers builds its share of nMachines, all clones of one
+// cartridge of the title, either with make_unique or in an arena of its own
+// that it reserves and touches itself. It then plays the title's movie on
+// them round robin, one frame per machine per turn, as a host interleaves
+// its clients, and only those frames are timed. With bPinThreads, worker i
+// runs on CPU i, so each arena stays on the NUMA node it was touched from.
+class ArenaBenchmark
+{
+public:
+    struct Result {
+        std::string sMode;              // "heap" or "arena"
+        bool bValid = false;            // False if the ROM or movie did not load
+        ArenaBacking::Backing backing = ArenaBacking::NONE;
+        uint32_t nMachines = 0;
+        uint64_t nFrames = 0;           // Over every machine
+        double dSeconds = 0.0;
+        double dFramesPerSecond = 0.0;
+        size_t nSpilled = 0;            // Bytes that did not fit their slots
+        uint64_t nStateHash = 0;        // Of the first machine; the same in both modes
+    };
+
+    // The heap, then arenas
+    std::vector<Result> run() const;
+    Result run(bool bArena) const;
+
+    static void writeReport(const std::vector<Result>& vResults, std::ostream& out);
+
+    Benchmark::Title title;
+    uint32_t nMachines = 1024;
+    uint32_t nThreads = 1;
+    // Frames per machine from the start of the movie; 0 plays all of it
+    uint32_t nFrames = 0;
+    // Render frames as a front end would
+    bool bVideo = false;
+    bool bPinThreads = true;
+    size_t nSlotSize = InstanceArena::DEFAULT_SLOT_SIZE;
+};
+
+#endif
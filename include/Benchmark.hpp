@@ -0,0 +1,79 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Whole-system benchmark: real ROMs replaying recorded input at full speed.
+//
+// Each title of the corpus is a ROM and a Movie. It is loaded, reset and run
+// frame by frame through Bus::clockFrame() with nothing attached, timing only
+// the frames. The fastest of nRepeats runs is kept. With bPinThread the
+// calling thread stays on one CPU for the runs of a title, so the scheduler
+// does not move it between them. Every result ends with
+// the StateHash of the final machine, which must be the same from build to
+// build: a faster build that hashes differently emulates something else.
+//
+// Results are written as JSON; compare() checks them against a stored
+// baseline and lists every title that got slower, or bigger, by more than a
+// threshold, and every title whose final state changed.
+class Benchmark
+{
+public:
+    struct Title {
+        std::string sName;
+        std::string sROM;
+        std::string sMovie;
+    };
+
+    struct Result {
+        std::string sName;
+        std::string sProfile;           // CorePolicy::NAME of the build that ran it
+        bool bValid = false;            // False if the ROM or movie did not load
+        uint64_t nFrames = 0;
+        uint64_t nCycles = 0;           // Emulated CPU cycles
+        double dSeconds = 0.0;
+        double dFramesPerSecond = 0.0;
+        double dCyclesPerSecond = 0.0;
+        uint64_t nPeakRSS = 0;          // Bytes; 0 where it cannot be measured
+        uint64_t nStateHash = 0;
+    };
+
+    struct Regression {
+        std::string sName;
+        std::string sMetric;            // "fps", "cycles_per_second", "peak_rss" or "state_hash"
+        double dBaseline = 0.0;
+        double dCurrent = 0.0;
+    };
+
+    // One title per line: name, ROM path and movie path separated by
+    // whitespace. Blank lines and lines starting with '#' are skipped.
+    bool loadCorpus(const std::string& sFileName);
+
+    std::vector<Result> run() const;
+    Result run(const Title& title) const;
+
+    static void writeJSON(const std::vector<Result>& vResults, std::ostream& out);
+    // Reads what writeJSON() wrote
+    static bool readJSON(std::istream& is, std::vector<Result>& vResults);
+
+    // Titles in both lists whose speed fell, or whose peak RSS grew, by more
+    // than dThreshold (0.05 is 5%), and those whose state hash differs. Speed
+    // and size are only compared between runs of the same profile.
+    static std::vector<Regression> compare(const std::vector<Result>& vBaseline,
+        const std::vector<Result>& vCurrent, double dThreshold = 0.05);
+    static void writeRegressions(const std::vector<Regression>& vRegressions, std::ostream& out);
+
+    std::vector<Title> vTitles;
+    uint32_t nRepeats = 3;
+    // Render frames as a front end would; off runs the PPU's render-less path
+    bool bVideo = true;
+    // Keep the calling thread on the CPU it is running on while a title runs;
+    // it gets the CPUs it had back afterwards
+    bool bPinThread = true;
+};
+
+#endif
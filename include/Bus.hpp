@@ -8,30 +8,144 @@
 #include "PPU.hpp"
 #include "Cartridge.hpp"
 #include "CPU.hpp"
+#include "CycleCPU.hpp"
+#include "CorePolicy.hpp"
+
+class Debugger;
+class Cheats;
+class LockstepBatch;
+
+NES_PROFILE_BEGIN
 
 class Bus
 {
+	// Advances lane PPUs itself and has to charge their DMA stalls
+	friend class ::LockstepBatch;
+	// Needs to know when the CPU is about to fetch an opcode
+	friend class ::Debugger;
+
 public:
 	Bus();
 	~Bus();
 
+	// Independent copy of the running machine for tree search. ROM is shared,
+	// registers and CPU RAM are copied, and cartridge RAM, CHR-RAM and
+	// nametables are shared page by page until either side writes to them.
+	std::unique_ptr<Bus> clone() const;
+
+	// In-place snapshot of the machine for rewinding the same instance, e.g.
+	// run-ahead. Saving and loading copy registers and RAM into preallocated
+	// storage; paged memory is shared rather than copied. The cartridge itself
+	// (and its ROM) is not part of the state.
+	struct State {
+		CPU::State cpu;
+		PPU::State ppu;
+		Cartridge::State cart;
+		std::array<Byte, MEMORY_SIZE> cpuRam;
+		std::array<Byte, 2> controller;
+		std::array<Byte, 2> controllerShift;
+		bool bControllerStrobe;
+		uint16_t nDMACycles;
+		uint32_t nSystemClockCounter;
+		// Only used with a cycle core attached
+		CycleCPU::Progress cycleCpu;
+		// Only used by profiles that emulate open bus
+		Byte openBus;
+	};
+
+	void saveState(State&) const;
+	void loadState(const State&);
+
 public:
 	CPU cpu;	
     PPU ppu;
 	std::shared_ptr<Cartridge> cart;
 	std::array<Byte, MEMORY_SIZE> cpuRam;
 
+	// Button state of both controllers for the current frame, one bit per
+	// button: A, B, Select, Start, Up, Down, Left, Right from bit 7 down
+	std::array<Byte, 2> controller{};
+
+	// Told about accesses to the pages it has breakpoints on while attached
+	Debugger *debugger = nullptr;
+	// Writes its RAM freezes before every frame run through clockFrame()
+	Cheats *cheats = nullptr;
+	// Runs in place of cpu while set, one bus access per cycle. Ignored by
+	// profiles that step by instruction; profiles that step by cycle set it
+	// to a core of the Bus's own.
+	CycleCPU *cycleCpu = nullptr;
+
 public:
 	void cpuWrite(Address, Byte);
 	Byte cpuRead(Address, bool bReadOnly = false);
 
 private:
+	Bus(const Bus&);
+	Bus& operator=(const Bus&) = delete;
+
+	void oamDMA(Byte page);
+
+	// One system clock; the traced copy times the CPU and PPU as it goes
+	template <bool bTraced>
+	void tick();
+	// tick<true>() timed as Bus::clock. On the clocks HostTrace samples, the
+	// CPU's bus accesses are timed too.
+	void tracedTick();
+
+	// What cpuRead() and cpuWrite() do; the traced copies time the address
+	// decode and the cartridge apart
+	template <bool bTraced>
+	Byte read(Address addr, bool bReadOnly);
+	template <bool bTraced>
+	void write(Address addr, Byte data);
+	Byte tracedRead(Address addr, bool bReadOnly);
+	void tracedWrite(Address addr, Byte data);
+
+	// Shift registers the game reads $4016/$4017 through, reloaded from
+	// controller[] while the strobe bit is set
+	std::array<Byte, 2> controllerShift{};
+	bool bControllerStrobe = false;
+
+	// CPU cycles still to be stolen by an OAM DMA in progress
+	uint16_t nDMACycles = 0;
+
 	uint32_t nSystemClockCounter = 0;
 
+	// Set by tracedTick() for a sampled clock only, so an access costs one
+	// test of it whenever nothing is being timed
+	bool bTraceAccesses = false;
+
+	// Last byte on the CPU data bus, kept by profiles that emulate open bus.
+	// Left out of StateHash, since the other profiles do not have it.
+	Byte openBus = 0x00;
+
+	// The core cycle-stepped profiles run, made with the first cartridge
+	std::unique_ptr<CycleCPU> ownCycleCpu;
+
+	// Set while a LockstepBatch runs this machine as one of its lanes: every
+	// RAM write also lands at ramMirror[address * nRamMirrorStride], the
+	// lane's column of the batch's structure-of-arrays RAM
+	Byte *ramMirror = nullptr;
+	size_t nRamMirrorStride = 0;
+
 public:
 	void insertCartridge(const std::shared_ptr<Cartridge>& cartridge);
 	void reset();
 	void clock();
+	// Clocks until the PPU completes a frame, then clears frameComplete
+	void clockFrame();
+	// System clocks (PPU dots) since the last reset; three per CPU cycle
+	uint32_t clockCount() const { return nSystemClockCounter; }
+	// True when the running core's next cycle starts an instruction or an
+	// interrupt; bus.cpu alone cannot tell while a cycle core runs
+	bool cpuComplete() const {
+		if (CorePolicy::STEPPING != CPUStepping::INSTRUCTION && cycleCpu != nullptr) {
+			return cycleCpu->Complete();
+		}
+		return cpu.Complete();
+	}
 };
 
-#endif
\ No newline at end of file
+NES_PROFILE_END
+
+#endif
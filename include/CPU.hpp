@@ -8,11 +8,22 @@
 #include "Typedefs.hpp"
 #include "Constants.hpp"
 
+class Profiler;
+class CodeDataLogger;
+class LockstepBatch;
+
+NES_PROFILE_BEGIN
+
 class CPU;
 class Bus;
 
 class CPU
 {
+    // Runs lanes of many machines through this core and keeps their registers itself
+    friend class ::LockstepBatch;
+    // Runs instead of this core, keeping its registers up to date
+    friend class CycleCPU;
+
     public:
         CPU();
         ~CPU();
@@ -23,6 +34,28 @@ class CPU
         void IRQ();
         void NMI();
 
+        // True when the current instruction has used up all of its cycles
+        bool Complete() const { return CyclesLeft == 0; }
+
+        // Registers and the in-flight instruction; the opcode table never changes
+        struct State {
+            Register Accumulator;
+            Register X;
+            Register Y;
+            Register StackPointer;
+            Register StatusRegister;
+            LargeRegister ProgramCounter;
+            Byte FetchedData;
+            Address AbsoluteAddress;
+            Address RelativeAddress;
+            Opcode CurrentOpcode;
+            uint8_t CyclesLeft;
+            uint16_t TemporaryStorage;
+        };
+
+        void SaveState(State&) const;
+        void LoadState(const State&);
+
         void write(uint16_t addr, uint8_t data);
         uint8_t read(uint16_t addr);
 
@@ -30,6 +63,16 @@ class CPU
             bus = b;
         }
 
+        // One line of text per instruction from start to stop, read without
+        // side effects through the bus: "$C000: LDA #$10 {IMM}"
+        std::map<Address, std::string> Disassemble(Address start, Address stop);
+
+        // Told about every instruction and interrupt while set; only looked at
+        // when built with NES_PROFILER
+        Profiler *profiler = nullptr;
+        // Told which PRG bytes are fetched as code and read as data while set
+        CodeDataLogger *cdl = nullptr;
+
 
     private:
 
@@ -116,16 +159,28 @@ class CPU
         inline uint8_t GetNumberOfBaseClockCyclesLeftForOperation(const Opcode);
         inline bool GetFlagFromStatusRegister(const StatusRegisterFlags::Flags);
         inline void SetFlagInStatusRegister(const StatusRegisterFlags::Flags, const bool);
-        std::map<Address, std::string> Disassemble(Address, Address);
+        inline void SetZeroAndNegativeFlags(const Byte);
+        // The whole byte with C, Z, V and N put back in, for pushes and states
+        Register GetStatusRegister() const;
+        void SetStatusRegister(const Register);
 
     private:
         Register Accumulator;
         Register X;
         Register Y;
         Register StackPointer;
+        // I, D, B and U; C, Z, V and N live in the flag members below
         Register StatusRegister;
         LargeRegister ProgramCounter;
         AddressingMode AddressingModeFunc;
+
+        // Operations store what the flags come from instead of the flags:
+        // Z is set when FlagZeroSource is 0, N is bit 7 of FlagNegativeSource.
+        // Most are overwritten before a branch or push looks at them.
+        bool FlagCarry = false;
+        bool FlagOverflow = false;
+        Byte FlagZeroSource = 0x01;
+        Byte FlagNegativeSource = 0x00;
         OperationFunction OperationFunc;
     
         Byte FetchedData;
@@ -136,7 +191,10 @@ class CPU
 
         uint16_t TemporaryStorage;
 
-        std::array<Instruction, NUMBER_OF_LEGAL_INSTRUCTIONS> OpcodeTable;
+        // Built at compile time, one copy for the whole process
+        static const std::array<Instruction, NUMBER_OF_OPCODES> OpcodeTable;
 };
 
-#endif
\ No newline at end of file
+NES_PROFILE_END
+
+#endif
@@ -2,7 +2,11 @@
 #define CARTRIDGE_HPP
 
 #include "Typedefs.hpp"
-#include "Mappers/Mapper_000.hpp"
+#include "Mapper.hpp"
+#include "PagedMemory.hpp"
+#include <cstddef>
+#include <istream>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -10,22 +14,73 @@ class Cartridge
 {
 public:
     Cartridge(const std::string&);
+    // Parses an iNES image already in memory; the bytes are copied
+    Cartridge(const Byte*, size_t);
     ~Cartridge();
 
+    bool ImageValid();
+    void reset();
+    Mirroring::Mode Mirror();
+    // Owned by the cartridge; no reference count is touched on the way
+    Mapper* GetMapper() { return pMapper.get(); }
+
     bool cpuWrite(Address, Byte);
 	bool cpuRead(Address, Byte&);
 
     bool ppuWrite(Address, Byte);
     bool ppuRead(Address, Byte&);
 
-    std::vector<Byte> vPRGMemory;
-    std::vector<Byte> vCHRMemory;
+    // Copy sharing the ROM images; only mapper registers and RAM are duplicated,
+    // and RAM only page by page as it is written
+    std::shared_ptr<Cartridge> clone() const;
+
+    // The parts of the board that change while a game runs
+    struct State {
+        std::shared_ptr<Mapper> pMapper;
+        PagedMemory vCHRRam;
+    };
+
+    void saveState(State&) const;
+    void loadState(const State&);
+
+    // One byte of PRG-ROM replaced as the CPU sees it through one 8 KB window
+    // ($8000, $A000, $C000 or $E000); offset is into PRG-ROM
+    struct PRGPatch {
+        uint8_t window;
+        uint32_t offset;
+        Byte value;
+    };
+
+    // Replaces every patch made before. Each bank patched for a window gets
+    // a copy with the patches in it, and the mapper reads that copy whenever
+    // it maps the bank into that window, so reads cost what they did without
+    // patches. The ROM image itself is never changed; clones and saved
+    // states keep whatever patches the cartridge has.
+    void patchPRG(const std::vector<PRGPatch>& vPatches);
+
+    // ROM never changes once loaded, so every clone points at the same images
+    std::shared_ptr<const std::vector<Byte>> pPRGMemory;
+    std::shared_ptr<const std::vector<Byte>> pCHRMemory;
+    // 8 KB of CHR-RAM on boards without CHR-ROM
+    PagedMemory vCHRRam;
 
     uint8_t nMapperID = 0;
     uint8_t nPRGBanks = 0;
     uint8_t nCHRBanks = 0;
 
     std::shared_ptr<Mapper> pMapper;
+
+private:
+    void load(std::istream&);
+
+    // What cpuRead() reads for each 8 KB bank of the mapper's offsets: the
+    // banks of the ROM image, then the patched copies
+    std::vector<const Byte*> vPRGBanks;
+    std::shared_ptr<const std::vector<Byte>> pPRGPatched;
+    std::shared_ptr<const std::vector<uint32_t>> pPRGOverlay;
+
+    bool bImageValid = false;
+    Mirroring::Mode hwMirror = Mirroring::HORIZONTAL;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,61 @@
+#ifndef CHEATS_HPP
+#define CHEATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+// Game Genie codes, ROM patches and RAM freezes.
+//
+// Nothing is compared on the way through the bus. Patches of $8000-$FFFF are
+// compiled into patched copies of the PRG banks they change, which the mapper
+// swaps in for the affected window only (Cartridge::patchPRG); a patch with a
+// compare value is only made in banks that hold that value at the address,
+// as a Game Genie does. Freezes of $0000-$1FFF and $6000-$7FFF rewrite their
+// byte before every frame run through Bus::clockFrame().
+class Cheats
+{
+public:
+    explicit Cheats(Bus& bus);
+    ~Cheats();
+
+    struct Cheat {
+        uint32_t nId = 0;       // Assigned by add()
+        Address address = 0x0000;
+        Byte value = 0x00;
+        int16_t compare = -1;   // ROM byte it has to replace, -1 for any
+        bool bEnabled = true;
+    };
+
+    // Returns the id of the new cheat, or 0 for an address in neither ROM
+    // nor RAM
+    uint32_t add(const Cheat& cheat);
+    // 6 or 8 letters; returns 0 if it is not a Game Genie code
+    uint32_t addGameGenie(const std::string& sCode);
+    bool remove(uint32_t nId);
+    void clear();
+    // nullptr if there is no such id; call refresh() after changing it
+    Cheat* find(uint32_t nId);
+    const std::vector<Cheat>& cheats() const { return vCheats; }
+
+    // Patches the cartridge again: after a cheat changed or a new cartridge
+    // went in
+    void refresh();
+
+    // Writes every freeze; called by the Bus before each frame
+    void freeze();
+
+    static bool decodeGameGenie(const std::string& sCode, Address& address, Byte& value, int16_t& compare);
+
+private:
+    Bus &bus;
+    std::vector<Cheat> vCheats;
+    uint32_t nNextId = 1;
+};
+
+#endif
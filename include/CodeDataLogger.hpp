@@ -0,0 +1,104 @@
+#ifndef CODE_DATA_LOGGER_HPP
+#define CODE_DATA_LOGGER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+// Bits kept for each byte of PRG-ROM, as in the .cdl files of FCEUX
+namespace CDLPrg {
+    enum Flags {
+        CODE = (1 << 0),          // Fetched as an opcode or operand
+        DATA = (1 << 1),          // Read by an instruction or as a vector
+        WINDOW = (3 << 2),        // $8000/$A000/$C000/$E000 window it was seen in
+        INDIRECT_CODE = (1 << 4), // Reached through JMP (indirect)
+        INDIRECT_DATA = (1 << 5), // Read through (zp,X) or (zp),Y
+        PCM = (1 << 6)            // DMC samples; never set without an APU
+    };
+}
+
+// Bits kept for each byte of CHR-ROM
+namespace CDLChr {
+    enum Flags {
+        RENDERED = (1 << 0),  // Fetched by the PPU to draw a tile or sprite
+        READ = (1 << 1)       // Read by the CPU through $2007
+    };
+}
+
+// Which PRG bytes were run as code or read as data, and which CHR bytes were
+// drawn, over a whole session.
+//
+// The logs hold one byte of flags per byte of PRG-ROM and CHR-ROM, in the same
+// layout as a .cdl file: PRG first, then CHR. The CPU reports each instruction
+// once its operands are fetched and each operand read; the PPU reports its
+// pattern fetches. Both go through the bank tables of the mapper, so every
+// bank is logged on its own. Code and data in RAM are not logged, and boards
+// with CHR-RAM have an empty CHR log. A machine without a logger pays a null
+// test per instruction and per pattern fetch; with one, the PPU does its tile
+// fetches even on frames without video output.
+class CodeDataLogger
+{
+public:
+    CodeDataLogger();
+    ~CodeDataLogger();
+
+    // Start logging this machine. The logs are sized to its cartridge and
+    // kept if they already are, so a loaded log carries on.
+    void attach(Bus& bus);
+    void detach();
+    // Zero both logs
+    void clear();
+
+    // Replace the logs with a .cdl file; false if it cannot be read or does
+    // not fit the attached cartridge
+    bool load(const std::string& sFileName);
+    bool save(const std::string& sFileName) const;
+
+    // Called by the CPU once the addressing mode has stepped over the
+    // operands: the instruction occupies pc up to operandEnd
+    void instruction(Address pc, Opcode opcode, Address operandEnd) {
+        if (pc >= 0x8000) {
+            logInstruction(pc, operandEnd);
+        } else {
+            bIndirectJump = false;
+        }
+        bIndirectJump = bIndirectJump || opcode == 0x6C;
+    }
+    // Called by the CPU for bytes read as data
+    void data(Address address, bool bIndirect = false) {
+        if (address >= 0x8000) {
+            logData(address, bIndirect ? CDLPrg::DATA | CDLPrg::INDIRECT_DATA : CDLPrg::DATA);
+        }
+    }
+    // Called by the CPU for a little-endian address it reads from memory: an
+    // interrupt vector or the pointer of JMP (indirect)
+    void vector(Address address) {
+        data(address);
+        data(address + 1);
+    }
+    // Called by the PPU for pattern table reads ($0000-$1FFF)
+    void chr(Address address, CDLChr::Flags flag);
+
+    // Bytes with any of the given flags set
+    size_t countPRG(Byte flags) const;
+    size_t countCHR(Byte flags) const;
+
+    std::vector<Byte> vPRG;
+    std::vector<Byte> vCHR;
+
+private:
+    void logInstruction(Address pc, Address operandEnd);
+    void logData(Address address, Byte flags);
+    uint32_t prgOffset(Address address) const;
+
+    Bus *bus = nullptr;
+    // The previous instruction was JMP (indirect), so this one is its target
+    bool bIndirectJump = false;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef CONFORMANCE_HPP
+#define CONFORMANCE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+namespace ConformanceStatus {
+    enum Status {
+        PASSED,
+        FAILED,     // The ROM reported a failure, or the log disagreed
+        TIMED_OUT,  // No result within the frame or time limit
+        ERROR       // The ROM or golden log did not load
+    };
+}
+
+// Runs test ROMs headless, one machine per ROM on every core, and tells
+// which pass.
+//
+// Two kinds of test are understood. A test with a golden log is run the way
+// nestest is run without a screen: from $C000 with P=$24, comparing PC, A, X,
+// Y, P, SP and the cycle count before every instruction with the log until
+// it runs out. Any other test follows the protocol of blargg's test ROMs:
+// once $6001-$6003 hold DE B0 61, $6000 is $80 while running, $81 when it
+// wants the reset button pressed (done 100 ms later) and the result code
+// when finished, 0 for a pass, with a message as text from $6004.
+class Conformance
+{
+public:
+    struct Test {
+        std::string sName;
+        std::string sROM;
+        std::string sLog;           // Golden log; empty for a $6000 test
+        uint32_t nLogLines = 0;     // Lines of the log to check; 0 for all
+        std::vector<Byte> vImage;   // iNES image run instead of sROM when set
+        std::string sLogText;       // Golden log checked instead of sLog when set
+    };
+
+    struct Result {
+        std::string sName;
+        ConformanceStatus::Status status = ConformanceStatus::ERROR;
+        int nCode = -1;             // Result code at $6000, or the failing log line
+        std::string sMessage;
+        uint64_t nFrames = 0;
+        double dSeconds = 0.0;
+    };
+
+    // One test per line: name, ROM path, then for a log test the golden log
+    // and optionally how many lines of it to check, separated by whitespace.
+    // Blank lines and lines starting with '#' are skipped.
+    bool loadSuite(const std::string& sFileName);
+
+    // Tests built in code for corner cases the usual suites may not reach:
+    // "jmp_indirect_wrap", a $6000 test, checks that JMP ($xxFF) takes its
+    // high byte from $xx00, and "status_flags", a log test, checks the B and
+    // U bits through PHP, PLP, BRK and RTI
+    static std::vector<Test> builtinTests();
+
+    // Every test, nThreads at a time; 0 uses every core. The results are in
+    // the order of vTests.
+    std::vector<Result> run(uint32_t nThreads = 0) const;
+    Result run(const Test& test) const;
+
+    // One line per test and a count of each status at the end
+    static void writeSummary(const std::vector<Result>& vResults, std::ostream& out);
+    static bool allPassed(const std::vector<Result>& vResults);
+
+    std::vector<Test> vTests;
+    // A test is timed out at whichever comes first
+    uint32_t nFrameLimit = 60 * 60;
+    double dSecondsLimit = 30.0;
+
+private:
+    Result runLog(const Test& test, Bus& bus) const;
+    Result runStatus(const Test& test, Bus& bus) const;
+};
+
+#endif
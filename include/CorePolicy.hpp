@@ -0,0 +1,75 @@
+#ifndef CORE_POLICY_HPP
+#define CORE_POLICY_HPP
+
+#include <cstdint>
+
+// Build profiles of the core, trading accuracy and hooks for speed with no
+// runtime test on the paths they touch. A build picks one with
+// -DNES_PROFILE_FAST or -DNES_PROFILE_ACCURATE (the standard profile
+// otherwise), and every source file of that library must be compiled with
+// the same choice. Each profile is its own library: libraries built with
+// different profiles must not be mixed in one program.
+//
+// The fast and standard profiles run games identically, cycle for cycle.
+// The accurate profile makes each access on its own cycle and emulates open
+// bus, so games that depend on either can differ, and a frame may end with
+// an instruction half done. Conformance suites, golden logs included, give
+// the same results in all three.
+namespace CPUStepping {
+    enum Stepping : uint8_t {
+        INSTRUCTION,    // The default core only; CycleCPU is never consulted
+        SELECTABLE,     // The default core unless a CycleCPU is attached
+        CYCLE           // Every Bus owns a CycleCPU and always runs it
+    };
+}
+
+// Bulk runs: no debugger, code/data logger, cheats or host trace hooks
+// (attaching them does nothing), and no cycle core
+struct FastPolicy {
+    static constexpr const char* NAME = "fast";
+    static constexpr CPUStepping::Stepping STEPPING = CPUStepping::INSTRUCTION;
+    static constexpr bool bInstrumented = false;
+    static constexpr bool bOpenBus = false;
+};
+
+// Everything attachable at run time; unmapped reads return 0
+struct StandardPolicy {
+    static constexpr const char* NAME = "standard";
+    static constexpr CPUStepping::Stepping STEPPING = CPUStepping::SELECTABLE;
+    static constexpr bool bInstrumented = true;
+    static constexpr bool bOpenBus = false;
+};
+
+// Verification: every bus access on its own cycle, and reads of unmapped
+// addresses (and the upper controller bits) return the last byte on the
+// CPU data bus
+struct AccuratePolicy {
+    static constexpr const char* NAME = "accurate";
+    static constexpr CPUStepping::Stepping STEPPING = CPUStepping::CYCLE;
+    static constexpr bool bInstrumented = true;
+    static constexpr bool bOpenBus = true;
+};
+
+#if defined(NES_PROFILE_FAST) && defined(NES_PROFILE_ACCURATE)
+#error "Pick one of NES_PROFILE_FAST and NES_PROFILE_ACCURATE"
+#elif defined(NES_PROFILE_FAST)
+typedef FastPolicy CorePolicy;
+#define NES_PROFILE_NAMESPACE profile_fast
+#elif defined(NES_PROFILE_ACCURATE)
+typedef AccuratePolicy CorePolicy;
+#define NES_PROFILE_NAMESPACE profile_accurate
+#else
+typedef StandardPolicy CorePolicy;
+#define NES_PROFILE_NAMESPACE profile_standard
+#endif
+
+// The classes whose layout or code depends on the profile (Bus, CPU,
+// CycleCPU and PPU) are declared between these, in an inline namespace named
+// after it. Their names, and those of every function taking one, then differ
+// from profile to profile, so a program mixing profiles fails to link
+// instead of running with two ideas of what a Bus is. The C interface is
+// the same in all of them.
+#define NES_PROFILE_BEGIN inline namespace NES_PROFILE_NAMESPACE {
+#define NES_PROFILE_END }
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef CYCLE_CPU_HPP
+#define CYCLE_CPU_HPP
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+
+class Bus;
+
+// Alternative 6502 core that makes every bus access on the cycle the real CPU
+// makes it, dummy reads and writes included.
+//
+// The core is a single coroutine that co_awaits each read and write. clock()
+// performs the access it is waiting on and resumes it up to the next one, so
+// one CPU cycle is exactly one bus access, and the Bus runs three PPU dots in
+// between. The coroutine frame lives inside this object: nothing is allocated
+// once it is constructed.
+//
+// While it exists it takes the place of bus.cpu in Bus::clock(). bus.cpu
+// stays the register file everything else looks at (states, clones, hashes)
+// and is brought up to date at every instruction boundary. A state saved in
+// the middle of an instruction also keeps the Progress made on it, which a
+// load replays from the opcode fetch without touching the bus, so the machine
+// carries on exactly as it would have. Interrupts are polled between
+// instructions. The debugger, profiler and code/data logger are only driven
+// by the default core.
+class CycleCPU
+{
+public:
+    explicit CycleCPU(Bus& bus);
+    ~CycleCPU();
+
+    CycleCPU(const CycleCPU&) = delete;
+    CycleCPU& operator=(const CycleCPU&) = delete;
+
+    // One CPU cycle: one read or write
+    void clock();
+    // True when the next clock fetches an opcode or starts an interrupt
+    bool Complete() const { return bBoundary; }
+
+    // How far the current instruction has got since the registers in bus.cpu
+    struct Progress {
+        int8_t nInterrupt = -1;         // Polled before it: 0 none, 1 IRQ, 2 NMI; -1 not yet
+        uint8_t nAccesses = 0;
+        std::array<Byte, 8> data{};     // Byte read or written by each access
+    };
+
+    void saveState(Progress& progress) const { progress = this->progress; }
+
+    // Starts over from the registers in bus.cpu, first running out the cycles
+    // the default core had left of an instruction, then replaying the
+    // progress given; the Bus calls it after a reset or a state load
+    void restart(const Progress* resume = nullptr);
+
+    // False if the coroutine frame did not fit in the storage for it
+    bool valid() const { return (bool)handle; }
+
+    uint64_t nCycles = 0;
+
+private:
+    struct Task {
+        struct promise_type {
+            // The frame goes into the core that runs it, never the heap
+            static void* operator new(std::size_t nSize, CycleCPU& cpu) noexcept {
+                return nSize <= cpu.frame.size() ? cpu.frame.data() : nullptr;
+            }
+            static void operator delete(void*) noexcept {}
+            static Task get_return_object_on_allocation_failure() noexcept { return Task{}; }
+
+            Task get_return_object() noexcept {
+                return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept {}
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // What co_await read()/write() returns: the data byte once clock() has
+    // made the access
+    struct Access {
+        CycleCPU &cpu;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) const noexcept {}
+        Byte await_resume() const noexcept { return cpu.data; }
+    };
+
+    Task run();
+
+    Access read(Address address) {
+        accessAddress = address;
+        bWrite = false;
+        return Access{ *this };
+    }
+    Access write(Address address, Byte value) {
+        accessAddress = address;
+        data = value;
+        bWrite = true;
+        return Access{ *this };
+    }
+
+    void setZN(Byte value);
+    void compare(Byte reg, Byte value);
+    void add(Byte value);
+    // Copies the registers into bus.cpu
+    void publish();
+
+    Bus &bus;
+    std::coroutine_handle<Task::promise_type> handle;
+
+    // The access the coroutine is waiting on
+    Address accessAddress = 0x0000;
+    Byte data = 0x00;
+    bool bWrite = false;
+    bool bBoundary = false;
+    Progress progress;
+    // Poll result restart() is replaying, or -1
+    int8_t nReplayInterrupt = -1;
+
+    Register A = 0x00;
+    Register X = 0x00;
+    Register Y = 0x00;
+    Register S = 0xFD;
+    Register P = StatusRegisterFlags::U;
+    Address PC = 0x0000;
+    // Cycles of an instruction the default core had begun
+    uint8_t nStall = 0;
+
+    alignas(std::max_align_t) std::array<std::byte, 1024> frame;
+};
+
+NES_PROFILE_END
+
+#endif
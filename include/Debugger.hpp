@@ -0,0 +1,131 @@
+#ifndef DEBUGGER_HPP
+#define DEBUGGER_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "Typedefs.hpp"
+#include "CPU.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+namespace BreakType {
+    enum Type {
+        EXECUTE = (1 << 0),
+        READ = (1 << 1),
+        WRITE = (1 << 2)
+    };
+}
+
+namespace BreakSpace {
+    enum Space {
+        CPU, // $0000-$FFFF as the CPU sees it
+        PPU  // $0000-$3FFF through PPU::ppuRead/ppuWrite
+    };
+}
+
+// What a condition looks at: a CPU register, or the byte being read, written
+// or (for EXECUTE) the opcode
+namespace BreakOperand {
+    enum Operand { A, X, Y, SP, P, PC, VALUE };
+}
+
+namespace BreakCompare {
+    enum Compare { EQUAL, NOT_EQUAL, LESS, GREATER_EQUAL, ANY_BITS };
+}
+
+struct BreakCondition {
+    BreakOperand::Operand operand;
+    BreakCompare::Compare compare;
+    uint16_t value;
+};
+
+// Breakpoints and watchpoints over the CPU and PPU address spaces.
+//
+// Each 256-byte page a breakpoint covers is flagged with the kinds of access
+// it watches. The bus and the PPU only call in here for accesses to a flagged
+// page, and only while a debugger is attached, so without one an access costs
+// a single null test. Reads the emulator makes on its own behalf (bReadOnly
+// peeks, the disassembler) are never reported.
+//
+// Read and write hits are reported as the accessing instruction runs and stop
+// runFrame() once it has finished; execute hits stop before the instruction.
+// PPU reads are only seen on frames that do their tile fetches, i.e. with
+// PPU output on or a mapper that watches the PPU bus.
+class Debugger
+{
+public:
+    explicit Debugger(Bus& bus);
+    ~Debugger();
+
+    struct Breakpoint {
+        uint32_t nId = 0;                   // Assigned by add()
+        BreakSpace::Space space = BreakSpace::CPU;
+        uint8_t types = BreakType::EXECUTE; // BreakType flags
+        Address first = 0x0000;
+        Address last = 0x0000;
+        std::vector<BreakCondition> conditions; // All have to hold
+        uint32_t nHits = 0;                 // Accesses that met the conditions
+        uint32_t nStopOnHit = 1;            // Stop once nHits reaches this
+        bool bStop = true;                  // False only counts hits
+        bool bEnabled = true;
+    };
+
+    // Returns the id of the new breakpoint
+    uint32_t add(const Breakpoint& breakpoint);
+    bool remove(uint32_t nId);
+    void clear();
+    // nullptr if there is no such id; call refresh() after changing its range,
+    // types or enabled state
+    Breakpoint* find(uint32_t nId);
+    void refresh();
+    const std::vector<Breakpoint>& breakpoints() const { return vBreakpoints; }
+
+    // What stopped the last run
+    struct Hit {
+        uint32_t nId;
+        BreakSpace::Space space;
+        BreakType::Type type;
+        Address address;
+        Byte value;
+        CPU::State cpu; // Registers when it happened
+    };
+
+    // Run until the frame is complete or a breakpoint stops it; true if stopped.
+    // After an execute stop the next run starts with that instruction.
+    bool runFrame();
+    // Run exactly one CPU instruction (after any DMA in the way); true if stopped
+    bool stepInstruction();
+
+    bool stopped() const { return bStopped; }
+    const Hit& lastHit() const { return hit; }
+
+    // Called by the Bus and PPU for flagged pages
+    void cpuAccess(BreakType::Type type, Address address, Byte value);
+    void ppuAccess(BreakType::Type type, Address address, Byte value);
+
+    // Kinds of access watched on each page
+    std::array<Byte, 256> cpuPages{};
+    std::array<Byte, 64> ppuPages{};
+
+private:
+    bool aboutToExecute() const;
+    void checkExecute();
+    void check(BreakSpace::Space space, BreakType::Type type, Address address, Byte value);
+    bool holds(const BreakCondition& condition, const CPU::State& cpu, Byte value) const;
+
+    Bus &bus;
+    std::vector<Breakpoint> vBreakpoints;
+    uint32_t nNextId = 1;
+
+    bool bStopped = false;
+    Hit hit{};
+
+    // An execute stop leaves the CPU on that instruction; resuming runs it
+    // without stopping again. -1 when not resuming from one.
+    int32_t nResumeAddress = -1;
+};
+
+#endif
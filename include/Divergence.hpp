@@ -0,0 +1,63 @@
+#ifndef DIVERGENCE_HPP
+#define DIVERGENCE_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include "Typedefs.hpp"
+#include "CPU.hpp"
+#include "StateHash.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+class Debugger;
+
+// Finds where two runs of the same ROM and input stop agreeing.
+//
+// A movie holds two controller bytes per frame, as nes_step_frames() takes
+// them. Both machines run it frame by frame through Bus::clockFrame() and
+// their StateHash parts are compared after every frame. At the first frame
+// that differs, both are rewound to its start and stepped one instruction at
+// a time, comparing CPU registers and RAM, to name the first instruction
+// whose result differs. A frame can also differ only in the PPU or the
+// picture, in which case no instruction is named.
+//
+// Two configurations of this build (video output on and off, cheats, ...)
+// are compared in one process with compare(). Two builds each write a log
+// with writeFrameLog(), and then writeInstructionLog() for the frame that
+// firstDifference() finds between the frame logs.
+class Divergence
+{
+public:
+    struct Report {
+        bool bDiverged = false;
+        uint64_t nFrame = 0;         // First frame whose end state differs
+        uint32_t nParts = 0;         // Bits of 1 << StatePart that differ
+        int64_t nInstruction = -1;   // Within that frame; -1 if the CPU agreed throughout
+        CPU::State a{};              // Registers before that instruction on each side
+        CPU::State b{};
+    };
+
+    // Both machines must be at the same starting point, e.g. just reset.
+    // Parts outside nMask are not compared.
+    static Report compare(Bus& a, Bus& b, const std::vector<Byte>& movie, uint32_t nMask = ~0u);
+
+    // One line per frame: the frame number, then every StatePart hash
+    static void writeFrameLog(Bus& bus, const std::vector<Byte>& movie, std::ostream& out);
+    // Runs up to nFrame, then one line per instruction of it: the count, PC
+    // and the hash of CPU registers and RAM after it
+    static void writeInstructionLog(Bus& bus, const std::vector<Byte>& movie, uint64_t nFrame, std::ostream& out);
+    // Index of the first line that differs, or -1 if the logs agree as far
+    // as the shorter one goes
+    static int64_t firstDifference(std::istream& a, std::istream& b);
+
+private:
+    static void setInput(Bus& bus, const std::vector<Byte>& movie, uint64_t nFrame);
+    // Runs an instruction and whatever DMA comes before it; false once that
+    // completes the frame
+    static bool stepInstruction(Bus& bus, Debugger& debugger);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef FOOTPRINT_HPP
+#define FOOTPRINT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CorePolicy.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+// Bytes one machine takes, component by component, for sizing hosts that
+// run a great many of them.
+//
+// What a machine owns is counted apart from what it shares: ROM images held
+// by more than one cartridge (clones) and PagedMemory pages no copy has
+// written to yet cost once per group, not once per machine. Tools attached to
+// the Bus are not part of the machine and are not counted.
+class Footprint
+{
+public:
+    struct Component {
+        std::string sName;
+        size_t nOwned = 0;
+        size_t nShared = 0;
+    };
+
+    // Every component of bus and the cartridge in it, in a fixed order
+    static std::vector<Component> measure(const Bus& bus);
+    // Sum of the owned bytes: what one more machine costs
+    static size_t owned(const std::vector<Component>& vComponents);
+
+    // One line per component and the totals
+    static void write(const std::vector<Component>& vComponents, std::ostream& out);
+};
+
+#endif
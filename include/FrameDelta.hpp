@@ -0,0 +1,71 @@
+#ifndef FRAME_DELTA_HPP
+#define FRAME_DELTA_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+#include "PPU.hpp"
+#include "Benchmark.hpp"
+
+// Scanline-level change tracking for consumers that stream or re-encode
+// frames. Most frames only change a status bar or a sprite or two, and this
+// lets a consumer skip the lines that did not change.
+//
+// update() takes each frame after it is drawn. While it sees every frame it
+// trusts the PPU's dirty lines and hashes only those. After a gap it hashes
+// every line and compares. The line hashes identify content, so a consumer
+// can also match lines against any frame it kept.
+//
+// A delta is a mask of SCREEN_HEIGHT bits (bit y % 8 of byte y / 8), then
+// SCREEN_WIDTH palette indices for each line set in it. The first delta, and
+// the first after reset(), is a key frame with every line.
+class FrameDelta
+{
+public:
+    static constexpr size_t MASK_BYTES = SCREEN_HEIGHT / 8;
+
+    // False if no frame was drawn since the last call
+    bool update(const PPU& ppu);
+    // The next update() reports every line changed
+    void reset();
+
+    // Lines changed between the previous update() and the last
+    const PPU::LineMask& changed() const { return changedLines; }
+    bool changed(uint16_t y) const { return (changedLines[y / 64] >> (y % 64)) & 1; }
+    uint32_t changedCount() const;
+    // Hash of each line of the last frame updated
+    const std::array<uint64_t, SCREEN_HEIGHT>& lineHashes() const { return vLineHashes; }
+
+    // Appends the delta that turns the previous frame into ppu's, which must
+    // be the frame last passed to update()
+    void encode(const PPU& ppu, std::vector<Byte>& vOut) const;
+    // Applies a delta to the frame it was made against. False if malformed.
+    static bool apply(const Byte* pDelta, size_t nSize, Byte* frame);
+
+    // What delta encoding saves over sending every frame whole
+    struct Savings {
+        std::string sName;
+        bool bValid = false;
+        uint64_t nFrames = 0;
+        uint64_t nChangedLines = 0;
+        uint64_t nFullBytes = 0;
+        uint64_t nDeltaBytes = 0;
+    };
+
+    // Plays each title of a Benchmark corpus with video on and encodes every frame
+    static std::vector<Savings> measure(const std::vector<Benchmark::Title>& vTitles);
+    static Savings measure(const Benchmark::Title& title);
+    static void writeSavings(const std::vector<Savings>& vSavings, std::ostream& out);
+
+private:
+    PPU::LineMask changedLines = {};
+    std::array<uint64_t, SCREEN_HEIGHT> vLineHashes = {};
+    uint32_t nLastFrame = 0;
+    bool bKey = true;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef INSTANCE_ARENA_HPP
+#define INSTANCE_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+namespace ArenaBacking {
+    enum Backing : uint8_t {
+        NONE,           // Nothing reserved yet
+        HEAP,           // Aligned heap block, where mmap is not available
+        PAGES,          // Anonymous mapping of ordinary pages
+        TRANSPARENT,    // Anonymous mapping the kernel was asked to back with 2 MB pages
+        HUGETLB         // Mapping of reserved 2 MB pages (MAP_HUGETLB)
+    };
+}
+
+// Memory for hosts that run a great many machines. Each machine gets one
+// slot of a single 2 MB-aligned mapping: the Bus object (CPU registers, CPU
+// RAM and the PPU) at the front, then a pool its own allocations come from:
+// PagedMemory pages (nametables, PRG-RAM, CHR-RAM), the frame buffer, and
+// the mapper and cartridge objects. A machine then spans a few contiguous,
+// cache-line-aligned pages instead of a dozen heap blocks, and a run of
+// machines shares the TLB entries of a few 2 MB pages.
+//
+// reserve() maps the arena, preferring reserved huge pages, then transparent
+// huge pages, then ordinary ones, and touches none of it. create() touches a
+// slot, so the kernel places it on the NUMA node of the calling thread: call
+// it from the worker that will run the machine. Slots in one 2 MB page land
+// together on the node of whichever thread touches the page first, so a
+// worker should create whole runs of slotsPerHugePage() slots.
+//
+// A slot and everything allocated from it belong to one thread at a time.
+// When its pool is full, allocations go to the heap, so a machine never
+// runs out of memory here. ROM images stay on the heap because clones share
+// them. Saved states and clones of a machine may hold its pages, so they
+// must not outlive the arena.
+class InstanceArena
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t CACHE_LINE = 64;
+    // Room for a machine drawing frames on a board with PRG-RAM, CHR-RAM and
+    // four-screen nametables, 16 to a 2 MB page
+    static constexpr size_t DEFAULT_SLOT_SIZE = 128 * 1024;
+
+    InstanceArena() = default;
+    ~InstanceArena();
+
+    InstanceArena(const InstanceArena&) = delete;
+    InstanceArena& operator=(const InstanceArena&) = delete;
+
+    // Maps room for nSlots machines; nSlotSize is rounded up to a cache
+    // line. False if it is already reserved or nothing could be mapped.
+    bool reserve(uint32_t nSlots, size_t nSlotSize = DEFAULT_SLOT_SIZE);
+
+    // Builds a Bus with no cartridge in a free slot. Hold a Scope for the
+    // slot while loading its cartridge and while running it, so the mapper,
+    // the cartridge's RAM and pages unshared by copy-on-write land in the
+    // slot too. nullptr if the slot is out of range or taken.
+    Bus* create(uint32_t slot);
+    void destroy(uint32_t slot);
+    Bus* machine(uint32_t slot) const;
+
+    uint32_t slots() const { return nSlots; }
+    size_t slotSize() const { return nSlotSize; }
+    uint32_t slotsPerHugePage() const { return nSlotSize > 0 ? (uint32_t)(HUGE_PAGE_SIZE / nSlotSize) : 0; }
+    ArenaBacking::Backing backing() const { return nBacking; }
+    // Bytes of a slot's allocations that did not fit and went to the heap
+    size_t spilled(uint32_t slot) const;
+
+    // While alive, allocations this thread makes through resource() or
+    // makeShared() come from the slot's pool. Scopes nest.
+    class Scope
+    {
+    public:
+        Scope(InstanceArena& arena, uint32_t slot);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        std::pmr::memory_resource *previous;
+    };
+
+    // Where the memory of the machine being built or run comes from: the pool
+    // of the slot in scope on this thread, or the heap
+    static std::pmr::memory_resource* resource();
+
+    // std::make_shared from resource(). The object and its control block are
+    // one block; releasing it returns the block to wherever it came from.
+    template <typename T, typename... Args>
+    static std::shared_ptr<T> makeShared(Args&&... args) {
+        return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource()), std::forward<Args>(args)...);
+    }
+
+private:
+    class Slot;
+
+    void release();
+
+    Byte *pBase = nullptr;
+    size_t nMapped = 0;
+    uint32_t nSlots = 0;
+    size_t nSlotSize = 0;
+    ArenaBacking::Backing nBacking = ArenaBacking::NONE;
+    // Set once a slot is first touched; its pool lives on after destroy()
+    // for anything that still holds its blocks
+    std::vector<Slot*> vSlots;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef LANE_VECTOR_HPP
+#define LANE_VECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "Typedefs.hpp"
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// One vector of 8-bit lanes. All kernels are written against these helpers,
+// so the widest instruction set the build targets is picked up automatically.
+// Comparisons return 0xFF/0x00 lane masks; vMaskBits packs the top bit of
+// every lane into an integer, lane 0 in bit 0. vLookup64 maps lanes holding
+// 0x00-0x3F through a 64-byte table.
+#if defined(__AVX512BW__)
+typedef __m512i LaneVector;
+constexpr size_t LANE_VECTOR_WIDTH = 64;
+
+inline LaneVector vLoad(const Byte* p) { return _mm512_loadu_si512(p); }
+inline void vStore(Byte* p, LaneVector v) { _mm512_storeu_si512(p, v); }
+inline LaneVector vSet(Byte b) { return _mm512_set1_epi8((char)b); }
+inline LaneVector vAnd(LaneVector a, LaneVector b) { return _mm512_and_si512(a, b); }
+inline LaneVector vOr(LaneVector a, LaneVector b) { return _mm512_or_si512(a, b); }
+inline LaneVector vXor(LaneVector a, LaneVector b) { return _mm512_xor_si512(a, b); }
+inline LaneVector vAdd(LaneVector a, LaneVector b) { return _mm512_add_epi8(a, b); }
+inline LaneVector vSub(LaneVector a, LaneVector b) { return _mm512_sub_epi8(a, b); }
+inline LaneVector vEq(LaneVector a, LaneVector b) { return _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(a, b)); }
+inline LaneVector vGeU(LaneVector a, LaneVector b) { return _mm512_movm_epi8(_mm512_cmpge_epu8_mask(a, b)); }
+inline LaneVector vSelect(LaneVector m, LaneVector a, LaneVector b) { return _mm512_mask_blend_epi8(_mm512_movepi8_mask(m), b, a); }
+inline LaneVector vShr1(LaneVector a) { return _mm512_and_si512(_mm512_srli_epi16(a, 1), _mm512_set1_epi8(0x7F)); }
+inline uint64_t vMaskBits(LaneVector m) { return _mm512_movepi8_mask(m); }
+inline LaneVector vMaxU(LaneVector a, LaneVector b) { return _mm512_max_epu8(a, b); }
+inline LaneVector vLookup64(const Byte* table, LaneVector idx) {
+    LaneVector r01 = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(idx, _mm512_set1_epi8(0x10)),
+        _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)table)), idx),
+        _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(table + 16))), idx));
+    LaneVector r23 = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(idx, _mm512_set1_epi8(0x10)),
+        _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(table + 32))), idx),
+        _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(table + 48))), idx));
+    return _mm512_mask_blend_epi8(_mm512_test_epi8_mask(idx, _mm512_set1_epi8(0x20)), r01, r23);
+}
+#elif defined(__AVX2__)
+typedef __m256i LaneVector;
+constexpr size_t LANE_VECTOR_WIDTH = 32;
+
+inline LaneVector vLoad(const Byte* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline void vStore(Byte* p, LaneVector v) { _mm256_storeu_si256((__m256i*)p, v); }
+inline LaneVector vSet(Byte b) { return _mm256_set1_epi8((char)b); }
+inline LaneVector vAnd(LaneVector a, LaneVector b) { return _mm256_and_si256(a, b); }
+inline LaneVector vOr(LaneVector a, LaneVector b) { return _mm256_or_si256(a, b); }
+inline LaneVector vXor(LaneVector a, LaneVector b) { return _mm256_xor_si256(a, b); }
+inline LaneVector vAdd(LaneVector a, LaneVector b) { return _mm256_add_epi8(a, b); }
+inline LaneVector vSub(LaneVector a, LaneVector b) { return _mm256_sub_epi8(a, b); }
+inline LaneVector vEq(LaneVector a, LaneVector b) { return _mm256_cmpeq_epi8(a, b); }
+inline LaneVector vGeU(LaneVector a, LaneVector b) { return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a); }
+inline LaneVector vSelect(LaneVector m, LaneVector a, LaneVector b) { return _mm256_blendv_epi8(b, a, m); }
+inline LaneVector vShr1(LaneVector a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)); }
+inline uint64_t vMaskBits(LaneVector m) { return (uint32_t)_mm256_movemask_epi8(m); }
+inline LaneVector vMaxU(LaneVector a, LaneVector b) { return _mm256_max_epu8(a, b); }
+inline LaneVector vLookup64(const Byte* table, LaneVector idx) {
+    // pshufb looks up 16 entries per 128-bit half; bits 4 and 5 of the index
+    // pick between the four quarters of the table
+    LaneVector bit4 = _mm256_slli_epi16(idx, 3);
+    LaneVector bit5 = _mm256_slli_epi16(idx, 2);
+    LaneVector r01 = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table)), idx),
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + 16))), idx), bit4);
+    LaneVector r23 = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + 32))), idx),
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + 48))), idx), bit4);
+    return _mm256_blendv_epi8(r01, r23, bit5);
+}
+#else
+typedef Byte LaneVector;
+constexpr size_t LANE_VECTOR_WIDTH = 1;
+
+inline LaneVector vLoad(const Byte* p) { return *p; }
+inline void vStore(Byte* p, LaneVector v) { *p = v; }
+inline LaneVector vSet(Byte b) { return b; }
+inline LaneVector vAnd(LaneVector a, LaneVector b) { return a & b; }
+inline LaneVector vOr(LaneVector a, LaneVector b) { return a | b; }
+inline LaneVector vXor(LaneVector a, LaneVector b) { return a ^ b; }
+inline LaneVector vAdd(LaneVector a, LaneVector b) { return a + b; }
+inline LaneVector vSub(LaneVector a, LaneVector b) { return a - b; }
+inline LaneVector vEq(LaneVector a, LaneVector b) { return a == b ? 0xFF : 0x00; }
+inline LaneVector vGeU(LaneVector a, LaneVector b) { return a >= b ? 0xFF : 0x00; }
+inline LaneVector vSelect(LaneVector m, LaneVector a, LaneVector b) { return (m & a) | (~m & b); }
+inline LaneVector vShr1(LaneVector a) { return a >> 1; }
+inline uint64_t vMaskBits(LaneVector m) { return m >> 7; }
+inline LaneVector vMaxU(LaneVector a, LaneVector b) { return a > b ? a : b; }
+inline LaneVector vLookup64(const Byte* table, LaneVector idx) { return table[idx & 0x3F]; }
+#endif
+
+inline LaneVector vNot(LaneVector a) {
+    return vXor(a, vSet(0xFF));
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LOAD_GENERATOR_HPP
+#define LOAD_GENERATOR_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Load test for a running Server. Several client threads, each with its own
+// connection, create instances running one ROM. Then each sends nRequests
+// batches, and each batch steps every one of its instances. Each batch is
+// timed from send to the last result. The report gives throughput and the
+// latency percentiles of every batch.
+class LoadGenerator
+{
+public:
+    struct Result {
+        bool bValid = false;
+        std::string sError;             // Why bValid is false
+        uint64_t nRequests = 0;         // Batches sent
+        uint64_t nSteps = 0;            // STEP commands run
+        uint64_t nFrames = 0;
+        double dSeconds = 0.0;
+        double dStepsPerSecond = 0.0;
+        double dFramesPerSecond = 0.0;
+        // Batch round trips, in microseconds
+        double dLatencyP50 = 0.0;
+        double dLatencyP90 = 0.0;
+        double dLatencyP99 = 0.0;
+        double dLatencyMax = 0.0;
+    };
+
+    Result run() const;
+
+    static void writeReport(const Result& result, std::ostream& out);
+
+    std::string sSocket;
+    std::string sROM;
+    uint32_t nClients = 4;
+    uint32_t nInstances = 8;            // Per client
+    uint32_t nFramesPerStep = 1;
+    uint32_t nRequests = 1000;          // Per client
+    // Have the server render frames into the views
+    bool bVideo = false;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef LOCKSTEP_BATCH_HPP
+#define LOCKSTEP_BATCH_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+#include "Bus.hpp"
+
+// Steps N copies of the same game in lockstep for batched rollouts.
+//
+// The CPU registers of all lanes live here structure-of-arrays. Every step picks
+// the PC most lanes agree on and retires the instruction for the whole group
+// with one SIMD kernel (AVX-512BW, AVX2 or a portable loop, chosen at compile
+// time) when there is one for it: register operations, branches, jumps, and
+// loads, stores and read-modify-writes of CPU RAM through zero page and
+// absolute addressing, plain or indexed. Lanes at a different PC, and every
+// other instruction or address, run on the lane's own CPU; a lane rejoins the
+// group as soon as its PC matches again.
+//
+// Each lane is a full Bus, so PPU and cartridge stay per instance. While the
+// batch runs, it also keeps every lane's CPU RAM structure-of-arrays, one row
+// per address, so a kernel loads or stores a whole vector of lanes at once.
+// Lane buses write through to it, and the lanes' own cpuRam stays current.
+//
+// Lockstep only pays while lanes run the same code. After a frame in which
+// the kernels retired less than dMinVectorShare of the lane-instructions,
+// every lane plays the next nFramesAlone frames through its own
+// Bus::clockFrame(), as if it were not in a batch, and the batch then tries
+// lockstep again. Lanes hand over at instruction boundaries, so the result
+// is the same either way.
+class LockstepBatch
+{
+public:
+    LockstepBatch(const std::string& sFileName, size_t nLanes);
+    ~LockstepBatch();
+
+    void reset();
+
+    // Retire one instruction on every active lane. Loads the lanes' RAM into
+    // the batch each time, so run many instructions through stepFrames().
+    void step();
+    // Run every lane until it has completed nFrames more frames, in lockstep
+    // or alone as the vectorised share decides
+    void stepFrames(uint32_t nFrames);
+
+    size_t laneCount() const;
+    Bus& lane(size_t index);
+
+    // Copy the lane registers back into each lane's CPU, e.g. before running a
+    // lane on its own or inspecting it
+    void syncLanes();
+
+    // Lane-instructions retired by the SIMD kernels and by the scalar fallback
+    uint64_t nVectorInstructions = 0;
+    uint64_t nScalarInstructions = 0;
+    // Lane-frames played through the lanes' own Bus::clockFrame()
+    uint64_t nLaneFramesAlone = 0;
+
+    // Below this share of lane-instructions vectorised in a frame, the lanes
+    // play nFramesAlone frames alone; 0 keeps every frame in lockstep
+    double dMinVectorShare = 0.75;
+    uint32_t nFramesAlone = 32;
+
+private:
+    void attachRam();
+    void detachRam();
+    void stepLanes();
+    void stepFramesLockstep(uint32_t nFrames);
+    void stepFramesAlone(uint32_t nFrames);
+    void copyToCPU(size_t index);
+    void copyFromCPU(size_t index);
+    void stepScalar(size_t index);
+    void clockPPU(size_t index, uint32_t nDots);
+    void advanceLane(size_t index, uint8_t nCycles);
+    size_t electLeader() const;
+    size_t buildGroup(size_t leader);
+    // Bytes of an instruction, opcode included
+    static uint8_t instructionLength(AddressingMode mode);
+    // Each returns how many lanes it retired the instruction for
+    size_t runKernel(Opcode opcode, Address operand);
+    size_t runBranch(Byte flag, bool bTakenWhenSet, Byte operand);
+    size_t runStackKernel(Opcode opcode, Address operand);
+    const Byte* resolveAddresses(AddressingMode mode, Address operand);
+    void storeToGroup(const Byte* values);
+    Byte& laneRam(size_t index, Address addr) { return ram[(addr & MEMORY_UNIT.second) * nPaddedLanes + index]; }
+    void writeLaneRam(size_t index, Address addr, Byte data);
+
+    size_t nLanes = 0;
+    size_t nPaddedLanes = 0;
+    std::vector<std::unique_ptr<Bus>> lanes;
+
+    // Structure-of-arrays lane state, padded to a whole number of vectors
+    std::vector<Byte> A;
+    std::vector<Byte> X;
+    std::vector<Byte> Y;
+    std::vector<Byte> SP;
+    std::vector<Byte> P;
+    std::vector<Address> PC;
+
+    // Every lane's CPU RAM, ram[address * nPaddedLanes + lane], kept while
+    // stepping
+    std::vector<Byte> ram;
+    // Per lane operand value and effective address of the instruction a
+    // kernel is running; the address is the same for every lane when
+    // bUniformAddress is set
+    std::vector<Byte> operandLanes;
+    std::vector<Address> addressLanes;
+    bool bUniformAddress = false;
+    Address uniformAddress = 0x0000;
+
+    // 0xFF/0x00 lane masks
+    std::vector<Byte> active;
+    std::vector<Byte> group;
+
+    std::vector<uint8_t> laneCycles;
+    std::vector<uint32_t> laneFrames;
+    // Frames left before lockstep is tried again
+    uint32_t nFramesAloneLeft = 0;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef LOCKSTEP_BENCHMARK_HPP
+#define LOCKSTEP_BENCHMARK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Benchmark.hpp"
+
+// Throughput of a LockstepBatch against the same lanes run one Bus at a time.
+//
+// Every lane plays the controller bytes of the title's movie; its reset
+// commands are dropped, as a batch cannot reset one lane. To look like a
+// batch of rollouts rather than copies of one, every lane but the first
+// replaces the input of one frame in nExploreEvery with a pad of its own,
+// the same in both modes. Only the frames are timed, the fastest of
+// nRepeats runs is kept, and each mode ends with a hash of every lane's RAM
+// and cartridge, which must be the same in both. differingLanes() names the
+// lanes where they are not.
+class LockstepBenchmark
+{
+public:
+    struct Result {
+        std::string sMode;              // "scalar" or "lockstep"
+        bool bValid = false;            // False if the ROM or movie did not load
+        size_t nLanes = 0;
+        uint64_t nFrames = 0;           // Over every lane
+        double dSeconds = 0.0;
+        double dFramesPerSecond = 0.0;
+        // Lane-instructions retired by the SIMD kernels; 0 for "scalar"
+        double dVectorFraction = 0.0;
+        // Lane-frames the batch left to the lanes' own Bus; 0 for "scalar"
+        double dAloneFraction = 0.0;
+        // RAM and cartridge of each lane, in lane order, and of all of them
+        std::vector<uint64_t> vLaneHashes;
+        uint64_t nStateHash = 0;
+    };
+
+    // One Bus per lane, then the batch
+    std::vector<Result> run() const;
+    Result run(bool bLockstep) const;
+
+    // Lanes whose RAM or cartridge ended differently in the two results
+    static std::vector<size_t> differingLanes(const Result& first, const Result& second);
+
+    static void writeReport(const std::vector<Result>& vResults, std::ostream& out);
+
+    Benchmark::Title title;
+    size_t nLanes = 64;
+    // Frames per lane from the start of the movie; 0 plays all of it
+    uint32_t nFrames = 0;
+    uint32_t nRepeats = 3;
+    // 0 keeps every lane on the movie
+    uint32_t nExploreEvery = 8;
+    // Render frames as a front end would
+    bool bVideo = false;
+};
+
+#endif
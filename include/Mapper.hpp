@@ -2,20 +2,88 @@
 #define MAPPER_HPP
 
 #include <cstdint>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
 #include "Typedefs.hpp"
+#include "PagedMemory.hpp"
 
 class Mapper {
 public:
     Mapper(uint8_t, uint8_t);
-    ~Mapper();
+    virtual ~Mapper();
 
-    virtual bool cpuMapRead(Address, uint32_t&) = 0;
-    virtual bool cpuMapWrite(Address, uint32_t&) = 0;
-    virtual bool ppuMapRead(Address, uint32_t&) = 0;
-    virtual bool ppuMapWrite(Address, uint32_t&) = 0;
+    // Returned as the mapped address when the mapper supplied or consumed the data itself
+    // (PRG-RAM, bank registers) and the cartridge must not touch its ROM vectors.
+    static constexpr uint32_t MAPPED_INTERNALLY = 0xFFFFFFFF;
+
+    virtual bool cpuMapRead(Address, uint32_t&, Byte&);
+    virtual bool cpuMapWrite(Address, uint32_t&, Byte data = 0) = 0;
+    virtual bool ppuMapRead(Address, uint32_t&);
+    virtual bool ppuMapWrite(Address, uint32_t&);
+
+    virtual void reset() = 0;
+    // Copy of the mapper with its registers; PRG-RAM pages stay shared until written
+    virtual std::shared_ptr<Mapper> clone() const = 0;
+    // Takes over the registers and PRG-RAM pages of another mapper of the same
+    // board without allocating; false, and nothing copied, for another board
+    virtual bool copyFrom(const Mapper&) = 0;
+    // Bytes of the mapper object itself, registers included
+    virtual size_t objectSize() const = 0;
+    virtual Mirroring::Mode mirror() { return Mirroring::HARDWARE; }
+
+    // True when the mapper reacts to the addresses the PPU puts on the bus
+    // (e.g. counting A12 edges), so every PPU fetch has to really happen
+    virtual bool observesPPUBus() const { return false; }
+
+    // Level of the cartridge IRQ line, held until the game acknowledges it
+    virtual bool irqState() { return false; }
+    virtual void irqClear() {}
+
+    // Offset into PRG-ROM of the 8 KB window that holds a $8000-$FFFF address
+    uint32_t prgBankBase(Address address) const { return prgBankTable[(address >> 13) & 0x03]; }
+    // Where CPU reads of a $8000-$FFFF address really go: prgBankBase() with
+    // any patched copy of the bank swapped in, an offset into the overlay's
+    // image past the end of PRG-ROM
+    uint32_t prgReadBase(Address address) const { return prgReadTable[(address >> 13) & 0x03]; }
+    const std::vector<uint32_t>* prgOverlay() const { return pPRGOverlay.get(); }
+    // Offset into CHR memory of the 1 KB window that holds a $0000-$1FFF address
+    uint32_t chrBankBase(Address address) const { return chrBankTable[(address >> 10) & 0x07]; }
+    // Battery/work RAM as the board holds it, empty without any
+    const PagedMemory& prgRam() const { return vPRGRam; }
+
+    // Where CPU reads go for each 8 KB bank in each window, indexed by
+    // window * banks + bank; offsets past the ROM are patched copies of a
+    // bank (see Cartridge::patchPRG). nullptr reads the ROM everywhere.
+    void setPRGOverlay(std::shared_ptr<const std::vector<uint32_t>> pOverlay);
 
     uint8_t nPRGBanks = 0;
     uint8_t nCHRBanks = 0;
+
+protected:
+    // Bank switching only rewrites these base offsets; every access is then a
+    // table lookup plus the offset inside the window.
+    // PRG: four 8 KB windows at $8000, $A000, $C000 and $E000.
+    // CHR: eight 1 KB windows covering $0000-$1FFF.
+    std::array<uint32_t, 4> prgBankTable{};
+    std::array<uint32_t, 8> chrBankTable{};
+    // prgBankTable as the CPU reads it, with patched banks swapped in
+    std::array<uint32_t, 4> prgReadTable{};
+    std::shared_ptr<const std::vector<uint32_t>> pPRGOverlay;
+
+    // Battery/work RAM at $6000-$7FFF, left empty for boards without it
+    PagedMemory vPRGRam;
+
+    void mapPRG8k(uint8_t slot, uint32_t bank);
+    void mapPRG16k(uint8_t slot, uint32_t bank);
+    void mapPRG32k(uint32_t bank);
+    void mapCHR1k(uint8_t slot, uint32_t bank);
+    void mapCHR4k(uint8_t slot, uint32_t bank);
+    void mapCHR8k(uint32_t bank);
+
+    uint32_t prgBankCount8k() const { return nPRGBanks * 2; }
+    uint32_t chrBankCount1k() const { return nCHRBanks == 0 ? 8 : nCHRBanks * 8; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,16 +4,18 @@
 #include "../Mapper.hpp"
 #include "../Typedefs.hpp"
 
+// NROM: fixed 16 KB or 32 KB PRG, fixed 8 KB CHR
 class Mapper_000 : public Mapper
 {
 public:
     Mapper_000(uint8_t prgBanks, uint8_t chrBanks);
     ~Mapper_000();
 
-    virtual bool cpuMapRead(Address address, uint32_t &mappedAddress) override;
-    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress) override;
-    virtual bool ppuMapRead(Address address, uint32_t &mappedAddress) override;
-    virtual bool ppuMapWrite(Address address, uint32_t &mappedAddress) override;
+    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data = 0) override;
+    virtual void reset() override;
+    virtual std::shared_ptr<Mapper> clone() const override;
+    virtual bool copyFrom(const Mapper& other) override;
+    virtual size_t objectSize() const override { return sizeof(*this); }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,35 @@
+#ifndef MAPPER_001_HPP
+#define MAPPER_001_HPP
+
+#include "../Mapper.hpp"
+#include "../Typedefs.hpp"
+
+// MMC1 (SxROM): serial shift register loaded one bit per write
+class Mapper_001 : public Mapper
+{
+public:
+    Mapper_001(uint8_t prgBanks, uint8_t chrBanks);
+    ~Mapper_001();
+
+    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data = 0) override;
+    virtual void reset() override;
+    virtual std::shared_ptr<Mapper> clone() const override;
+    virtual bool copyFrom(const Mapper& other) override;
+    virtual size_t objectSize() const override { return sizeof(*this); }
+    virtual Mirroring::Mode mirror() override;
+
+private:
+    void updateBanks();
+
+    Byte nLoadRegister = 0x00;
+    Byte nLoadRegisterCount = 0x00;
+    Byte nControlRegister = 0x00;
+
+    Byte nCHRBankSelect0 = 0x00;
+    Byte nCHRBankSelect1 = 0x00;
+    Byte nPRGBankSelect = 0x00;
+
+    Mirroring::Mode mirrormode = Mirroring::HORIZONTAL;
+};
+
+#endif
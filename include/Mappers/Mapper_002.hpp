@@ -0,0 +1,21 @@
+#ifndef MAPPER_002_HPP
+#define MAPPER_002_HPP
+
+#include "../Mapper.hpp"
+#include "../Typedefs.hpp"
+
+// UxROM: switchable 16 KB at $8000, last 16 KB fixed at $C000
+class Mapper_002 : public Mapper
+{
+public:
+    Mapper_002(uint8_t prgBanks, uint8_t chrBanks);
+    ~Mapper_002();
+
+    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data = 0) override;
+    virtual void reset() override;
+    virtual std::shared_ptr<Mapper> clone() const override;
+    virtual bool copyFrom(const Mapper& other) override;
+    virtual size_t objectSize() const override { return sizeof(*this); }
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef MAPPER_003_HPP
+#define MAPPER_003_HPP
+
+#include "../Mapper.hpp"
+#include "../Typedefs.hpp"
+
+// CNROM: fixed PRG, switchable 8 KB CHR
+class Mapper_003 : public Mapper
+{
+public:
+    Mapper_003(uint8_t prgBanks, uint8_t chrBanks);
+    ~Mapper_003();
+
+    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data = 0) override;
+    virtual void reset() override;
+    virtual std::shared_ptr<Mapper> clone() const override;
+    virtual bool copyFrom(const Mapper& other) override;
+    virtual size_t objectSize() const override { return sizeof(*this); }
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MAPPER_004_HPP
+#define MAPPER_004_HPP
+
+#include <array>
+#include "../Mapper.hpp"
+#include "../Typedefs.hpp"
+
+// MMC3 (TxROM): 8 KB PRG / 1-2 KB CHR banking and a scanline counter
+// clocked by rising edges of PPU address line A12
+class Mapper_004 : public Mapper
+{
+public:
+    Mapper_004(uint8_t prgBanks, uint8_t chrBanks);
+    ~Mapper_004();
+
+    virtual bool cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data = 0) override;
+    virtual bool ppuMapRead(Address address, uint32_t &mappedAddress) override;
+    virtual bool ppuMapWrite(Address address, uint32_t &mappedAddress) override;
+    virtual void reset() override;
+    virtual std::shared_ptr<Mapper> clone() const override;
+    virtual bool copyFrom(const Mapper& other) override;
+    virtual size_t objectSize() const override { return sizeof(*this); }
+    virtual Mirroring::Mode mirror() override;
+    virtual bool observesPPUBus() const override { return true; }
+
+    virtual bool irqState() override;
+    virtual void irqClear() override;
+
+private:
+    void updateBanks();
+    void watchA12(Address address);
+    void scanline();
+
+    // A12 has to stay low for this many PPU bus accesses before a rising edge
+    // counts. It swallows the toggling between the eight sprite pattern fetches
+    // of a line, which are separated by two nametable accesses each.
+    static constexpr uint8_t A12_LOW_FILTER = 8;
+
+    Byte nTargetRegister = 0x00;
+    bool bPRGBankMode = false;
+    bool bCHRInversion = false;
+    std::array<Byte, 8> pRegister{};
+
+    Mirroring::Mode mirrormode = Mirroring::HORIZONTAL;
+
+    bool bIRQActive = false;
+    bool bIRQEnable = false;
+    bool bIRQReload = false;
+    Byte nIRQCounter = 0x00;
+    Byte nIRQLatch = 0x00;
+    Byte nA12LowCount = 0x00;
+};
+
+#endif
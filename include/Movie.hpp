@@ -0,0 +1,49 @@
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+// Commands an input line can carry besides the buttons, as in FM2
+namespace MovieCommand {
+    enum Flags {
+        SOFT_RESET = (1 << 0),  // Reset button, taken before the frame
+        HARD_RESET = (1 << 1)   // Power cycle: RAM cleared, then reset
+    };
+}
+
+// Recorded input: both controllers and any reset for every frame.
+//
+// Reads the input lines of an FCEUX .fm2 movie, "|commands|RLDUTSBA|RLDUTSBA|...|",
+// where any button character other than '.' or ' ' means held; header lines
+// and the optional Famicom port field are skipped. A movie starts from a
+// machine that has just been reset.
+class Movie
+{
+public:
+    struct Frame {
+        Byte controller[2] = { 0x00, 0x00 };  // In the bit order of Bus::controller
+        Byte commands = 0x00;                  // MovieCommand flags
+    };
+
+    bool load(const std::string& sFileName);
+    bool parse(std::istream& is);
+
+    // Takes this frame's commands and buttons; then run it with clockFrame()
+    void apply(Bus& bus, size_t nFrame) const;
+
+    // Two controller bytes per frame, as nes_step_frames() and Divergence
+    // take them; the commands are dropped
+    std::vector<Byte> controllerBytes() const;
+
+    std::vector<Frame> vFrames;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef OBSERVATION_HPP
+#define OBSERVATION_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Typedefs.hpp"
+#include "PPU.hpp"
+
+namespace GrayscaleConversion {
+    enum Mode {
+        LUMA,    // BT.601 weights, as most agent pipelines use
+        AVERAGE  // Plain mean of R, G and B
+    };
+}
+
+// Turns PPU frames into agent observations without leaving the core: palette
+// indices go through a 64-entry grey LUT, two consecutive frames are
+// max-pooled (sprites that flicker on alternate frames stay visible), and
+// the result is area-downscaled into the next slot of a frame-stack ring
+// owned by the caller.
+//
+// All buffers are sized once in the constructor; observing a frame allocates
+// nothing.
+class ObservationStage
+{
+public:
+    ObservationStage(uint16_t width, uint16_t height, uint16_t nStack, Byte* ring,
+                     GrayscaleConversion::Mode mode = GrayscaleConversion::LUMA);
+    ~ObservationStage();
+
+    // Remember a frame to be max-pooled into the next observe(). It should be
+    // the frame just before the one that will be observed.
+    void pool(const Byte* frame);
+    // Write the observation of this frame into the next ring slot. It is
+    // max-pooled with the last frame seen through pool() or observe().
+    void observe(const Byte* frame);
+    // Forget the last frame, e.g. after a reset
+    void clear();
+
+    // Ring slot written by the last observe(); the previous observations are
+    // in the slots before it, wrapping round
+    uint16_t newestSlot() const;
+    size_t observationSize() const;
+
+private:
+    void downscale(const Byte* in, Byte* out);
+
+    // Source pixels each output row or column covers, with the length of
+    // the overlap in units where a whole output pixel sums to the source size
+    struct Taps {
+        std::vector<uint16_t> first;
+        std::vector<uint16_t> count;
+        std::vector<uint32_t> offset;
+        std::vector<uint32_t> weight;
+    };
+    static Taps buildTaps(uint16_t nSource, uint16_t nOutput);
+
+    uint16_t width;
+    uint16_t height;
+    uint16_t nStack;
+    Byte* pRing;
+    uint16_t nSlot;
+
+    std::array<Byte, 64> lut;
+    Taps columns;
+    Taps rows;
+
+    // Grey copy of the last frame seen and the pooled frame
+    std::vector<Byte> vLast;
+    std::vector<Byte> vPooled;
+    bool bHaveLast = false;
+};
+
+#endif
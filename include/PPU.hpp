@@ -1,6 +1,57 @@
 #ifndef PPU_HPP
 #define PPU_HPP
 
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <array>
+#include <vector>
+#include "Typedefs.hpp"
+#include "PagedMemory.hpp"
+
+class Cartridge;
+class Debugger;
+class CodeDataLogger;
+
+namespace PPUControlFlags {
+    enum Flags {
+        NAMETABLE_X = (1 << 0),
+        NAMETABLE_Y = (1 << 1),
+        INCREMENT_MODE = (1 << 2), // VRAM address step: 1 across, 32 down
+        PATTERN_SPRITE = (1 << 3),
+        PATTERN_BACKGROUND = (1 << 4),
+        SPRITE_SIZE = (1 << 5),
+        SLAVE_MODE = (1 << 6),
+        ENABLE_NMI = (1 << 7)
+    };
+}
+
+namespace PPUMaskFlags {
+    enum Flags {
+        GRAYSCALE = (1 << 0),
+        RENDER_BACKGROUND_LEFT = (1 << 1),
+        RENDER_SPRITES_LEFT = (1 << 2),
+        RENDER_BACKGROUND = (1 << 3),
+        RENDER_SPRITES = (1 << 4),
+        ENHANCE_RED = (1 << 5),
+        ENHANCE_GREEN = (1 << 6),
+        ENHANCE_BLUE = (1 << 7)
+    };
+}
+
+namespace PPUStatusFlags {
+    enum Flags {
+        SPRITE_OVERFLOW = (1 << 5),
+        SPRITE_ZERO_HIT = (1 << 6),
+        VERTICAL_BLANK = (1 << 7)
+    };
+}
+
+constexpr uint16_t SCREEN_WIDTH = 256;
+constexpr uint16_t SCREEN_HEIGHT = 240;
+
+NES_PROFILE_BEGIN
+
 class PPU
 {
 public:
@@ -13,14 +64,177 @@ public:
     void ppuWrite(Address, Byte);
     Byte ppuRead(Address, bool bReadOnly = false);
 
+    // $4014 OAM DMA: the whole 256-byte page lands in OAM starting at the
+    // current OAM address, as 256 writes to $2004 would
+    void oamDMA(const Byte* page);
+
     void ConnectCartridge(const std::shared_ptr<Cartridge>& cartridge);
+    // Points the nametables where the cartridge's mirroring now puts them.
+    // The Bus calls it after anything that can change a mapper's registers.
+    void updateMirroring();
     void clock();
+    void reset();
+
+    // Everything the PPU needs to carry on from where it was, minus the frame
+    // buffer: a restored PPU keeps showing whatever it drew last
+    struct State {
+        PagedMemory tblName;
+        std::array<Byte, 32> tblPalette;
+        std::array<Byte, 256> oam;
+        Byte oamAddr;
+        std::array<Byte, 32> secondaryOAM;
+        uint8_t spriteCount;
+        bool spriteZeroPicked;
+        std::array<Byte, 8> spritePatternLo, spritePatternHi;
+        std::array<Byte, SCREEN_WIDTH> spriteLine;
+        bool spriteZeroOnLine;
+        bool bSkipPixels, bSkipFetches;
+        int16_t spriteZeroHitLine, spriteZeroHitCycle;
+        Byte control, mask, status;
+        LargeRegister vramAddr, tramAddr;
+        Byte fineX, addressLatch, ppuDataBuffer;
+        int16_t scanline, cycle;
+        bool oddFrame, nmi, frameComplete;
+        Byte bgNextTileId, bgNextTileAttrib, bgNextTileLsb, bgNextTileMsb;
+        uint16_t bgShifterPatternLo, bgShifterPatternHi, bgShifterAttribLo, bgShifterAttribHi;
+    };
+
+    void saveState(State&) const;
+    void loadState(const State&);
+
+    // Set at the start of vertical blank when NMI output is enabled; the Bus
+    // forwards it to the CPU and clears it
+    bool nmi = false;
+    bool frameComplete = false;
+
+    // Cleared for frames nobody will look at; read at the start of each frame.
+    // Such frames skip pixel generation, compositing and palette lookups, and
+    // (unless the mapper watches the PPU bus) the tile fetches as well. What
+    // the CPU can see is unchanged: vblank and NMI timing, $2002, sprite 0
+    // hit and overflow, and the VRAM address updates.
+    bool outputEnabled = true;
+
+    // Told about accesses to the pages it has breakpoints on while attached
+    Debugger *debugger = nullptr;
+    // Told which CHR bytes are drawn and read through $2007 while set
+    CodeDataLogger *cdl = nullptr;
+
+    // One NES palette index (0x00-0x3F) per pixel, row major. The buffer is
+    // only allocated by the first frame drawn or the first call, so machines
+    // that never show a picture do without it; it never moves after that.
+    const Byte* frame() const;
+    bool hasFrame() const { return !frameBuffer.empty(); }
+
+    // Lines of the last frame drawn whose pixels differ from the frame drawn
+    // before it, bit y % 64 of word y / 64. Found while compositing, so it
+    // costs a compare per pixel. Frames that are not drawn leave it alone.
+    typedef std::array<uint64_t, 4> LineMask;
+    const LineMask& dirtyLines() const { return dirtyLineMask; }
+    // Frames drawn so far, so a consumer can tell whether it missed any
+    uint32_t framesDrawn() const { return nFramesDrawn; }
+    // Nametable RAM as the PPU holds it
+    const PagedMemory& nametables() const { return tblName; }
+
+    // RGB colour of each palette index on the 2C02
+    static const Byte PALETTE_RGB[64][3];
 
 private:
+    bool renderingEnabled() const;
+    void mapNametables();
+    Byte fetchNametable(Address addr);
+
+    void incrementScrollX();
+    void incrementScrollY();
+    void transferAddressX();
+    void transferAddressY();
+    void loadBackgroundShifters();
+    void updateShifters();
+
+    void evaluateSprites();
+    Address spritePatternAddress(uint8_t slot);
+    void logTileRow(Address pattern);
+    void buildSpriteLine();
+    void compositeLine();
+    void predictSpriteZeroHit();
+    void resolveSpriteZeroHit();
+
     std::shared_ptr<Cartridge> cart;
-    std::array<std::array<Byte, 1024>, 2> tblName;
-    std::array<std::array<Byte, 4096>, 2> tblPattern;
+    // Two 1 KB nametables (four on four-screen boards), shared page by page
+    // between clones
+    PagedMemory tblName;
+    // What $2000, $2400, $2800 and $2C00 read under the current mirroring:
+    // the page of tblName behind each and a pointer to it. The pointers are
+    // redone whenever tblName replaces a page, so a nametable read is one
+    // indexed load.
+    Mirroring::Mode nametableMirror = Mirroring::VERTICAL;
+    std::array<uint8_t, 4> nametablePage = {};
+    std::array<const Byte*, 4> nametable = {};
+    // The mapper sees nametable and palette accesses as well (scanline counters)
+    bool bMapperWatchesBus = false;
     std::array<Byte, 32> tblPalette;
+    // Empty until frame() or a drawn frame needs it, then allocated from
+    // where the PPU was built (see InstanceArena)
+    mutable std::pmr::vector<Byte> frameBuffer;
+    // Like the frame buffer, not part of the machine's state
+    LineMask dirtyLineMask = {};
+    uint32_t nFramesDrawn = 0;
+
+    // Object attribute memory: 64 sprites of Y, tile, attributes, X
+    std::array<Byte, 256> oam;
+    Byte oamAddr = 0x00;
+
+    // Up to eight sprites picked for the next scanline, their pattern bytes,
+    // and whether OAM entry 0 is one of them
+    std::array<Byte, 32> secondaryOAM;
+    uint8_t spriteCount = 0;
+    bool spriteZeroPicked = false;
+    std::array<Byte, 8> spritePatternLo;
+    std::array<Byte, 8> spritePatternHi;
+
+    // The scanline being drawn, composited once its last dot is out.
+    // Sprite pixels hold palette << 2 | pixel plus the SpriteLine flags;
+    // background pixels hold palette << 2 | pixel, 0 where transparent.
+    std::array<Byte, SCREEN_WIDTH> spriteLine;
+    std::array<Byte, SCREEN_WIDTH> bgLine;
+    bool spriteZeroOnLine = false;
+
+    // outputEnabled as latched for the current frame
+    bool bSkipPixels = false;
+    bool bSkipFetches = false;
+
+    // Without fetches, sprite 0 hit is worked out a line ahead and the flag
+    // only raised once a $2002 read (or the end of the picture) reaches the
+    // dot it happens on. -1 when no hit is pending.
+    int16_t spriteZeroHitLine = -1;
+    int16_t spriteZeroHitCycle = 0;
+
+    Byte control = 0x00;
+    Byte mask = 0x00;
+    Byte status = 0x00;
+
+    // Internal "loopy" registers: the current VRAM address, the temporary
+    // address written through $2005/$2006, fine X scroll and the write toggle.
+    // Layout of both addresses: yyy NN YYYYY XXXXX (fine Y, nametable, coarse Y, coarse X)
+    LargeRegister vramAddr = 0x0000;
+    LargeRegister tramAddr = 0x0000;
+    Byte fineX = 0x00;
+    Byte addressLatch = 0x00;
+    Byte ppuDataBuffer = 0x00;
+
+    int16_t scanline = 0;
+    int16_t cycle = 0;
+    bool oddFrame = false;
+
+    Byte bgNextTileId = 0x00;
+    Byte bgNextTileAttrib = 0x00;
+    Byte bgNextTileLsb = 0x00;
+    Byte bgNextTileMsb = 0x00;
+    uint16_t bgShifterPatternLo = 0x0000;
+    uint16_t bgShifterPatternHi = 0x0000;
+    uint16_t bgShifterAttribLo = 0x0000;
+    uint16_t bgShifterAttribHi = 0x0000;
 };
 
-#endif
\ No newline at end of file
+NES_PROFILE_END
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PAGED_MEMORY_HPP
+#define PAGED_MEMORY_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Typedefs.hpp"
+#include "InstanceArena.hpp"
+
+// Byte buffer split into 1 KB pages. Copies share every page, and a page is
+// only duplicated the first time one of the sharers writes to it, so copying
+// costs a few pointer copies and memory grows with the pages actually dirtied.
+// Pages come from InstanceArena::resource().
+class PagedMemory
+{
+public:
+    static constexpr size_t PAGE_SIZE = 1024;
+
+    PagedMemory();
+    explicit PagedMemory(size_t nSize);
+
+    // Zero-filled and not shared with anything
+    void resize(size_t nSize);
+    size_t size() const;
+    bool empty() const;
+
+    Byte read(size_t offset) const {
+        return (*pages[offset / PAGE_SIZE])[offset % PAGE_SIZE];
+    }
+
+    void write(size_t offset, Byte data) {
+        writablePage(offset / PAGE_SIZE)[offset % PAGE_SIZE] = data;
+    }
+
+    const Byte* page(size_t index) const {
+        return pages[index]->data();
+    }
+
+    // Unshares the page before handing it out
+    Byte* writablePage(size_t index) {
+        std::shared_ptr<Page> &p = pages[index];
+        if (p.use_count() != 1) {
+            p = InstanceArena::makeShared<Page>(*p);
+        }
+        return p->data();
+    }
+
+    // Pages this copy does not share with any other
+    size_t privatePages() const;
+
+private:
+    typedef std::array<Byte, PAGE_SIZE> Page;
+    std::vector<std::shared_ptr<Page>> pages;
+};
+
+#endif
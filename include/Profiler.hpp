@@ -0,0 +1,117 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Typedefs.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+
+namespace ProfilerFrame {
+    enum Kind {
+        CALL = 0, // Entered through JSR
+        NMI = 1,
+        IRQ = 2
+    };
+}
+
+// Where the guest spends its CPU cycles.
+//
+// Every instruction adds its cycles to the PRG location it was fetched from:
+// the offset into PRG-ROM for $8000-$FFFF, so each bank is counted apart even
+// when several share a window, and the plain address below $8000. A shadow
+// call stack follows JSR/RTS and NMI/IRQ/RTI, matched on the stack pointer so
+// jump tables built from pushed addresses and stacks dropped with TXS do not
+// derail it, and charges the same cycles to the current node of a call tree.
+//
+// The CPU only calls in here when the emulator is built with NES_PROFILER
+// defined; otherwise the hooks are compiled out and attach() fails.
+class Profiler
+{
+public:
+    Profiler();
+    ~Profiler();
+
+    // Start counting the CPU of this machine; false if profiling is compiled out
+    bool attach(Bus& bus);
+    void detach();
+    // Forget everything counted so far
+    void clear();
+
+    // Called by the CPU once an instruction has executed: where it started,
+    // where execution goes next, the stack pointer after it and its cycles
+    void instruction(Address pc, Opcode opcode, Address nextPC, Register sp, uint8_t cycles);
+    // Called by the CPU once it has entered an interrupt handler
+    void interrupt(ProfilerFrame::Kind kind, Address handler, Register sp, uint8_t cycles);
+
+    uint64_t totalCycles() const { return nTotalCycles; }
+    // Cycles counted at one address as currently mapped
+    uint64_t cyclesAt(Address pc) const;
+
+    // One line per call path, "main;03:C0F0;03:C2A4 1234", with the cycles
+    // spent in the innermost function itself; the input flamegraph.pl and
+    // speedscope expect
+    void writeFoldedStacks(std::ostream& out) const;
+
+    // A backward branch or jump and the instructions it repeats
+    struct HotLoop {
+        int32_t bank;      // 8 KB PRG bank, -1 below $8000
+        Address head;      // Branch target
+        Address tail;      // The branch itself
+        uint64_t iterations;
+        uint64_t cycles;   // Everything counted from head to tail
+        std::string label; // Disassembly of both ends, empty if the bank is no longer mapped
+    };
+
+    // The n loops with the most cycles
+    std::vector<HotLoop> hotLoops(size_t n) const;
+    void writeHotLoops(std::ostream& out, size_t n) const;
+
+private:
+    struct Node {
+        uint32_t parent;
+        uint32_t location; // Of the entry point
+        Address address;   // The entry point as the CPU saw it
+        ProfilerFrame::Kind kind;
+        uint64_t nCycles;  // Spent in this function itself
+    };
+
+    struct StackEntry {
+        uint32_t node;
+        Register sp;       // Stack pointer right after the call pushed its return address
+    };
+
+    struct BackEdge {
+        uint32_t nTaken;
+        Address head;
+        Address tail;
+    };
+
+    uint32_t location(Address pc) const;
+    void ensureLocations(uint32_t n);
+    void enter(ProfilerFrame::Kind kind, Address entry, Register sp);
+    void leave(Register sp);
+    std::string nodeName(const Node& node) const;
+    std::string disassembly(Address pc) const;
+
+    Bus *bus = nullptr;
+
+    // Indexed by location
+    std::vector<uint64_t> vCycles;
+    std::vector<BackEdge> vBackEdges;
+
+    // Node 0 is the code outside any call: reset onwards
+    std::vector<Node> vNodes;
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::vector<StackEntry> vStack;
+    uint32_t nCurrentNode = 0;
+
+    uint64_t nTotalCycles = 0;
+};
+
+#endif
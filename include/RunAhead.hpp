@@ -0,0 +1,53 @@
+#ifndef RUN_AHEAD_HPP
+#define RUN_AHEAD_HPP
+
+#include <cstdint>
+#include "Typedefs.hpp"
+#include "Bus.hpp"
+
+// Run-ahead hides input lag that a game's own logic adds on top of the display.
+//
+// Each displayed frame runs the real frame with the new input, snapshots the
+// machine, emulates nFrames more frames with the same input and shows only the
+// last of them, then rewinds to the snapshot. A game that reacts to input K
+// frames late looks like it reacts immediately once nFrames reaches K. Frames
+// nobody sees run with PPU output off (there is no audio to skip yet).
+class RunAhead
+{
+public:
+    explicit RunAhead(Bus& bus);
+    ~RunAhead();
+
+    // Frames to run ahead of the real state; 0 runs frames normally.
+    // Changing it starts the statistics over.
+    void setFrames(uint32_t nFrames);
+    uint32_t frames() const;
+
+    // Advance the real state by one frame with the buttons currently held in
+    // bus.controller; bus.ppu.frame() then shows the frame nFrames ahead
+    void frame();
+
+    void resetStats();
+
+    // Wall time of the real frames, and of everything run-ahead added on top
+    // of them: the hidden frames, the displayed frame and the save/restore
+    double realFrameMicroseconds() const;
+    double extraMicroseconds() const;
+    // Extra host time spent per displayed frame for each frame of lag removed
+    double extraMicrosecondsPerLagFrame() const;
+
+    uint64_t nDisplayedFrames = 0;
+    uint64_t nEmulatedFrames = 0;
+
+private:
+    void runFrame();
+
+    Bus &bus;
+    Bus::State state;
+    uint32_t nFrames = 0;
+
+    uint64_t nRealNanoseconds = 0;
+    uint64_t nExtraNanoseconds = 0;
+};
+
+#endif
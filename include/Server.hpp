@@ -0,0 +1,70 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Typedefs.hpp"
+
+// Emulation sidecar: hosts machines for client processes that talk to it
+// over a Unix domain socket (see ServerProtocol.hpp) instead of linking the
+// core.
+//
+// Each connection gets its own thread and its own instances; serve() joins
+// the threads of closed connections as it accepts new ones. Nothing is
+// shared between connections, so nothing is locked. Instances go away with
+// the connection that made them. Frames and memory never cross the socket:
+// each instance writes them into a memfd that the client has mapped.
+//
+// Linux only. Elsewhere listen() fails.
+class Server
+{
+public:
+    Server() = default;
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Binds the socket, replacing a stale one left at the path
+    bool listen(const std::string& sPath);
+    // Takes connections until stop(), then waits for them to close
+    void serve();
+    // Safe from any thread; serve() returns once every connection is done
+    void stop();
+
+    // Open connections, for monitoring
+    uint32_t connections() const { return nConnections; }
+
+private:
+    struct Instance;
+    struct Connection;
+
+    void serveConnection(int fd);
+    // Joins the threads of closed connections; called with mutex held
+    void reapConnections();
+    bool execute(Connection& connection, const std::vector<Byte>& vRequest, std::vector<Byte>& vResponse,
+        std::vector<int>& vDescriptors);
+    // One command: appends its data and any view descriptor, returns its ServerStatus
+    static int8_t run(Connection& connection, uint8_t command, uint32_t id, const Byte* args, size_t nArgs,
+        std::vector<Byte>& vData, std::vector<int>& vDescriptors);
+    static int8_t create(Connection& connection, std::vector<Byte>& vData, std::vector<int>& vDescriptors);
+
+    std::string sPath;
+    int nListen = -1;
+    std::atomic<bool> bStopping{false};
+    std::atomic<uint32_t> nConnections{0};
+
+    // Connection sockets, shut down by stop() to wake their threads
+    std::mutex mutex;
+    std::vector<int> vSockets;
+    std::vector<std::thread> vThreads;
+    // Connection threads that have finished and wait to be joined
+    std::vector<std::thread::id> vFinished;
+};
+
+#endif
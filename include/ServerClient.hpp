@@ -0,0 +1,84 @@
+#ifndef SERVER_CLIENT_HPP
+#define SERVER_CLIENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ServerProtocol.hpp"
+
+// Client side of the Server protocol. It needs nothing from the emulator
+// core, so client processes can link it alone.
+//
+// Commands are queued into a batch and sent together by execute(), which
+// waits for every result. The view of each instance created is mapped
+// read-only as its CREATE result comes back. frame() and memory() then read
+// the server's copies directly.
+class ServerClient
+{
+public:
+    struct Result {
+        int8_t status = ServerStatus::BAD_COMMAND;
+        std::vector<uint8_t> vData;
+
+        // The leading bytes of the data as T, or 0 if there are too few
+        template <typename T>
+        T value() const;
+    };
+
+    ServerClient() = default;
+    ~ServerClient();
+
+    ServerClient(const ServerClient&) = delete;
+    ServerClient& operator=(const ServerClient&) = delete;
+
+    bool connect(const std::string& sPath);
+    void disconnect();
+
+    // Queue one command each; see ServerCommand for what they return
+    void create();
+    void destroy(uint32_t instance);
+    void loadROM(uint32_t instance, const uint8_t* image, size_t nSize);
+    void reset(uint32_t instance);
+    // inputs holds two bytes per frame, or is nullptr to keep the buttons held
+    void step(uint32_t instance, uint32_t nFrames, const uint8_t* inputs);
+    void setVideo(uint32_t instance, bool bEnabled);
+    void saveState(uint32_t instance, uint32_t slot);
+    void loadState(uint32_t instance, uint32_t slot);
+    void readMemory(uint32_t instance, uint16_t address, uint32_t nLength);
+    void stateHash(uint32_t instance);
+
+    // Sends the queued commands and fills vResults with one result each, in
+    // order. False if the connection failed, which leaves it closed.
+    bool execute(std::vector<Result>& vResults);
+
+    // ServerView::FRAME_SIZE palette indices and the ServerView::MEMORY_SIZE
+    // memory image of an instance, or nullptr if it has no view
+    const uint8_t* frame(uint32_t instance) const;
+    const uint8_t* memory(uint32_t instance) const;
+
+private:
+    void queue(uint8_t command, uint32_t instance, const void* pArgs, size_t nArgs);
+    bool receive(std::vector<uint8_t>& vMessage, std::vector<int>& vDescriptors);
+
+    int fd = -1;
+    // Encoded commands waiting for execute(), and what each one was
+    std::vector<uint8_t> vBatch;
+    std::vector<std::pair<uint8_t, uint32_t>> vCommands;
+    std::map<uint32_t, const uint8_t*> views;
+};
+
+template <typename T>
+T ServerClient::Result::value() const {
+    T v = 0;
+    if (vData.size() >= sizeof(T)) {
+        for (size_t i = 0; i < sizeof(T); i++) {
+            ((uint8_t*)&v)[i] = vData[i];
+        }
+    }
+    return v;
+}
+
+#endif
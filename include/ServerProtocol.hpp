@@ -0,0 +1,60 @@
+#ifndef SERVER_PROTOCOL_HPP
+#define SERVER_PROTOCOL_HPP
+
+#include <cstdint>
+
+// Wire format between Server and ServerClient. Both ends are on one machine,
+// so every field is in host byte order with no padding.
+//
+// A request is a uint32_t byte count of what follows, a uint16_t command
+// count, then per command: uint8_t command, uint32_t instance, uint32_t byte
+// count of its arguments, the arguments. The response has the same shape
+// with one result per command: int8_t status, uint32_t byte count of its
+// data, the data. Commands run in order, and one that fails does not stop
+// the ones after it. The descriptors of the views made by CREATE commands
+// come with the response, in their order, as SCM_RIGHTS.
+namespace ServerCommand {
+    enum Command : uint8_t {
+        CREATE,         // -> uint32_t instance; the view comes as a descriptor
+        DESTROY,
+        LOAD_ROM,       // iNES image; also resets
+        RESET,
+        STEP,           // uint32_t frames, then two input bytes per frame or none
+                        // to keep the buttons held -> uint64_t frames run so far
+        SET_VIDEO,      // uint8_t enabled
+        SAVE_STATE,     // uint32_t slot; slots are kept by the server
+        LOAD_STATE,     // uint32_t slot
+        READ_MEMORY,    // uint16_t address, uint32_t length; into the view
+        STATE_HASH,     // -> uint64_t StateHash of the machine
+        COUNT
+    };
+}
+
+namespace ServerStatus {
+    enum Status : int8_t {
+        OK = 0,
+        BAD_COMMAND = -1,   // Unknown command or malformed arguments
+        NO_INSTANCE = -2,
+        BAD_ROM = -3,
+        NO_ROM = -4,
+        NO_STATE = -5,      // LOAD_STATE of a slot never saved
+        NO_MEMORY = -6      // The view could not be made
+    };
+}
+
+// Each instance has a view, a memfd the client maps read-only. STEP copies
+// the frame into it while video output is on and CPU RAM always;
+// READ_MEMORY copies any range of the CPU address space, read without side
+// effects, to the same address in the memory image.
+namespace ServerView {
+    constexpr uint32_t FRAME_OFFSET = 0;
+    constexpr uint32_t FRAME_SIZE = 256 * 240;
+    constexpr uint32_t MEMORY_OFFSET = FRAME_OFFSET + FRAME_SIZE;
+    constexpr uint32_t MEMORY_SIZE = 0x10000;
+    constexpr uint32_t SIZE = MEMORY_OFFSET + MEMORY_SIZE;
+}
+
+// Largest request the server takes; a bigger one closes the connection
+constexpr uint32_t SERVER_MAX_REQUEST = 16 * 1024 * 1024;
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef STATE_HASH_HPP
+#define STATE_HASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "Typedefs.hpp"
+#include "CPU.hpp"
+#include "PPU.hpp"
+
+NES_PROFILE_BEGIN
+class Bus;
+NES_PROFILE_END
+class PagedMemory;
+
+namespace StatePart {
+    enum Part {
+        CPU,        // Registers and the instruction in flight
+        RAM,        // The 2 KB of CPU RAM
+        PPU,        // Registers, OAM, palette and nametables
+        CARTRIDGE,  // Bank tables, PRG-RAM and CHR-RAM
+        FRAME,      // The frame buffer
+        COUNT
+    };
+}
+
+// Streaming 64-bit hash with the structure and constants of XXH64: four
+// independent lanes over 32-byte stripes, so it runs at memory speed
+class StateHasher
+{
+public:
+    explicit StateHasher(uint64_t nSeed = 0);
+
+    void update(const void* pData, size_t nSize);
+    template <typename T>
+    void value(T v) { update(&v, sizeof(v)); }
+
+    uint64_t digest() const;
+
+private:
+    std::array<uint64_t, 4> lanes;
+    std::array<Byte, 32> stripe;
+    size_t nBuffered = 0;
+    uint64_t nTotal = 0;
+    uint64_t nSeed;
+};
+
+// Fingerprint of everything that makes up the result of emulation, taken
+// part by part so a mismatch says where it is. Internal PPU pipeline state
+// (shifters, the sprite line being built) and what video output being off
+// skips are left out, so machines that only differ in how fast they get the
+// same result hash the same. A whole machine is about 75 KB, most of it the
+// frame buffer, which takes microseconds: cheap enough to take every frame.
+class StateHash
+{
+public:
+    typedef std::array<uint64_t, StatePart::COUNT> Parts;
+
+    // One hash per StatePart
+    Parts parts(const Bus& bus);
+    // All parts in mask (bits of 1 << StatePart) folded into one
+    uint64_t operator()(const Bus& bus, uint32_t nMask = ~0u);
+
+    // Just the CPU registers and RAM, for comparing instruction by instruction
+    uint64_t cpu(const Bus& bus);
+
+    static uint64_t combine(const Parts& parts, uint32_t nMask = ~0u);
+
+private:
+    uint64_t registers(const Bus& bus);
+    static void hashPaged(StateHasher& hasher, const PagedMemory& memory);
+
+    // Reused by every call instead of copied onto the stack
+    CPU::State cpuState;
+    PPU::State ppuState;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace TraceZone {
+    enum Zone {
+        // Bus::clock itself, without the CPU and PPU work below it: DMA,
+        // interrupt dispatch and the clock loop
+        BUS_CLOCK,
+        CPU_CLOCK,        // CPU::Clock, where instructions are executed
+        PPU_DOT,          // PPU::clock, the PPU's own memory fetches included
+        // Bus::cpuRead and cpuWrite decoding a CPU access, and the cartridge
+        // and mapper handling it. Only timed on the clocks Bus::clock is
+        // sampled on, so untraced accesses never pay for a scope.
+        BUS_DISPATCH,
+        MAPPER,
+        CARTRIDGE_LOAD,   // Reading and parsing a ROM image
+        FRAME_HANDOFF,    // Turning a finished frame into what the caller reads
+        COUNT
+    };
+}
+
+class TraceScope;
+struct ThreadTrace;
+
+// Where host time goes while emulating, without attaching a profiler.
+//
+// Scopes read the time stamp counter on entry and exit and add their time,
+// minus the time of the scopes nested in them, to per-zone totals kept in a
+// buffer owned by the calling thread. The per-dot zones run millions of times
+// a second, so only one outermost call in SAMPLE_PERIOD is timed, together
+// with everything nested in it, and counted that many times over. frame()
+// closes the totals into one record per emulated frame; the coarse zones also
+// keep every occurrence as an event. Recording never takes a lock; a thread
+// only registers its buffer the first time it records. Buffers have a fixed
+// size and drop what does not fit. With tracing off, a scope costs one test
+// of a flag that never changes; the per-dot zones are only timed from a
+// traced copy of Bus::clock, picked with that one test per clock. What
+// reading the counter itself costs is measured once and taken back out, so
+// parents are not charged for timing their children.
+class HostTrace
+{
+public:
+    static constexpr uint32_t SAMPLE_PERIOD = 16;
+
+    static bool enabled() { return bEnabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool bOn);
+
+    // Closes the current frame of the calling thread. Bus::clockFrame()
+    // calls it after every frame it runs while tracing.
+    static void frame() {
+        if (enabled()) {
+            endFrame();
+        }
+    }
+
+    // Empties every buffer; no thread may be recording meanwhile
+    static void clear();
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto): the coarse zones
+    // and frames as slices, per-frame zone times as counters
+    static void writeChromeTrace(std::ostream& out);
+    // Per thread, the mean time per frame of every zone and its share
+    static void writeFrameSummary(std::ostream& out);
+
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+private:
+    friend class TraceScope;
+
+    static void endFrame();
+    static void calibrate();
+
+    static std::atomic<bool> bEnabled;
+};
+
+// Times the rest of the enclosing block as the given zone
+class TraceScope
+{
+public:
+    explicit TraceScope(TraceZone::Zone zone) {
+        if (HostTrace::enabled()) {
+            begin(zone);
+        } else {
+            pThread = nullptr;
+        }
+    }
+
+    ~TraceScope() {
+        if (pThread != nullptr) {
+            end();
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Whether this call is being timed rather than skipped by sampling
+    bool timed() const { return pThread != nullptr && !bSkipped; }
+
+private:
+    friend class HostTrace;
+
+    void begin(TraceZone::Zone zone);
+    void end();
+
+    ThreadTrace *pThread;
+    TraceScope *pParent;
+    TraceZone::Zone zone;
+    bool bSkipped;     // Not sampled; nothing is timed until it ends
+    uint32_t nWeight;  // Calls this one stands for
+    uint64_t nStart;
+    uint64_t nChildTicks;
+};
+
+// Runs f, timed as zone only in the traced copy of a code path that already
+// tested HostTrace::enabled() once
+template <bool bTraced, typename F>
+inline void traced(TraceZone::Zone zone, F&& f) {
+    if constexpr (bTraced) {
+        TraceScope scope(zone);
+        f();
+    } else {
+        f();
+    }
+}
+
+#endif
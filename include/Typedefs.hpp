@@ -1,9 +1,13 @@
 #ifndef TYPEDEFS_HPP
 #define TYPEDEFS_HPP
 
-#include "CPU.hpp"
+#include <cstdint>
+#include <string>
+#include "CorePolicy.hpp"
 
+NES_PROFILE_BEGIN
 class CPU;
+NES_PROFILE_END
 
 typedef uint8_t Byte;
 typedef uint16_t Address;
@@ -26,18 +30,26 @@ namespace StatusRegisterFlags {
     };
 }
 
+namespace Mirroring {
+    enum Mode {
+        HARDWARE,     // Use the solder pad setting from the iNES header
+        HORIZONTAL,
+        VERTICAL,
+        ONESCREEN_LO,
+        ONESCREEN_HI,
+        FOUR_SCREEN
+    };
+}
+
 typedef bool (CPU::*AddressingMode)();
 typedef bool (CPU::*OperationFunction)();
 
+// One entry of the opcode table, which is constant data shared by every CPU
 struct Instruction {
     AddressingMode addressingMode;
     OperationFunction operation;
-    const uint8_t cyclesCount;
-    std::string name;
-
-    Instruction() : addressingMode(nullptr), operation(nullptr), cyclesCount(0), name("") {}
-    Instruction(AddressingMode mode, OperationFunction op, uint8_t cycles, std::string nameSetter)
-        : addressingMode(mode), operation(op), cyclesCount(cycles), name(nameSetter) {}
+    uint8_t cyclesCount;
+    const char *name;
 };
 
 typedef struct
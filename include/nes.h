@@ -0,0 +1,169 @@
+#ifndef NES_H
+#define NES_H
+
+/*
+ * C interface for embedding the emulator (libnes).
+ *
+ * Instances are opaque handles. Nothing is passed by value across the boundary
+ * except integers and pointers, so the ABI stays stable as the C++ core changes;
+ * additions only ever append functions or result codes and bump NES_ABI_VERSION.
+ *
+ * The view functions return pointers into the live instance. They stay valid
+ * until nes_destroy() and are updated in place by nes_step_frames().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(NES_BUILD_LIBRARY)
+        #define NES_API __declspec(dllexport)
+    #else
+        #define NES_API __declspec(dllimport)
+    #endif
+#else
+    #define NES_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_ABI_VERSION 9
+
+#define NES_SCREEN_WIDTH 256
+#define NES_SCREEN_HEIGHT 240
+#define NES_RAM_SIZE 2048
+#define NES_MAX_RUN_AHEAD 8
+
+/* Controller bits, as stored in each input byte */
+#define NES_BUTTON_A      0x80
+#define NES_BUTTON_B      0x40
+#define NES_BUTTON_SELECT 0x20
+#define NES_BUTTON_START  0x10
+#define NES_BUTTON_UP     0x08
+#define NES_BUTTON_DOWN   0x04
+#define NES_BUTTON_LEFT   0x02
+#define NES_BUTTON_RIGHT  0x01
+
+typedef enum {
+    NES_OK = 0,
+    NES_ERROR_INVALID_ARGUMENT = -1,
+    NES_ERROR_BAD_ROM = -2,
+    NES_ERROR_NO_ROM = -3,
+    /* The core failed, e.g. out of memory. No exception crosses the
+       boundary; the instance is still safe to destroy. */
+    NES_ERROR_INTERNAL = -4
+} nes_result;
+
+typedef struct nes_instance nes_instance;
+
+NES_API uint32_t nes_abi_version(void);
+
+NES_API nes_instance* nes_create(void);
+NES_API void nes_destroy(nes_instance* nes);
+
+/* Loading a ROM also resets the machine */
+NES_API nes_result nes_load_rom_file(nes_instance* nes, const char* path);
+NES_API nes_result nes_load_rom_memory(nes_instance* nes, const uint8_t* image, size_t size);
+NES_API nes_result nes_reset(nes_instance* nes);
+
+/*
+ * Runs nFrames frames. inputs holds two bytes per frame (controller 1, then
+ * controller 2) and may be NULL to keep the current buttons held.
+ */
+NES_API nes_result nes_step_frames(nes_instance* nes, uint32_t nFrames, const uint8_t* inputs);
+
+/*
+ * Turns video output off (0) or back on (nonzero) from the next frame. With
+ * it off the PPU skips all pixel work and nes_framebuffer() keeps the last
+ * drawn frame; emulation results are identical either way, so headless runs
+ * can switch it on only for the frames they look at.
+ */
+NES_API nes_result nes_set_video_output(nes_instance* nes, int enabled);
+
+/*
+ * Agent observations computed in the core. After each nes_step_frames() call
+ * its last frame, max-pooled with the frame before it, is converted to grey
+ * (BT.601 luma), area-downscaled to width x height (at most the screen size)
+ * and written into the next of nStack slots of ring, which the caller owns
+ * and must keep alive: nStack * width * height bytes. Those two frames are
+ * rendered even with video output off. A NULL ring turns observations off.
+ */
+NES_API nes_result nes_set_observation(nes_instance* nes, uint32_t width, uint32_t height, uint32_t nStack, uint8_t* ring);
+/* Ring slot holding the newest observation (older ones precede it,
+   wrapping), or -1 if observations are off */
+NES_API int32_t nes_observation_slot(const nes_instance* nes);
+
+/*
+ * Run-ahead: each stepped frame also emulates nFrames frames ahead with the
+ * same input and shows the last of them, then rewinds, cutting that many
+ * frames of the game's own input lag. 0 (the default) turns it off. Costs
+ * roughly nFrames extra frames of host time per frame.
+ */
+NES_API nes_result nes_set_run_ahead(nes_instance* nes, uint32_t nFrames);
+/* Average host time of a real frame, and the extra time run-ahead spends per
+   stepped frame for each frame of lag removed, both in microseconds. Either
+   pointer may be NULL. */
+NES_API nes_result nes_run_ahead_stats(const nes_instance* nes, double* realFrameUs, double* extraUsPerLagFrame);
+
+/*
+ * Host timing for all instances in the process: CPU, PPU and bus time per
+ * emulated frame, plus ROM loading and frame handoff. Off by default, where
+ * it costs one branch per timed scope. nes_write_host_trace() writes Chrome
+ * trace-event JSON and/or a text summary per thread; either path may be
+ * NULL. Call it while no instance is being stepped.
+ */
+NES_API void nes_set_host_trace(int enabled);
+NES_API nes_result nes_write_host_trace(const char* chromeTracePath, const char* summaryPath);
+
+/*
+ * Code/data log: one byte of flags per byte of PRG-ROM and CHR-ROM, marking
+ * what ran as code, what was read as data and which tiles were drawn, in the
+ * .cdl layout FCEUX uses. Turning it on again carries on with the log kept
+ * while it was off, as long as it fits the loaded ROM; a ROM of another size
+ * starts it over. Loading a .cdl replaces the log and fails if the file does
+ * not fit the ROM; both loading and saving need the log to have been on.
+ */
+NES_API nes_result nes_set_code_data_log(nes_instance* nes, int enabled);
+NES_API nes_result nes_load_code_data_log(nes_instance* nes, const char* path);
+NES_API nes_result nes_save_code_data_log(const nes_instance* nes, const char* path);
+
+/*
+ * Cheats. A Game Genie code (6 or 8 letters) patches ROM through patched
+ * copies of the banks it changes, so reads cost the same with any number of
+ * codes; a freeze holds a byte of $0000-$1FFF or $6000-$7FFF at a value,
+ * rewritten before every frame. Both return an id above zero, or a negative
+ * nes_result. Cheats stay across ROM loads and resets.
+ */
+NES_API int32_t nes_add_game_genie(nes_instance* nes, const char* code);
+NES_API int32_t nes_add_ram_freeze(nes_instance* nes, uint16_t address, uint8_t value);
+NES_API nes_result nes_remove_cheat(nes_instance* nes, int32_t id);
+NES_API nes_result nes_clear_cheats(nes_instance* nes);
+
+/*
+ * 64-bit hash of the machine as it stands: CPU registers and RAM, PPU
+ * registers and memory, cartridge banks and RAM, and the frame buffer. Two
+ * runs that agree on it have emulated the same thing. It takes a few
+ * microseconds, so it can be read after every frame. 0 without a ROM.
+ */
+NES_API uint64_t nes_state_hash(nes_instance* nes);
+
+/* NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT palette indices (0x00-0x3F), row major;
+ * NULL if the frame cannot be allocated */
+NES_API const uint8_t* nes_framebuffer(const nes_instance* nes);
+/* 64 RGB triplets to turn palette indices into colours */
+NES_API const uint8_t* nes_palette_rgb(void);
+/* NES_RAM_SIZE bytes of CPU work RAM */
+NES_API const uint8_t* nes_cpu_ram(const nes_instance* nes);
+/* Signed 16-bit mono samples produced by the last step; the core has no APU
+   yet, so this is NULL with a count of 0 */
+NES_API const int16_t* nes_audio_buffer(const nes_instance* nes, size_t* count);
+
+NES_API uint64_t nes_frame_count(const nes_instance* nes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#include "../include/ArenaBenchmark.hpp"
+#include "../include/Bus.hpp"
+#include "../include/Movie.hpp"
+#include "../include/StateHash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+struct WorkerRun {
+    Clock::time_point start, end;
+    uint64_t nFrames = 0;
+    size_t nSpilled = 0;
+    ArenaBacking::Backing backing = ArenaBacking::NONE;
+    uint64_t nStateHash = 0;
+    bool bValid = false;
+};
+
+static void pinThread(uint32_t nCPU) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(nCPU % std::max(std::thread::hardware_concurrency(), 1u), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)nCPU;
+#endif
+}
+
+static void runWorker(const ArenaBenchmark& benchmark, bool bArena, uint32_t nWorker, const Movie& movie,
+    std::atomic<uint32_t>& nReady, WorkerRun& run) {
+    if (benchmark.bPinThreads) {
+        pinThread(nWorker);
+    }
+
+    uint32_t nThreads = std::max(benchmark.nThreads, 1u);
+    uint32_t nCount = benchmark.nMachines / nThreads + (nWorker < benchmark.nMachines % nThreads ? 1 : 0);
+
+    // Every machine gets a clone, sharing the ROM as a host would
+    std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(benchmark.title.sROM);
+    InstanceArena arena;
+    std::vector<std::unique_ptr<Bus>> vHeap;
+    std::vector<Bus*> vMachines;
+    bool bBuilt = cart->ImageValid() && (!bArena || nCount == 0 || arena.reserve(nCount, benchmark.nSlotSize));
+    for (uint32_t i = 0; bBuilt && i < nCount; i++) {
+        Bus *bus = nullptr;
+        if (bArena) {
+            bus = arena.create(i);
+            InstanceArena::Scope scope(arena, i);
+            bus->insertCartridge(cart->clone());
+        } else {
+            vHeap.push_back(std::make_unique<Bus>());
+            bus = vHeap.back().get();
+            bus->insertCartridge(cart->clone());
+        }
+        bus->ppu.outputEnabled = benchmark.bVideo;
+        bus->reset();
+        vMachines.push_back(bus);
+    }
+
+    // Everyone starts the clock together, once all machines are built
+    nReady++;
+    while (nReady < nThreads) {
+        std::this_thread::yield();
+    }
+
+    size_t nFrames = movie.vFrames.size();
+    if (benchmark.nFrames != 0) {
+        nFrames = std::min<size_t>(nFrames, benchmark.nFrames);
+    }
+    run.start = Clock::now();
+    for (size_t frame = 0; bBuilt && frame < nFrames; frame++) {
+        for (uint32_t i = 0; i < vMachines.size(); i++) {
+            if (bArena) {
+                // Pages copy-on-write unshares land in the machine's slot
+                InstanceArena::Scope scope(arena, i);
+                movie.apply(*vMachines[i], frame);
+                vMachines[i]->clockFrame();
+            } else {
+                movie.apply(*vMachines[i], frame);
+                vMachines[i]->clockFrame();
+            }
+        }
+    }
+    run.end = Clock::now();
+
+    run.bValid = bBuilt;
+    run.nFrames = bBuilt ? nFrames * vMachines.size() : 0;
+    run.backing = arena.backing();
+    for (uint32_t i = 0; i < vMachines.size(); i++) {
+        run.nSpilled += arena.spilled(i);
+    }
+    if (!vMachines.empty()) {
+        StateHash hash;
+        run.nStateHash = hash(*vMachines[0]);
+    }
+}
+
+std::vector<ArenaBenchmark::Result> ArenaBenchmark::run() const {
+    return { run(false), run(true) };
+}
+
+ArenaBenchmark::Result ArenaBenchmark::run(bool bArena) const {
+    Result result;
+    result.sMode = bArena ? "arena" : "heap";
+    result.nMachines = nMachines;
+
+    Movie movie;
+    if (!movie.load(title.sMovie)) {
+        return result;
+    }
+
+    std::vector<WorkerRun> vRuns(std::max(nThreads, 1u));
+    std::vector<std::thread> vThreads;
+    std::atomic<uint32_t> nReady{0};
+    for (uint32_t i = 0; i < vRuns.size(); i++) {
+        vThreads.emplace_back(runWorker, std::cref(*this), bArena, i, std::cref(movie), std::ref(nReady),
+            std::ref(vRuns[i]));
+    }
+    for (std::thread &thread : vThreads) {
+        thread.join();
+    }
+
+    Clock::time_point start = vRuns[0].start, end = vRuns[0].end;
+    for (const WorkerRun &run : vRuns) {
+        if (!run.bValid) {
+            return result;
+        }
+        start = std::min(start, run.start);
+        end = std::max(end, run.end);
+        result.nFrames += run.nFrames;
+        result.nSpilled += run.nSpilled;
+    }
+
+    result.bValid = true;
+    result.backing = vRuns[0].backing;
+    result.nStateHash = vRuns[0].nStateHash;
+    result.dSeconds = std::chrono::duration<double>(end - start).count();
+    if (result.dSeconds > 0.0) {
+        result.dFramesPerSecond = result.nFrames / result.dSeconds;
+    }
+    return result;
+}
+
+void ArenaBenchmark::writeReport(const std::vector<Result>& vResults, std::ostream& out) {
+    static const char *BACKING[] = { "-", "heap", "pages", "transparent", "hugetlb" };
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-6s %-12s %9s %12s %10s %12s %10s  %s\n",
+        "mode", "backing", "machines", "frames", "seconds", "frames/s", "spilled", "state hash");
+    out << line;
+
+    for (const Result &r : vResults) {
+        if (!r.bValid) {
+            std::snprintf(line, sizeof(line), "%-6s %-12s\n", r.sMode.c_str(), "invalid");
+            out << line;
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "%-6s %-12s %9u %12llu %10.3f %12.0f %10zu  %016llx\n",
+            r.sMode.c_str(), BACKING[r.backing], r.nMachines, (unsigned long long)r.nFrames, r.dSeconds,
+            r.dFramesPerSecond, r.nSpilled, (unsigned long long)r.nStateHash);
+        out << line;
+    }
+
+    if (vResults.size() == 2 && vResults[0].bValid && vResults[1].bValid && vResults[0].dFramesPerSecond > 0.0) {
+        std::snprintf(line, sizeof(line), "arena/heap throughput: %.3fx\n",
+            vResults[1].dFramesPerSecond / vResults[0].dFramesPerSecond);
+        out << line;
+    }
+}
@@ -0,0 +1,290 @@
+#include "../include/Benchmark.hpp"
+#include "../include/Bus.hpp"
+#include "../include/Movie.hpp"
+#include "../include/StateHash.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// Holds the calling thread on the CPU it is running on while alive
+class ThreadPin
+{
+public:
+    explicit ThreadPin(bool bPin) {
+#ifdef __linux__
+        int nCPU = bPin ? sched_getcpu() : -1;
+        if (nCPU < 0 || pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(nCPU, &set);
+        bPinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)bPin;
+#endif
+    }
+
+    ~ThreadPin() {
+#ifdef __linux__
+        if (bPinned) {
+            pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+        }
+#endif
+    }
+
+    ThreadPin(const ThreadPin&) = delete;
+    ThreadPin& operator=(const ThreadPin&) = delete;
+
+private:
+#ifdef __linux__
+    cpu_set_t previous;
+    bool bPinned = false;
+#endif
+};
+
+// Starts the peak RSS over from the current RSS, where the kernel allows it
+static void resetPeakRSS() {
+#ifdef __linux__
+    std::ofstream ofs("/proc/self/clear_refs");
+    ofs << "5";
+#endif
+}
+
+static uint64_t peakRSS() {
+#ifdef __linux__
+    std::ifstream ifs("/proc/self/status");
+    std::string sLine;
+    while (std::getline(ifs, sLine)) {
+        if (sLine.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(sLine.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+static std::string quoted(const std::string& s) {
+    std::string sOut = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            sOut += '\\';
+        }
+        sOut += c;
+    }
+    return sOut + "\"";
+}
+
+// Value of "key" in one line of writeJSON() output, unquoted
+static bool field(const std::string& sLine, const char* key, std::string& sValue) {
+    std::string sKey = std::string("\"") + key + "\": ";
+    size_t pos = sLine.find(sKey);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += sKey.size();
+
+    sValue.clear();
+    if (sLine[pos] != '"') {
+        size_t end = sLine.find_first_of(",}", pos);
+        sValue = sLine.substr(pos, end - pos);
+        return true;
+    }
+    for (pos++; pos < sLine.size() && sLine[pos] != '"'; pos++) {
+        if (sLine[pos] == '\\' && pos + 1 < sLine.size()) {
+            pos++;
+        }
+        sValue += sLine[pos];
+    }
+    return pos < sLine.size();
+}
+
+bool Benchmark::loadCorpus(const std::string& sFileName) {
+    std::ifstream ifs(sFileName);
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    std::string sLine;
+    while (std::getline(ifs, sLine)) {
+        std::istringstream iss(sLine);
+        Title title;
+        if (!(iss >> title.sName) || title.sName[0] == '#') {
+            continue;
+        }
+        if (!(iss >> title.sROM >> title.sMovie)) {
+            return false;
+        }
+        vTitles.push_back(title);
+    }
+    return true;
+}
+
+std::vector<Benchmark::Result> Benchmark::run() const {
+    std::vector<Result> vResults;
+    for (const Title &title : vTitles) {
+        vResults.push_back(run(title));
+    }
+    return vResults;
+}
+
+Benchmark::Result Benchmark::run(const Title& title) const {
+    Result result;
+    result.sName = title.sName;
+    result.sProfile = CorePolicy::NAME;
+
+    Movie movie;
+    if (!movie.load(title.sMovie)) {
+        return result;
+    }
+
+    ThreadPin pin(bPinThread);
+    StateHash hash;
+    resetPeakRSS();
+    for (uint32_t repeat = 0; repeat < std::max(nRepeats, 1u); repeat++) {
+        std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(title.sROM);
+        if (!cart->ImageValid()) {
+            return result;
+        }
+        std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+        bus->ppu.outputEnabled = bVideo;
+        bus->insertCartridge(cart);
+        bus->reset();
+
+        // Clocks are read around each frame, since a reset in the movie
+        // starts the count over
+        uint64_t nClocks = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t frame = 0; frame < movie.vFrames.size(); frame++) {
+            movie.apply(*bus, frame);
+            uint32_t nBefore = bus->clockCount();
+            bus->clockFrame();
+            nClocks += bus->clockCount() - nBefore;
+        }
+        double dSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (!result.bValid || dSeconds < result.dSeconds) {
+            result.dSeconds = dSeconds;
+        }
+        result.bValid = true;
+        result.nFrames = movie.vFrames.size();
+        result.nCycles = nClocks / 3;
+        result.nStateHash = hash(*bus);
+    }
+
+    if (result.dSeconds > 0.0) {
+        result.dFramesPerSecond = result.nFrames / result.dSeconds;
+        result.dCyclesPerSecond = result.nCycles / result.dSeconds;
+    }
+    result.nPeakRSS = peakRSS();
+    return result;
+}
+
+void Benchmark::writeJSON(const std::vector<Result>& vResults, std::ostream& out) {
+    char line[512];
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < vResults.size(); i++) {
+        const Result &r = vResults[i];
+        std::snprintf(line, sizeof(line),
+            "\"valid\": %s, \"frames\": %llu, \"cycles\": %llu, \"seconds\": %.6f, "
+            "\"fps\": %.2f, \"cycles_per_second\": %.0f, \"peak_rss\": %llu, \"state_hash\": \"%016llx\"}",
+            r.bValid ? "true" : "false", (unsigned long long)r.nFrames, (unsigned long long)r.nCycles,
+            r.dSeconds, r.dFramesPerSecond, r.dCyclesPerSecond, (unsigned long long)r.nPeakRSS,
+            (unsigned long long)r.nStateHash);
+        out << "    {\"name\": " << quoted(r.sName) << ", \"profile\": " << quoted(r.sProfile) << ", " << line
+            << (i + 1 < vResults.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+bool Benchmark::readJSON(std::istream& is, std::vector<Result>& vResults) {
+    vResults.clear();
+
+    std::string sLine, sValue;
+    while (std::getline(is, sLine)) {
+        Result r;
+        if (!field(sLine, "name", r.sName)) {
+            continue;
+        }
+
+        // Baselines from before profiles have none
+        field(sLine, "profile", r.sProfile);
+        bool bOk = field(sLine, "valid", sValue);
+        r.bValid = sValue == "true";
+        bOk = bOk && field(sLine, "frames", sValue);
+        r.nFrames = std::strtoull(sValue.c_str(), nullptr, 10);
+        bOk = bOk && field(sLine, "cycles", sValue);
+        r.nCycles = std::strtoull(sValue.c_str(), nullptr, 10);
+        bOk = bOk && field(sLine, "seconds", sValue);
+        r.dSeconds = std::strtod(sValue.c_str(), nullptr);
+        bOk = bOk && field(sLine, "fps", sValue);
+        r.dFramesPerSecond = std::strtod(sValue.c_str(), nullptr);
+        bOk = bOk && field(sLine, "cycles_per_second", sValue);
+        r.dCyclesPerSecond = std::strtod(sValue.c_str(), nullptr);
+        bOk = bOk && field(sLine, "peak_rss", sValue);
+        r.nPeakRSS = std::strtoull(sValue.c_str(), nullptr, 10);
+        bOk = bOk && field(sLine, "state_hash", sValue);
+        r.nStateHash = std::strtoull(sValue.c_str(), nullptr, 16);
+        if (!bOk) {
+            return false;
+        }
+        vResults.push_back(r);
+    }
+    return true;
+}
+
+std::vector<Benchmark::Regression> Benchmark::compare(const std::vector<Result>& vBaseline,
+    const std::vector<Result>& vCurrent, double dThreshold) {
+    std::vector<Regression> vRegressions;
+
+    for (const Result &current : vCurrent) {
+        for (const Result &baseline : vBaseline) {
+            if (baseline.sName != current.sName || !baseline.bValid || !current.bValid) {
+                continue;
+            }
+
+            if (current.nStateHash != baseline.nStateHash || current.nFrames != baseline.nFrames) {
+                vRegressions.push_back({ current.sName, "state_hash", 0.0, 0.0 });
+            }
+            if (!baseline.sProfile.empty() && baseline.sProfile != current.sProfile) {
+                continue;
+            }
+            if (current.dFramesPerSecond < baseline.dFramesPerSecond * (1.0 - dThreshold)) {
+                vRegressions.push_back({ current.sName, "fps", baseline.dFramesPerSecond, current.dFramesPerSecond });
+            }
+            if (current.dCyclesPerSecond < baseline.dCyclesPerSecond * (1.0 - dThreshold)) {
+                vRegressions.push_back({ current.sName, "cycles_per_second", baseline.dCyclesPerSecond, current.dCyclesPerSecond });
+            }
+            if (baseline.nPeakRSS > 0 && current.nPeakRSS > baseline.nPeakRSS * (1.0 + dThreshold)) {
+                vRegressions.push_back({ current.sName, "peak_rss", (double)baseline.nPeakRSS, (double)current.nPeakRSS });
+            }
+        }
+    }
+    return vRegressions;
+}
+
+void Benchmark::writeRegressions(const std::vector<Regression>& vRegressions, std::ostream& out) {
+    char line[256];
+    for (const Regression &r : vRegressions) {
+        if (r.sMetric == "state_hash") {
+            out << r.sName << ": final state differs from the baseline\n";
+            continue;
+        }
+        double dChange = r.dBaseline > 0.0 ? (r.dCurrent / r.dBaseline - 1.0) * 100.0 : 0.0;
+        std::snprintf(line, sizeof(line), ": %s %.0f -> %.0f (%+.1f%%)\n",
+            r.sMetric.c_str(), r.dBaseline, r.dCurrent, dChange);
+        out << r.sName << line;
+    }
+}
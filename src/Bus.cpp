@@ -2,6 +2,9 @@
 #include <vector>
 #include "../include/Bus.hpp"
 #include "../include/Typedefs.hpp"
+#include "../include/Trace.hpp"
+#include "../include/Debugger.hpp"
+#include "../include/Cheats.hpp"
 
 Bus::Bus() {
     // Connect CPU to communication bus
@@ -12,39 +15,286 @@ Bus::Bus() {
     }
 }
 
+Bus::Bus(const Bus& other)
+    : cpu(other.cpu), ppu(other.ppu), cpuRam(other.cpuRam), controller(other.controller),
+      controllerShift(other.controllerShift), bControllerStrobe(other.bControllerStrobe),
+      nDMACycles(other.nDMACycles), nSystemClockCounter(other.nSystemClockCounter), openBus(other.openBus) {
+    cpu.ConnectBus(this);
+    // A profiler, debugger, logger, cheat list or cycle core follows one
+    // machine; clones run without them, though ROM patches live in the
+    // cartridge and carry over
+    cpu.profiler = nullptr;
+    cpu.cdl = nullptr;
+    ppu.debugger = nullptr;
+    ppu.cdl = nullptr;
+
+    if (other.cart != nullptr) {
+        cart = other.cart->clone();
+        ppu.ConnectCartridge(cart);
+    }
+
+    // Except the core of a cycle-stepped profile, which is part of the machine
+    if (other.ownCycleCpu != nullptr) {
+        CycleCPU::Progress progress;
+        other.ownCycleCpu->saveState(progress);
+        ownCycleCpu = std::make_unique<CycleCPU>(*this);
+        ownCycleCpu->restart(&progress);
+    }
+}
+
 Bus::~Bus() {
 
 }
 
+std::unique_ptr<Bus> Bus::clone() const {
+    return std::unique_ptr<Bus>(new Bus(*this));
+}
+
+void Bus::saveState(State &state) const {
+    cpu.SaveState(state.cpu);
+    ppu.saveState(state.ppu);
+    cart->saveState(state.cart);
+    state.cpuRam = cpuRam;
+    state.controller = controller;
+    state.controllerShift = controllerShift;
+    state.bControllerStrobe = bControllerStrobe;
+    state.nDMACycles = nDMACycles;
+    state.nSystemClockCounter = nSystemClockCounter;
+    if (cycleCpu != nullptr) {
+        cycleCpu->saveState(state.cycleCpu);
+    } else {
+        state.cycleCpu = CycleCPU::Progress{};
+    }
+    state.openBus = openBus;
+}
+
+void Bus::loadState(const State &state) {
+    cpu.LoadState(state.cpu);
+    ppu.loadState(state.ppu);
+    cart->loadState(state.cart);
+    ppu.updateMirroring();
+    cpuRam = state.cpuRam;
+    controller = state.controller;
+    controllerShift = state.controllerShift;
+    bControllerStrobe = state.bControllerStrobe;
+    nDMACycles = state.nDMACycles;
+    nSystemClockCounter = state.nSystemClockCounter;
+    openBus = state.openBus;
+    if (cycleCpu != nullptr) {
+        cycleCpu->restart(&state.cycleCpu);
+    }
+}
+
 void Bus::cpuWrite(Address addr, Byte data) {
-    if (cart->cpuWrite(addr, data)) {
-        // The cartridge "may" handle the write
+    if (CorePolicy::bInstrumented && bTraceAccesses) {
+        tracedWrite(addr, data);
+    } else {
+        write<false>(addr, data);
+    }
+}
+
+Byte Bus::cpuRead(Address addr, bool bReadOnly) {
+    if (CorePolicy::bInstrumented && debugger != nullptr && !bReadOnly
+        && (debugger->cpuPages[addr >> 8] & BreakType::READ)) {
+        // Peeked first so the value is the one the read is about to return
+        debugger->cpuAccess(BreakType::READ, addr, cpuRead(addr, true));
+    }
+
+    if (CorePolicy::bInstrumented && bTraceAccesses) {
+        return tracedRead(addr, bReadOnly);
+    }
+    return read<false>(addr, bReadOnly);
+}
+
+// Out of line, so the untraced accesses keep a small frame
+void Bus::tracedWrite(Address addr, Byte data) {
+    TraceScope trace(TraceZone::BUS_DISPATCH);
+    write<true>(addr, data);
+}
+
+Byte Bus::tracedRead(Address addr, bool bReadOnly) {
+    TraceScope trace(TraceZone::BUS_DISPATCH);
+    return read<true>(addr, bReadOnly);
+}
+
+template <bool bTraced>
+inline void Bus::write(Address addr, Byte data) {
+    if (CorePolicy::bOpenBus) {
+        openBus = data;
+    }
+    if (CorePolicy::bInstrumented && debugger != nullptr && (debugger->cpuPages[addr >> 8] & BreakType::WRITE)) {
+        debugger->cpuAccess(BreakType::WRITE, addr, data);
+    }
+
+    bool bCartridge = false;
+    traced<bTraced>(TraceZone::MAPPER, [&] { bCartridge = cart->cpuWrite(addr, data); });
+    if (bCartridge) {
+        // The cartridge "may" handle the write, and a mapper register may
+        // switch the mirroring
+        ppu.updateMirroring();
     } else if (addr >= 0x0000 && addr <= 0x1FFF) {
         cpuRam[addr & MEMORY_UNIT.second] = data;
+        if (ramMirror != nullptr) {
+            ramMirror[(addr & MEMORY_UNIT.second) * nRamMirrorStride] = data;
+        }
     } else if (addr >= 0x2000 && addr <= 0x3FFF) {
         ppu.cpuWrite(addr & 0x0007, data);
+    } else if (addr == 0x4014) {
+        oamDMA(data);
+    } else if (addr == 0x4016) {
+        // Strobe both controllers; while it is held they keep reloading
+        bControllerStrobe = data & 0x01;
+        if (bControllerStrobe) {
+            controllerShift = controller;
+        }
     }
 }
 
-Byte Bus::cpuRead(Address addr, bool bReadOnly) {
-    Byte data = 0x00;
-    if (cart->cpuRead(addr, data)) {
+template <bool bTraced>
+inline Byte Bus::read(Address addr, bool bReadOnly) {
+    // Nothing drives the bus for unmapped addresses, so it keeps the last byte
+    Byte data = CorePolicy::bOpenBus ? openBus : 0x00;
+    bool bCartridge = false;
+    traced<bTraced>(TraceZone::MAPPER, [&] { bCartridge = cart->cpuRead(addr, data); });
+    if (bCartridge) {
         // The cartridge "may" handle the read
     } else if (addr >= 0x0000 && addr <= 0x1FFF) {
-        return cpuRam[addr & MEMORY_UNIT.second];
+        data = cpuRam[addr & MEMORY_UNIT.second];
     } else if (addr >= 0x2000 && addr <= 0x3FFF) {
-        return ppu.cpuRead(addr & 0x0007, bReadOnly);
+        data = ppu.cpuRead(addr & 0x0007, bReadOnly);
+    } else if (addr == 0x4016 || addr == 0x4017) {
+        Byte &shift = controllerShift[addr & 0x0001];
+        if (bControllerStrobe) {
+            shift = controller[addr & 0x0001];
+        }
+
+        // One button per read on bit 0, A first; the upper bits are open bus,
+        // which after an absolute read still holds the $40 of the address.
+        // Once all eight have been read the official pads return 1.
+        data = (CorePolicy::bOpenBus ? (openBus & 0xE0) : 0x40) | ((shift & 0x80) >> 7);
+        if (!bReadOnly && !bControllerStrobe) {
+            shift = (shift << 1) | 0x01;
+        }
     }
 
-    return 0x00;
+    if (CorePolicy::bOpenBus && !bReadOnly) {
+        openBus = data;
+    }
+    return data;
+}
+
+void Bus::oamDMA(Byte page) {
+    Address base = (Address)page << 8;
+
+    if (base <= 0x1FFF) {
+        // Work RAM is the usual source: copy straight out of it
+        ppu.oamDMA(cpuRam.data() + (base & MEMORY_UNIT.second));
+    } else {
+        // Anything else goes through the bus once per byte, then one copy
+        std::array<Byte, 256> buffer;
+        for (size_t i = 0; i < buffer.size(); i++) {
+            buffer[i] = cpuRead(base + i);
+        }
+        ppu.oamDMA(buffer.data());
+    }
+
+    // The CPU halts for 513 cycles, plus one to line up when the DMA starts
+    // on an odd cycle
+    nDMACycles = 513 + ((nSystemClockCounter / 3) & 0x01);
 }
 
 void Bus::insertCartridge(const std::shared_ptr<Cartridge>& cartridge) {
     cart = cartridge;
     ppu.ConnectCartridge(cart);
+
+    // The core polls the mapper as it starts, so it waits for a cartridge
+    if constexpr (CorePolicy::STEPPING == CPUStepping::CYCLE) {
+        if (ownCycleCpu == nullptr) {
+            ownCycleCpu = std::make_unique<CycleCPU>(*this);
+        }
+    }
 }
 
 void Bus::reset() {
+    cart->reset();
+    ppu.updateMirroring();
     cpu.Reset();
+    ppu.reset();
+    controllerShift.fill(0x00);
+    bControllerStrobe = false;
+    nDMACycles = 0;
     nSystemClockCounter = 0;
+    if (cycleCpu != nullptr) {
+        cycleCpu->restart();
+    }
+}
+
+void Bus::clock() {
+    if (CorePolicy::bInstrumented && HostTrace::enabled()) {
+        tracedTick();
+    } else {
+        tick<false>();
+    }
+}
+
+void Bus::clockFrame() {
+    if (CorePolicy::bInstrumented && cheats != nullptr) {
+        cheats->freeze();
+    }
+
+    // The flag is tested once, so the untraced loop can inline the clock
+    if (CorePolicy::bInstrumented && HostTrace::enabled()) {
+        do {
+            tracedTick();
+        } while (!ppu.frameComplete);
+        ppu.frameComplete = false;
+        HostTrace::frame();
+    } else {
+        do {
+            tick<false>();
+        } while (!ppu.frameComplete);
+        ppu.frameComplete = false;
+    }
+}
+
+void Bus::tracedTick() {
+    TraceScope trace(TraceZone::BUS_CLOCK);
+    bTraceAccesses = trace.timed();
+    tick<true>();
+    bTraceAccesses = false;
+}
+
+template <bool bTraced>
+void Bus::tick() {
+    // The PPU runs three dots for every CPU cycle
+    traced<bTraced>(TraceZone::PPU_DOT, [this] { ppu.clock(); });
+
+    if (CorePolicy::STEPPING != CPUStepping::INSTRUCTION && nSystemClockCounter % 3 == 0 && cycleCpu != nullptr) {
+        // Takes its own interrupts between instructions
+        if (nDMACycles > 0 && cycleCpu->Complete()) {
+            nDMACycles--;
+        } else {
+            traced<bTraced>(TraceZone::CPU_CLOCK, [this] { cycleCpu->clock(); });
+        }
+    } else if (nSystemClockCounter % 3 == 0) {
+        if (nDMACycles > 0 && cpu.Complete()) {
+            // OAM DMA owns the bus once the writing instruction has finished
+            nDMACycles--;
+        } else {
+            traced<bTraced>(TraceZone::CPU_CLOCK, [this] { cpu.Clock(); });
+        }
+
+        // Interrupts are only taken between instructions. NMI is an edge the
+        // PPU latched; the cartridge IRQ is a level held until acknowledged.
+        if (cpu.Complete() && nDMACycles == 0) {
+            if (ppu.nmi) {
+                ppu.nmi = false;
+                cpu.NMI();
+            } else if (cart->GetMapper()->irqState()) {
+                cpu.IRQ();
+            }
+        }
+    }
+
+    nSystemClockCounter++;
 }
\ No newline at end of file
@@ -1,12 +1,84 @@
 #include "../include/CPU.hpp"
 #include "../include/Typedefs.hpp"
+#include "../include/CorePolicy.hpp"
 #include "../include/Bus.hpp"
-
-// TODO: Fix and register the opcodes in the Opcode Table
+#include "../include/CodeDataLogger.hpp"
+#ifdef NES_PROFILER
+#include "../include/Profiler.hpp"
+#endif
+
+#include <cstdio>
+
+constexpr std::array<Instruction, NUMBER_OF_OPCODES> CPU::OpcodeTable{ {
+    // Indexed by opcode; illegal opcodes decode to XXX
+    { &CPU::IMP, &CPU::BRK, 7, "BRK" }, { &CPU::IZX, &CPU::ORA, 6, "ORA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZP0, &CPU::ORA, 3, "ORA" }, { &CPU::ZP0, &CPU::ASL, 5, "ASL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::PHP, 3, "PHP" }, { &CPU::IMM, &CPU::ORA, 2, "ORA" }, { &CPU::IMP, &CPU::ASL, 2, "ASL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABS, &CPU::ORA, 4, "ORA" }, { &CPU::ABS, &CPU::ASL, 6, "ASL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BPL, 2, "BPL" }, { &CPU::IZY, &CPU::ORA, 5, "ORA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::ORA, 4, "ORA" }, { &CPU::ZPX, &CPU::ASL, 6, "ASL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::CLC, 2, "CLC" }, { &CPU::ABY, &CPU::ORA, 4, "ORA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::ORA, 4, "ORA" }, { &CPU::ABX, &CPU::ASL, 7, "ASL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::JSR, 6, "JSR" }, { &CPU::IZX, &CPU::AND, 6, "AND" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZP0, &CPU::BIT, 3, "BIT" }, { &CPU::ZP0, &CPU::AND, 3, "AND" }, { &CPU::ZP0, &CPU::ROL, 5, "ROL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::PLP, 4, "PLP" }, { &CPU::IMM, &CPU::AND, 2, "AND" }, { &CPU::IMP, &CPU::ROL, 2, "ROL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::BIT, 4, "BIT" }, { &CPU::ABS, &CPU::AND, 4, "AND" }, { &CPU::ABS, &CPU::ROL, 6, "ROL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BMI, 2, "BMI" }, { &CPU::IZY, &CPU::AND, 5, "AND" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::AND, 4, "AND" }, { &CPU::ZPX, &CPU::ROL, 6, "ROL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::SEC, 2, "SEC" }, { &CPU::ABY, &CPU::AND, 4, "AND" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::AND, 4, "AND" }, { &CPU::ABX, &CPU::ROL, 7, "ROL" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::RTI, 6, "RTI" }, { &CPU::IZX, &CPU::EOR, 6, "EOR" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZP0, &CPU::EOR, 3, "EOR" }, { &CPU::ZP0, &CPU::LSR, 5, "LSR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::PHA, 3, "PHA" }, { &CPU::IMM, &CPU::EOR, 2, "EOR" }, { &CPU::IMP, &CPU::LSR, 2, "LSR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::JMP, 3, "JMP" }, { &CPU::ABS, &CPU::EOR, 4, "EOR" }, { &CPU::ABS, &CPU::LSR, 6, "LSR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BVC, 2, "BVC" }, { &CPU::IZY, &CPU::EOR, 5, "EOR" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::EOR, 4, "EOR" }, { &CPU::ZPX, &CPU::LSR, 6, "LSR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::CLI, 2, "CLI" }, { &CPU::ABY, &CPU::EOR, 4, "EOR" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::EOR, 4, "EOR" }, { &CPU::ABX, &CPU::LSR, 7, "LSR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::RTS, 6, "RTS" }, { &CPU::IZX, &CPU::ADC, 6, "ADC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZP0, &CPU::ADC, 3, "ADC" }, { &CPU::ZP0, &CPU::ROR, 5, "ROR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::PLA, 4, "PLA" }, { &CPU::IMM, &CPU::ADC, 2, "ADC" }, { &CPU::IMP, &CPU::ROR, 2, "ROR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IND, &CPU::JMP, 5, "JMP" }, { &CPU::ABS, &CPU::ADC, 4, "ADC" }, { &CPU::ABS, &CPU::ROR, 6, "ROR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BVS, 2, "BVS" }, { &CPU::IZY, &CPU::ADC, 5, "ADC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::ADC, 4, "ADC" }, { &CPU::ZPX, &CPU::ROR, 6, "ROR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::SEI, 2, "SEI" }, { &CPU::ABY, &CPU::ADC, 4, "ADC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::ADC, 4, "ADC" }, { &CPU::ABX, &CPU::ROR, 7, "ROR" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IZX, &CPU::STA, 6, "STA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZP0, &CPU::STY, 3, "STY" }, { &CPU::ZP0, &CPU::STA, 3, "STA" }, { &CPU::ZP0, &CPU::STX, 3, "STX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::DEY, 2, "DEY" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::TXA, 2, "TXA" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::STY, 4, "STY" }, { &CPU::ABS, &CPU::STA, 4, "STA" }, { &CPU::ABS, &CPU::STX, 4, "STX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BCC, 2, "BCC" }, { &CPU::IZY, &CPU::STA, 6, "STA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZPX, &CPU::STY, 4, "STY" }, { &CPU::ZPX, &CPU::STA, 4, "STA" }, { &CPU::ZPY, &CPU::STX, 4, "STX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::TYA, 2, "TYA" }, { &CPU::ABY, &CPU::STA, 5, "STA" }, { &CPU::IMP, &CPU::TXS, 2, "TXS" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::STA, 5, "STA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMM, &CPU::LDY, 2, "LDY" }, { &CPU::IZX, &CPU::LDA, 6, "LDA" }, { &CPU::IMM, &CPU::LDX, 2, "LDX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZP0, &CPU::LDY, 3, "LDY" }, { &CPU::ZP0, &CPU::LDA, 3, "LDA" }, { &CPU::ZP0, &CPU::LDX, 3, "LDX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::TAY, 2, "TAY" }, { &CPU::IMM, &CPU::LDA, 2, "LDA" }, { &CPU::IMP, &CPU::TAX, 2, "TAX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::LDY, 4, "LDY" }, { &CPU::ABS, &CPU::LDA, 4, "LDA" }, { &CPU::ABS, &CPU::LDX, 4, "LDX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BCS, 2, "BCS" }, { &CPU::IZY, &CPU::LDA, 5, "LDA" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZPX, &CPU::LDY, 4, "LDY" }, { &CPU::ZPX, &CPU::LDA, 4, "LDA" }, { &CPU::ZPY, &CPU::LDX, 4, "LDX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::CLV, 2, "CLV" }, { &CPU::ABY, &CPU::LDA, 4, "LDA" }, { &CPU::IMP, &CPU::TSX, 2, "TSX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABX, &CPU::LDY, 4, "LDY" }, { &CPU::ABX, &CPU::LDA, 4, "LDA" }, { &CPU::ABY, &CPU::LDX, 4, "LDX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMM, &CPU::CPY, 2, "CPY" }, { &CPU::IZX, &CPU::CMP, 6, "CMP" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZP0, &CPU::CPY, 3, "CPY" }, { &CPU::ZP0, &CPU::CMP, 3, "CMP" }, { &CPU::ZP0, &CPU::DEC, 5, "DEC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::INY, 2, "INY" }, { &CPU::IMM, &CPU::CMP, 2, "CMP" }, { &CPU::IMP, &CPU::DEX, 2, "DEX" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::CPY, 4, "CPY" }, { &CPU::ABS, &CPU::CMP, 4, "CMP" }, { &CPU::ABS, &CPU::DEC, 6, "DEC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BNE, 2, "BNE" }, { &CPU::IZY, &CPU::CMP, 5, "CMP" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::CMP, 4, "CMP" }, { &CPU::ZPX, &CPU::DEC, 6, "DEC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::CLD, 2, "CLD" }, { &CPU::ABY, &CPU::CMP, 4, "CMP" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::CMP, 4, "CMP" }, { &CPU::ABX, &CPU::DEC, 7, "DEC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMM, &CPU::CPX, 2, "CPX" }, { &CPU::IZX, &CPU::SBC, 6, "SBC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ZP0, &CPU::CPX, 3, "CPX" }, { &CPU::ZP0, &CPU::SBC, 3, "SBC" }, { &CPU::ZP0, &CPU::INC, 5, "INC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::INX, 2, "INX" }, { &CPU::IMM, &CPU::SBC, 2, "SBC" }, { &CPU::IMP, &CPU::NOP, 2, "NOP" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::ABS, &CPU::CPX, 4, "CPX" }, { &CPU::ABS, &CPU::SBC, 4, "SBC" }, { &CPU::ABS, &CPU::INC, 6, "INC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::REL, &CPU::BEQ, 2, "BEQ" }, { &CPU::IZY, &CPU::SBC, 5, "SBC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ZPX, &CPU::SBC, 4, "SBC" }, { &CPU::ZPX, &CPU::INC, 6, "INC" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::SED, 2, "SED" }, { &CPU::ABY, &CPU::SBC, 4, "SBC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::IMP, &CPU::XXX, 2, "???" },
+    { &CPU::IMP, &CPU::XXX, 2, "???" }, { &CPU::ABX, &CPU::SBC, 4, "SBC" }, { &CPU::ABX, &CPU::INC, 7, "INC" }, { &CPU::IMP, &CPU::XXX, 2, "???" }
+} };
 
 CPU::CPU()
 {
-    // Empty Constructor
 }
 
 CPU::~CPU()
@@ -14,21 +86,66 @@ CPU::~CPU()
     // Empty Destructor
 }
 
+void CPU::SaveState(State &state) const {
+    state.Accumulator = Accumulator;
+    state.X = X;
+    state.Y = Y;
+    state.StackPointer = StackPointer;
+    state.StatusRegister = GetStatusRegister();
+    state.ProgramCounter = ProgramCounter;
+    state.FetchedData = FetchedData;
+    state.AbsoluteAddress = AbsoluteAddress;
+    state.RelativeAddress = RelativeAddress;
+    state.CurrentOpcode = CurrentOpcode;
+    state.CyclesLeft = CyclesLeft;
+    state.TemporaryStorage = TemporaryStorage;
+}
+
+void CPU::LoadState(const State &state) {
+    Accumulator = state.Accumulator;
+    X = state.X;
+    Y = state.Y;
+    StackPointer = state.StackPointer;
+    SetStatusRegister(state.StatusRegister);
+    ProgramCounter = state.ProgramCounter;
+    FetchedData = state.FetchedData;
+    AbsoluteAddress = state.AbsoluteAddress;
+    RelativeAddress = state.RelativeAddress;
+    CurrentOpcode = state.CurrentOpcode;
+    CyclesLeft = state.CyclesLeft;
+    TemporaryStorage = state.TemporaryStorage;
+}
+
 void
 CPU::Clock()
 {
     if (CyclesLeft == 0) {
         // If we have entered here, it means that the previous instruction has completed
         // its cycle count and we can move on to the next instruction.
+        Address instructionAddress = ProgramCounter;
 
-        Opcode opcode = FetchByteFromMemory(ProgramCounter);
+        CurrentOpcode = FetchByteFromMemory(ProgramCounter);
         ++ProgramCounter;
-        CyclesLeft = GetNumberOfBaseClockCyclesLeftForOperation(opcode);
+        SetFlagInStatusRegister(StatusRegisterFlags::U, true);
+        CyclesLeft = GetNumberOfBaseClockCyclesLeftForOperation(CurrentOpcode);
         
-        AddressingModeFunc = OpcodeTable[opcode].addressingMode;
-        OperationFunc = OpcodeTable[opcode].operation;
-
-        CyclesLeft +=  (this->*AddressingModeFunc)() & (this->*OperationFunc)() ? 1 : 0;
+        AddressingModeFunc = OpcodeTable[CurrentOpcode].addressingMode;
+        OperationFunc = OpcodeTable[CurrentOpcode].operation;
+
+        // The addressing mode has to run first, so don't let both calls share an expression
+        bool addressingCrossedPage = (this->*AddressingModeFunc)();
+        if (CorePolicy::bInstrumented && cdl != nullptr) {
+            // Only now is the program counter past the operands and not yet moved by a jump
+            cdl->instruction(instructionAddress, CurrentOpcode, ProgramCounter);
+        }
+        bool operationMayTakeExtraCycle = (this->*OperationFunc)();
+        CyclesLeft += (addressingCrossedPage && operationMayTakeExtraCycle) ? 1 : 0;
+
+#ifdef NES_PROFILER
+        if (profiler != nullptr) {
+            profiler->instruction(instructionAddress, CurrentOpcode, ProgramCounter, StackPointer, CyclesLeft);
+        }
+#endif
     }
 
     --CyclesLeft;
@@ -37,12 +154,12 @@ CPU::Clock()
 // read and writes
 uint8_t CPU::FetchByteFromMemory(uint16_t addr)
 {
-    return bus->read(addr);
+    return bus->cpuRead(addr, false);
 }
 
 void CPU::WriteByteToMemory(uint16_t addr, uint8_t data)
 {
-    bus->write(addr, data);
+    bus->cpuWrite(addr, data);
 }
 
 bool
@@ -136,9 +253,14 @@ CPU::IND()
     ++ProgramCounter;
     
     Address indirectAddress = (highByte << 8) | lowByte;
-    
+    if (CorePolicy::bInstrumented && cdl != nullptr) {
+        cdl->vector(indirectAddress);
+    }
+
+    // The pointer's high byte never carries into the next page: JMP ($xxFF)
+    // takes its target's high byte from $xx00
     Byte indirectAddressLowByte = FetchByteFromMemory(indirectAddress);
-    Byte indirectAddressHighByte = FetchByteFromMemory(indirectAddress + 1);
+    Byte indirectAddressHighByte = FetchByteFromMemory((indirectAddress & 0xFF00) | ((indirectAddress + 1) & 0x00FF));
     AbsoluteAddress = (indirectAddressHighByte << 8) | indirectAddressLowByte;
 
     return false;
@@ -192,35 +314,83 @@ CPU::REL()
 Byte
 CPU::FetchDataForOperation()
 {
-    if (OpcodeTable.at(CurrentOpcode).addressingMode != &CPU::IMP) {
-        FetchedData = FetchByteFromMemory(ProgramCounter);
+    if (OpcodeTable[CurrentOpcode].addressingMode != &CPU::IMP) {
+        FetchedData = FetchByteFromMemory(AbsoluteAddress);
+        if (CorePolicy::bInstrumented && cdl != nullptr) {
+            cdl->data(AbsoluteAddress, AddressingModeFunc == &CPU::IZX || AddressingModeFunc == &CPU::IZY);
+        }
     }
     return FetchedData;
 }
 
+// Kept outside StatusRegister until something reads the whole byte
+static constexpr Register LAZY_FLAGS = StatusRegisterFlags::C | StatusRegisterFlags::Z
+    | StatusRegisterFlags::V | StatusRegisterFlags::N;
+
 inline bool
 CPU::GetFlagFromStatusRegister(const StatusRegisterFlags::Flags flag)
 {
-    return (StatusRegister & flag) != 0;
+    // Always called with a constant, so only one case is ever compiled in
+    switch (flag) {
+        case StatusRegisterFlags::C: return FlagCarry;
+        case StatusRegisterFlags::Z: return FlagZeroSource == 0x00;
+        case StatusRegisterFlags::V: return FlagOverflow;
+        case StatusRegisterFlags::N: return (FlagNegativeSource & 0x80) != 0;
+        default: return (StatusRegister & flag) != 0;
+    }
 }
 
 inline void
 CPU::SetFlagInStatusRegister(const StatusRegisterFlags::Flags flag, const bool toSet)
 {
-    if (toSet) {
-        StatusRegister |= flag;
-    } else {
-        StatusRegister &= ~flag;
+    switch (flag) {
+        case StatusRegisterFlags::C: FlagCarry = toSet; break;
+        case StatusRegisterFlags::Z: FlagZeroSource = toSet ? 0x00 : 0x01; break;
+        case StatusRegisterFlags::V: FlagOverflow = toSet; break;
+        case StatusRegisterFlags::N: FlagNegativeSource = toSet ? 0x80 : 0x00; break;
+        default:
+            if (toSet) {
+                StatusRegister |= flag;
+            } else {
+                StatusRegister &= ~flag;
+            }
+            break;
     }
 }
 
+inline void
+CPU::SetZeroAndNegativeFlags(const Byte result)
+{
+    FlagZeroSource = result;
+    FlagNegativeSource = result;
+}
+
+Register
+CPU::GetStatusRegister() const
+{
+    Register lazy = (FlagCarry ? StatusRegisterFlags::C : 0)
+        | (FlagZeroSource == 0x00 ? StatusRegisterFlags::Z : 0)
+        | (FlagOverflow ? StatusRegisterFlags::V : 0)
+        | (FlagNegativeSource & StatusRegisterFlags::N);
+    return (StatusRegister & ~LAZY_FLAGS) | lazy;
+}
+
+void
+CPU::SetStatusRegister(const Register value)
+{
+    StatusRegister = value;
+    FlagCarry = (value & StatusRegisterFlags::C) != 0;
+    FlagZeroSource = (value & StatusRegisterFlags::Z) ? 0x00 : 0x01;
+    FlagOverflow = (value & StatusRegisterFlags::V) != 0;
+    FlagNegativeSource = value & StatusRegisterFlags::N;
+}
+
 bool CPU::ADC() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)Accumulator + (uint16_t)FetchedData + (uint16_t)GetFlagFromStatusRegister(StatusRegisterFlags::C);
     SetFlagInStatusRegister(StatusRegisterFlags::C, TemporaryStorage > 255);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0);
     SetFlagInStatusRegister(StatusRegisterFlags::V, (~((uint16_t)Accumulator ^ (uint16_t)FetchedData) & ((uint16_t)Accumulator ^ (uint16_t)TemporaryStorage)) & 0x0080);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x80);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     Accumulator = TemporaryStorage & 0x00FF;
     return 1;
 }
@@ -230,9 +400,8 @@ bool CPU::SBC() {
     uint16_t value = ((uint16_t)FetchedData) ^ 0x00FF;
     TemporaryStorage = (uint16_t)Accumulator + value + (uint16_t)GetFlagFromStatusRegister(StatusRegisterFlags::C);
     SetFlagInStatusRegister(StatusRegisterFlags::C, TemporaryStorage & 0xFF00);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, ((TemporaryStorage & 0x00FF) == 0));
     SetFlagInStatusRegister(StatusRegisterFlags::V, (TemporaryStorage ^ (uint16_t)Accumulator) & (TemporaryStorage ^ value) & 0x0080);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     Accumulator = TemporaryStorage & 0x00FF;
     return 1;
 }
@@ -240,8 +409,7 @@ bool CPU::SBC() {
 bool CPU::AND() {
     FetchDataForOperation();
     Accumulator = Accumulator & FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 1;
 }
 
@@ -249,8 +417,7 @@ bool CPU::ASL() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)FetchedData << 1;
     SetFlagInStatusRegister(StatusRegisterFlags::C, (TemporaryStorage & 0xFF00) > 0);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x80);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     if (OpcodeTable.at(CurrentOpcode).addressingMode == &CPU::IMP)
         Accumulator = TemporaryStorage & 0x00FF;
     else
@@ -294,8 +461,9 @@ bool CPU::BEQ() {
 bool CPU::BIT() {
     FetchDataForOperation();
     TemporaryStorage = Accumulator & FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, FetchedData & (1 << 7));
+    // Z comes from the AND, N from bit 7 of the operand itself
+    FlagZeroSource = TemporaryStorage & 0x00FF;
+    FlagNegativeSource = FetchedData;
     SetFlagInStatusRegister(StatusRegisterFlags::V, FetchedData & (1 << 6));
     return 0;
 }
@@ -341,9 +509,12 @@ bool CPU::BRK() {
     WriteByteToMemory(0x0100 + StackPointer, ProgramCounter & 0x00FF);
     StackPointer--;
     SetFlagInStatusRegister(StatusRegisterFlags::B, 1);
-    WriteByteToMemory(0x0100 + StackPointer, StatusRegister);
+    WriteByteToMemory(0x0100 + StackPointer, GetStatusRegister());
     StackPointer--;
     SetFlagInStatusRegister(StatusRegisterFlags::B, 0);
+    if (CorePolicy::bInstrumented && cdl != nullptr) {
+        cdl->vector(0xFFFE);
+    }
     ProgramCounter = (uint16_t)FetchByteFromMemory(0xFFFE) | ((uint16_t)FetchByteFromMemory(0xFFFF) << 8);
     return 0;
 }
@@ -394,8 +565,7 @@ bool CPU::CMP() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t) Accumulator - (uint16_t)FetchedData;
     SetFlagInStatusRegister(StatusRegisterFlags::C, Accumulator >= FetchedData);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     return 1;
 }
 
@@ -403,8 +573,7 @@ bool CPU::CPX() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)X - (uint16_t)FetchedData;
     SetFlagInStatusRegister(StatusRegisterFlags::C, X >= FetchedData);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     return 0;
 }
 
@@ -412,8 +581,7 @@ bool CPU::CPY() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)Y - (uint16_t)FetchedData;
     SetFlagInStatusRegister(StatusRegisterFlags::C, Y >= FetchedData);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     return 0;
 }
 
@@ -421,30 +589,26 @@ bool CPU::DEC() {
     FetchDataForOperation();
     TemporaryStorage = FetchedData - 1;
     WriteByteToMemory(AbsoluteAddress, TemporaryStorage & 0x00FF);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     return 0;
 }
 
 bool CPU::DEX() {
     X--;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, X == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, X & 0x80);
+    SetZeroAndNegativeFlags(X);
     return 0;
 }
 
 bool CPU::DEY() {
     Y--;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Y == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Y & 0x80);
+    SetZeroAndNegativeFlags(Y);
     return 0;
 }
 
 bool CPU::EOR() {
     FetchDataForOperation();
     Accumulator = Accumulator ^ FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 1;
 }
 
@@ -452,22 +616,19 @@ bool CPU::INC() {
     FetchDataForOperation();
     TemporaryStorage = FetchedData + 1;
     WriteByteToMemory(AbsoluteAddress, TemporaryStorage & 0x00FF);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     return 0;
 }
 
 bool CPU::INX() {
     X++;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, X == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, X & 0x80);
+    SetZeroAndNegativeFlags(X);
     return 0;
 }
 
 bool CPU::INY() {
     Y++;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Y == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Y & 0x80);
+    SetZeroAndNegativeFlags(Y);
     return 0;
 }
 
@@ -489,24 +650,21 @@ bool CPU::JSR() {
 bool CPU::LDA() {
     FetchDataForOperation();
     Accumulator = FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 1;
 }
 
 bool CPU::LDX() {
     FetchDataForOperation();
     X = FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, X == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, X & 0x80);
+    SetZeroAndNegativeFlags(X);
     return 1;
 }
 
 bool CPU::LDY() {
     FetchDataForOperation();
     Y = FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Y == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Y & 0x80);
+    SetZeroAndNegativeFlags(Y);
     return 1;
 }
 
@@ -514,8 +672,7 @@ bool CPU::LSR() {
     FetchDataForOperation();
     SetFlagInStatusRegister(StatusRegisterFlags::C, FetchedData & 0x0001);
     TemporaryStorage = FetchedData >> 1;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     if (OpcodeTable.at(CurrentOpcode).addressingMode == &CPU::IMP)
         Accumulator = TemporaryStorage & 0x00FF;
     else
@@ -530,8 +687,7 @@ bool CPU::NOP() {
 bool CPU::ORA() {
     FetchDataForOperation();
     Accumulator = Accumulator | FetchedData;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 1;
 }
 
@@ -542,9 +698,8 @@ bool CPU::PHA() {
 }
 
 bool CPU::PHP() {
-    WriteByteToMemory(0x0100 + StackPointer, StatusRegister | StatusRegisterFlags::B | StatusRegisterFlags::U);
-    SetFlagInStatusRegister(StatusRegisterFlags::B, 0);
-    SetFlagInStatusRegister(StatusRegisterFlags::U, 0);
+    // B and U exist only on the stack copy
+    WriteByteToMemory(0x0100 + StackPointer, GetStatusRegister() | StatusRegisterFlags::B | StatusRegisterFlags::U);
     StackPointer--;
     return 0;
 }
@@ -552,15 +707,13 @@ bool CPU::PHP() {
 bool CPU::PLA() {
     StackPointer++;
     Accumulator = FetchByteFromMemory(0x0100 + StackPointer);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 0;
 }
 
 bool CPU::PLP() {
     StackPointer++;
-    StatusRegister = FetchByteFromMemory(0x0100 + StackPointer);
-    SetFlagInStatusRegister(StatusRegisterFlags::U, 1);
+    SetStatusRegister((FetchByteFromMemory(0x0100 + StackPointer) & ~StatusRegisterFlags::B) | StatusRegisterFlags::U);
     return 0;
 }
 
@@ -568,8 +721,7 @@ bool CPU::ROL() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)(FetchedData << 1) | GetFlagFromStatusRegister(StatusRegisterFlags::C);
     SetFlagInStatusRegister(StatusRegisterFlags::C, TemporaryStorage & 0xFF00);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x0000);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     if (OpcodeTable.at(CurrentOpcode).addressingMode == &CPU::IMP)
         Accumulator = TemporaryStorage & 0x00FF;
     else
@@ -581,8 +733,7 @@ bool CPU::ROR() {
     FetchDataForOperation();
     TemporaryStorage = (uint16_t)(GetFlagFromStatusRegister(StatusRegisterFlags::C) << 7) | (FetchedData >> 1);
     SetFlagInStatusRegister(StatusRegisterFlags::C, FetchedData & 0x01);
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, (TemporaryStorage & 0x00FF) == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, TemporaryStorage & 0x0080);
+    SetZeroAndNegativeFlags(TemporaryStorage & 0x00FF);
     if (OpcodeTable.at(CurrentOpcode).addressingMode == &CPU::IMP)
         Accumulator = TemporaryStorage & 0x00FF;
     else
@@ -592,9 +743,7 @@ bool CPU::ROR() {
 
 bool CPU::RTI() {
     StackPointer++;
-    StatusRegister = FetchByteFromMemory(0x0100 + StackPointer);
-    StatusRegister &= ~StatusRegisterFlags::B;
-    StatusRegister &= ~StatusRegisterFlags::U;
+    SetStatusRegister((FetchByteFromMemory(0x0100 + StackPointer) & ~StatusRegisterFlags::B) | StatusRegisterFlags::U);
 
     StackPointer++;
     ProgramCounter = (uint16_t)FetchByteFromMemory(0x0100 + StackPointer);
@@ -644,29 +793,25 @@ bool CPU::STY() {
 
 bool CPU::TAX() {
     X = Accumulator;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, X == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, X & 0x80);
+    SetZeroAndNegativeFlags(X);
     return 0;
 }
 
 bool CPU::TAY() {
     Y = Accumulator;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Y == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Y & 0x80);
+    SetZeroAndNegativeFlags(Y);
     return 0;
 }
 
 bool CPU::TSX() {
     X = StackPointer;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, X == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, X & 0x80);
+    SetZeroAndNegativeFlags(X);
     return 0;
 }
 
 bool CPU::TXA() {
     Accumulator = X;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 0;
 }
 
@@ -677,8 +822,7 @@ bool CPU::TXS() {
 
 bool CPU::TYA() {
     Accumulator = Y;
-    SetFlagInStatusRegister(StatusRegisterFlags::Z, Accumulator == 0x00);
-    SetFlagInStatusRegister(StatusRegisterFlags::N, Accumulator & 0x80);
+    SetZeroAndNegativeFlags(Accumulator);
     return 0;
 }
 
@@ -691,9 +835,12 @@ void CPU::Reset() {
     X = 0;
     Y = 0;
     StackPointer = 0xFD;
-    StatusRegister = 0x00 | StatusRegisterFlags::U;
+    SetStatusRegister(0x00 | StatusRegisterFlags::U);
 
     AbsoluteAddress = 0xFFFC;
+    if (CorePolicy::bInstrumented && cdl != nullptr) {
+        cdl->vector(AbsoluteAddress);
+    }
     Byte lowByte = FetchByteFromMemory(AbsoluteAddress);
     Byte highByte = FetchByteFromMemory(AbsoluteAddress + 1);
 
@@ -715,15 +862,24 @@ void CPU::IRQ() {
         SetFlagInStatusRegister(StatusRegisterFlags::B, 0);
         SetFlagInStatusRegister(StatusRegisterFlags::U, 1);
         SetFlagInStatusRegister(StatusRegisterFlags::I, 1);
-        WriteByteToMemory(0x0100 + StackPointer, StatusRegister);
+        WriteByteToMemory(0x0100 + StackPointer, GetStatusRegister());
         StackPointer--;
 
         AbsoluteAddress = 0xFFFE;
+        if (CorePolicy::bInstrumented && cdl != nullptr) {
+            cdl->vector(AbsoluteAddress);
+        }
         Byte lowByte = FetchByteFromMemory(AbsoluteAddress);
         Byte highByte = FetchByteFromMemory(AbsoluteAddress + 1);
         ProgramCounter = (highByte << 8) | lowByte;
 
         CyclesLeft = 7;
+
+#ifdef NES_PROFILER
+        if (profiler != nullptr) {
+            profiler->interrupt(ProfilerFrame::IRQ, ProgramCounter, StackPointer, CyclesLeft);
+        }
+#endif
     }
 }
 
@@ -736,18 +892,82 @@ void CPU::NMI() {
     SetFlagInStatusRegister(StatusRegisterFlags::B, 0);
     SetFlagInStatusRegister(StatusRegisterFlags::U, 1);
     SetFlagInStatusRegister(StatusRegisterFlags::I, 1);
-    WriteByteToMemory(0x0100 + StackPointer, StatusRegister);
+    WriteByteToMemory(0x0100 + StackPointer, GetStatusRegister());
     StackPointer--;
 
     AbsoluteAddress = 0xFFFA;
+    if (CorePolicy::bInstrumented && cdl != nullptr) {
+        cdl->vector(AbsoluteAddress);
+    }
     Byte lowByte = FetchByteFromMemory(AbsoluteAddress);
     Byte highByte = FetchByteFromMemory(AbsoluteAddress + 1);
     ProgramCounter = (highByte << 8) | lowByte;
 
     CyclesLeft = 8;
+
+#ifdef NES_PROFILER
+    if (profiler != nullptr) {
+        profiler->interrupt(ProfilerFrame::NMI, ProgramCounter, StackPointer, CyclesLeft);
+    }
+#endif
 }
 
-//TODO: Implement the Disassemble function
+std::map<Address, std::string> CPU::Disassemble(Address start, Address stop)
+{
+    std::map<Address, std::string> lines;
+    char operand[16];
+
+    // Wider than an Address so that stopping at $FFFF still terminates
+    uint32_t address = start;
+    while (address <= stop) {
+        Address lineAddress = address;
+        Opcode opcode = bus->cpuRead(address++, true);
+        const Instruction &instruction = OpcodeTable[opcode];
+        AddressingMode mode = instruction.addressingMode;
+
+        Byte low = 0x00;
+        Byte high = 0x00;
+        if (mode == &CPU::IMP) {
+            std::snprintf(operand, sizeof(operand), "{IMP}");
+        } else if (mode == &CPU::IMM) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "#$%02X {IMM}", low);
+        } else if (mode == &CPU::ZP0) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "$%02X {ZP0}", low);
+        } else if (mode == &CPU::ZPX) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "$%02X, X {ZPX}", low);
+        } else if (mode == &CPU::ZPY) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "$%02X, Y {ZPY}", low);
+        } else if (mode == &CPU::IZX) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "($%02X, X) {IZX}", low);
+        } else if (mode == &CPU::IZY) {
+            low = bus->cpuRead(address++, true);
+            std::snprintf(operand, sizeof(operand), "($%02X), Y {IZY}", low);
+        } else if (mode == &CPU::REL) {
+            low = bus->cpuRead(address++, true);
+            Address target = address + (int8_t)low;
+            std::snprintf(operand, sizeof(operand), "$%04X {REL}", target);
+        } else {
+            low = bus->cpuRead(address++, true);
+            high = bus->cpuRead(address++, true);
+            const char *format = mode == &CPU::ABS ? "$%04X {ABS}"
+                : mode == &CPU::ABX ? "$%04X, X {ABX}"
+                : mode == &CPU::ABY ? "$%04X, Y {ABY}"
+                : "($%04X) {IND}";
+            std::snprintf(operand, sizeof(operand), format, (high << 8) | low);
+        }
+
+        char line[40];
+        std::snprintf(line, sizeof(line), "$%04X: %s %s", lineAddress, instruction.name, operand);
+        lines[lineAddress] = line;
+    }
+
+    return lines;
+}
 
 inline uint8_t CPU::GetNumberOfBaseClockCyclesLeftForOperation(const Opcode opcode)
 {
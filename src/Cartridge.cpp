@@ -1,45 +1,93 @@
 #include "../include/Cartridge.hpp"
 #include "../include/Typedefs.hpp"
+#include "../include/Trace.hpp"
+#include "../include/InstanceArena.hpp"
+#include "../include/Mappers/Mapper_000.hpp"
+#include "../include/Mappers/Mapper_001.hpp"
+#include "../include/Mappers/Mapper_002.hpp"
+#include "../include/Mappers/Mapper_003.hpp"
+#include "../include/Mappers/Mapper_004.hpp"
 
 #include <fstream>
+#include <sstream>
 
 Cartridge::Cartridge(const std::string& sFileName) {
-    iNESHeader header;
-
+    TraceScope trace(TraceZone::CARTRIDGE_LOAD);
     std::ifstream ifs;
     ifs.open(sFileName, std::ifstream::binary);
     if (ifs.is_open()) {
-        ifs.read((char*)&header, sizeof(iNESHeader));
+        load(ifs);
+        ifs.close();
+    }
+}
 
-        if (header.mapper1 & 0x04) {
-            ifs.seekg(512, std::ios_base::cur);
-        }
+Cartridge::Cartridge(const Byte* pImage, size_t nSize) {
+    TraceScope trace(TraceZone::CARTRIDGE_LOAD);
+    std::istringstream iss(std::string((const char*)pImage, nSize), std::ios_base::binary);
+    load(iss);
+}
 
-        nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-        nPRGBanks = header.prg_rom_chunks;
-        nCHRBanks = header.chr_rom_chunks;
+void Cartridge::load(std::istream& ifs) {
+    iNESHeader header;
+
+    if (!ifs.read((char*)&header, sizeof(iNESHeader))) {
+        return;
+    }
 
-        uint32_t nFileType = 1;
+    if (header.mapper1 & 0x04) {
+        ifs.seekg(512, std::ios_base::cur);
+    }
 
-        if (nFileType == 0) {
-            // Load ROM data
-        } else if (nFileType == 1) {
-            nPRGBanks = header.prg_rom_chunks;
-            vPRGMemory.resize(nPRGBanks * 16384);
-            ifs.read((char*)vPRGMemory.data(), vPRGMemory.size());
+    nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
+    nPRGBanks = header.prg_rom_chunks;
+    nCHRBanks = header.chr_rom_chunks;
 
-            nCHRBanks = header.chr_rom_chunks;
-            vCHRMemory.resize(nCHRBanks * 8192);
-            ifs.read((char*)vCHRMemory.data(), vCHRMemory.size());
-        } else if (nFileType == 2) {
-            // Load ROM data
-        }
+    if (header.mapper1 & 0x08) {
+        hwMirror = Mirroring::FOUR_SCREEN;
+    } else {
+        hwMirror = (header.mapper1 & 0x01) ? Mirroring::VERTICAL : Mirroring::HORIZONTAL;
+    }
+
+    uint32_t nFileType = 1;
 
-        switch (nMapperID) {
-            case 0: pMapper = std::make_shared<Mapper_000>(nPRGBanks, nCHRBanks); break;
+    if (nFileType == 0) {
+        // Load ROM data
+    } else if (nFileType == 1) {
+        nPRGBanks = header.prg_rom_chunks;
+        auto vPRGMemory = std::make_shared<std::vector<Byte>>(nPRGBanks * 16384);
+        ifs.read((char*)vPRGMemory->data(), vPRGMemory->size());
+        pPRGMemory = vPRGMemory;
+
+        nCHRBanks = header.chr_rom_chunks;
+        auto vCHRMemory = std::make_shared<std::vector<Byte>>(nCHRBanks * 8192);
+        ifs.read((char*)vCHRMemory->data(), vCHRMemory->size());
+        pCHRMemory = vCHRMemory;
+
+        if (nCHRBanks == 0) {
+            // No CHR-ROM means the board carries 8 KB of CHR-RAM instead
+            vCHRRam.resize(8192);
         }
+    } else if (nFileType == 2) {
+        // Load ROM data
+    }
 
-        ifs.close();
+    if (!ifs) {
+        // Truncated image
+        return;
+    }
+
+    // The mapper's registers belong to the machine, so they come from its memory
+    switch (nMapperID) {
+        case 0: pMapper = InstanceArena::makeShared<Mapper_000>(nPRGBanks, nCHRBanks); break;
+        case 1: pMapper = InstanceArena::makeShared<Mapper_001>(nPRGBanks, nCHRBanks); break;
+        case 2: pMapper = InstanceArena::makeShared<Mapper_002>(nPRGBanks, nCHRBanks); break;
+        case 3: pMapper = InstanceArena::makeShared<Mapper_003>(nPRGBanks, nCHRBanks); break;
+        case 4: pMapper = InstanceArena::makeShared<Mapper_004>(nPRGBanks, nCHRBanks); break;
+    }
+
+    bImageValid = pMapper != nullptr && nPRGBanks > 0;
+    if (bImageValid) {
+        patchPRG({});
     }
 }
 
@@ -47,14 +95,105 @@ Cartridge::~Cartridge() {
 
 }
 
+bool Cartridge::ImageValid() {
+    return bImageValid;
+}
+
+void Cartridge::reset() {
+    if (pMapper != nullptr) {
+        pMapper->reset();
+    }
+}
+
+Mirroring::Mode Cartridge::Mirror() {
+    if (hwMirror == Mirroring::FOUR_SCREEN) {
+        return hwMirror;
+    }
+
+    Mirroring::Mode m = pMapper->mirror();
+    return m == Mirroring::HARDWARE ? hwMirror : m;
+}
+
+std::shared_ptr<Cartridge> Cartridge::clone() const {
+    auto copy = InstanceArena::makeShared<Cartridge>(*this);
+    if (pMapper != nullptr) {
+        copy->pMapper = pMapper->clone();
+    }
+    return copy;
+}
+
+void Cartridge::saveState(State &state) const {
+    // A state saved over and over keeps its mapper object; it is only cloned
+    // the first time, or when a copy of the State shares it
+    if (state.pMapper == nullptr || state.pMapper.use_count() > 1 || !state.pMapper->copyFrom(*pMapper)) {
+        state.pMapper = pMapper->clone();
+    }
+    state.vCHRRam = vCHRRam;
+}
+
+void Cartridge::loadState(const State &state) {
+    // Copied into the live mapper so the saved one survives being loaded more
+    // than once
+    if (!pMapper->copyFrom(*state.pMapper)) {
+        pMapper = state.pMapper->clone();
+    }
+    vCHRRam = state.vCHRRam;
+    // The state may come from before the patches changed
+    pMapper->setPRGOverlay(pPRGOverlay);
+}
+
+void Cartridge::patchPRG(const std::vector<PRGPatch>& vPatches) {
+    uint32_t nBanks = (uint32_t)pPRGMemory->size() / 0x2000;
+
+    // (window, bank) -> where the CPU reads it, starting out at the ROM bank
+    auto vOverlay = std::make_shared<std::vector<uint32_t>>(4 * nBanks);
+    for (uint32_t window = 0; window < 4; window++) {
+        for (uint32_t bank = 0; bank < nBanks; bank++) {
+            (*vOverlay)[window * nBanks + bank] = bank * 0x2000;
+        }
+    }
+
+    auto vPatched = std::make_shared<std::vector<Byte>>();
+    for (const PRGPatch &patch : vPatches) {
+        uint32_t bank = patch.offset / 0x2000;
+        uint32_t &read = (*vOverlay)[(patch.window & 0x03) * nBanks + bank];
+        if (read == bank * 0x2000) {
+            // First patch of this bank in this window
+            read = (uint32_t)(pPRGMemory->size() + vPatched->size());
+            vPatched->insert(vPatched->end(), pPRGMemory->begin() + bank * 0x2000,
+                pPRGMemory->begin() + (bank + 1) * 0x2000);
+        }
+        (*vPatched)[read - pPRGMemory->size() + (patch.offset & 0x1FFF)] = patch.value;
+    }
+
+    vPRGBanks.clear();
+    for (uint32_t bank = 0; bank < nBanks; bank++) {
+        vPRGBanks.push_back(pPRGMemory->data() + bank * 0x2000);
+    }
+    for (size_t copy = 0; copy < vPatched->size(); copy += 0x2000) {
+        vPRGBanks.push_back(vPatched->data() + copy);
+    }
+
+    pPRGPatched = vPatched;
+    pPRGOverlay = vPatches.empty() ? nullptr : vOverlay;
+    if (pMapper != nullptr) {
+        pMapper->setPRGOverlay(pPRGOverlay);
+    }
+}
+
 bool Cartridge::cpuWrite(Address addr, Byte data) {
-    return false;
+    // Writes never reach PRG-ROM; the mapper either latches them into a bank
+    // register or stores them in its own PRG-RAM
+    uint32_t mappedAddress = 0;
+    return pMapper->cpuMapWrite(addr, mappedAddress, data);
 }
 
 bool Cartridge::cpuRead(Address addr, Byte& data) {
     uint32_t mappedAddress = 0;
-    if (pMapper->cpuMapRead(addr, mappedAddress)) {
-        data = vPRGMemory[mappedAddress];
+    if (pMapper->cpuMapRead(addr, mappedAddress, data)) {
+        if (mappedAddress != Mapper::MAPPED_INTERNALLY) {
+            data = vPRGBanks[mappedAddress / 0x2000][mappedAddress & 0x1FFF];
+        }
         return true;
     }
     return false;
@@ -63,12 +202,17 @@ bool Cartridge::cpuRead(Address addr, Byte& data) {
 bool Cartridge::ppuWrite(Address addr, Byte data) {
     uint32_t mappedAddress = 0;
     if (pMapper->ppuMapWrite(addr, mappedAddress)) {
-        vCHRMemory[mappedAddress] = data;
+        vCHRRam.write(mappedAddress, data);
         return true;
     }
     return false;
 }
 
 bool Cartridge::ppuRead(Address addr, Byte& data) {
+    uint32_t mappedAddress = 0;
+    if (pMapper->ppuMapRead(addr, mappedAddress)) {
+        data = nCHRBanks == 0 ? vCHRRam.read(mappedAddress) : (*pCHRMemory)[mappedAddress];
+        return true;
+    }
     return false;
-}
\ No newline at end of file
+}
@@ -0,0 +1,143 @@
+#include "../include/Cheats.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// Letters of a Game Genie code, each worth its position
+static const char GAME_GENIE_LETTERS[] = "APZLGITYEOXUKSVN";
+
+Cheats::Cheats(Bus& b) : bus(b) {
+    bus.cheats = this;
+}
+
+Cheats::~Cheats() {
+    if (bus.cheats == this) {
+        bus.cheats = nullptr;
+    }
+    // Leave the cartridge as it came
+    if (bus.cart != nullptr && bus.cart->ImageValid()) {
+        bus.cart->patchPRG({});
+    }
+}
+
+uint32_t Cheats::add(const Cheat& cheat) {
+    bool bROM = cheat.address >= 0x8000;
+    bool bRAM = cheat.address <= 0x1FFF || (cheat.address >= 0x6000 && cheat.address <= 0x7FFF);
+    if (!bROM && !bRAM) {
+        return 0;
+    }
+
+    vCheats.push_back(cheat);
+    vCheats.back().nId = nNextId;
+    if (bROM) {
+        refresh();
+    }
+    return nNextId++;
+}
+
+uint32_t Cheats::addGameGenie(const std::string& sCode) {
+    Cheat cheat;
+    if (!decodeGameGenie(sCode, cheat.address, cheat.value, cheat.compare)) {
+        return 0;
+    }
+    return add(cheat);
+}
+
+bool Cheats::remove(uint32_t nId) {
+    auto found = std::find_if(vCheats.begin(), vCheats.end(),
+        [nId](const Cheat& cheat) { return cheat.nId == nId; });
+    if (found == vCheats.end()) {
+        return false;
+    }
+    bool bROM = found->address >= 0x8000;
+    vCheats.erase(found);
+    if (bROM) {
+        refresh();
+    }
+    return true;
+}
+
+void Cheats::clear() {
+    vCheats.clear();
+    refresh();
+}
+
+Cheats::Cheat* Cheats::find(uint32_t nId) {
+    for (Cheat &cheat : vCheats) {
+        if (cheat.nId == nId) {
+            return &cheat;
+        }
+    }
+    return nullptr;
+}
+
+void Cheats::refresh() {
+    if (bus.cart == nullptr || !bus.cart->ImageValid()) {
+        return;
+    }
+
+    const std::vector<Byte> &rom = *bus.cart->pPRGMemory;
+    std::vector<Cartridge::PRGPatch> vPatches;
+    for (const Cheat &cheat : vCheats) {
+        if (!cheat.bEnabled || cheat.address < 0x8000) {
+            continue;
+        }
+
+        // Every bank the window can map, so bank switching needs no help
+        uint8_t window = (cheat.address >> 13) & 0x03;
+        for (uint32_t offset = cheat.address & 0x1FFF; offset < rom.size(); offset += 0x2000) {
+            if (cheat.compare < 0 || rom[offset] == cheat.compare) {
+                vPatches.push_back({ window, offset, cheat.value });
+            }
+        }
+    }
+
+    bus.cart->patchPRG(vPatches);
+}
+
+void Cheats::freeze() {
+    for (const Cheat &cheat : vCheats) {
+        if (!cheat.bEnabled || cheat.address >= 0x8000) {
+            continue;
+        }
+
+        if (cheat.address <= 0x1FFF) {
+            bus.cpuRam[cheat.address & MEMORY_UNIT.second] = cheat.value;
+        } else {
+            // Through the mapper, which may have its PRG-RAM write protected
+            bus.cart->cpuWrite(cheat.address, cheat.value);
+        }
+    }
+}
+
+bool Cheats::decodeGameGenie(const std::string& sCode, Address& address, Byte& value, int16_t& compare) {
+    if (sCode.size() != 6 && sCode.size() != 8) {
+        return false;
+    }
+
+    Byte n[8];
+    for (size_t i = 0; i < sCode.size(); i++) {
+        const char *letter = std::strchr(GAME_GENIE_LETTERS, std::toupper((unsigned char)sCode[i]));
+        if (letter == nullptr || *letter == '\0') {
+            return false;
+        }
+        n[i] = (Byte)(letter - GAME_GENIE_LETTERS);
+    }
+
+    address = 0x8000
+        | ((n[3] & 7) << 12)
+        | ((n[5] & 7) << 8) | ((n[4] & 8) << 8)
+        | ((n[2] & 7) << 4) | ((n[1] & 8) << 4)
+        | (n[4] & 7) | (n[3] & 8);
+
+    if (sCode.size() == 6) {
+        value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[5] & 8);
+        compare = -1;
+    } else {
+        value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[7] & 8);
+        compare = ((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8);
+    }
+    return true;
+}
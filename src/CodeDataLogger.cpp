@@ -0,0 +1,102 @@
+#include "../include/CodeDataLogger.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+CodeDataLogger::CodeDataLogger() {
+
+}
+
+CodeDataLogger::~CodeDataLogger() {
+    detach();
+}
+
+void CodeDataLogger::attach(Bus& b) {
+    detach();
+    bus = &b;
+    bus->cpu.cdl = this;
+    bus->ppu.cdl = this;
+    bIndirectJump = false;
+
+    size_t nPRG = bus->cart->pPRGMemory->size();
+    size_t nCHR = bus->cart->pCHRMemory->size();
+    if (vPRG.size() != nPRG || vCHR.size() != nCHR) {
+        vPRG.assign(nPRG, 0);
+        vCHR.assign(nCHR, 0);
+    }
+}
+
+void CodeDataLogger::detach() {
+    if (bus != nullptr) {
+        if (bus->cpu.cdl == this) {
+            bus->cpu.cdl = nullptr;
+        }
+        if (bus->ppu.cdl == this) {
+            bus->ppu.cdl = nullptr;
+        }
+    }
+    bus = nullptr;
+}
+
+void CodeDataLogger::clear() {
+    std::fill(vPRG.begin(), vPRG.end(), 0);
+    std::fill(vCHR.begin(), vCHR.end(), 0);
+}
+
+bool CodeDataLogger::load(const std::string& sFileName) {
+    std::ifstream ifs(sFileName, std::ifstream::binary | std::ifstream::ate);
+    if (!ifs.is_open() || (size_t)ifs.tellg() != vPRG.size() + vCHR.size()) {
+        return false;
+    }
+
+    std::vector<Byte> vFile(vPRG.size() + vCHR.size());
+    ifs.seekg(0);
+    if (!ifs.read((char*)vFile.data(), vFile.size())) {
+        return false;
+    }
+
+    std::copy(vFile.begin(), vFile.begin() + vPRG.size(), vPRG.begin());
+    std::copy(vFile.begin() + vPRG.size(), vFile.end(), vCHR.begin());
+    return true;
+}
+
+bool CodeDataLogger::save(const std::string& sFileName) const {
+    std::ofstream ofs(sFileName, std::ofstream::binary);
+    ofs.write((const char*)vPRG.data(), vPRG.size());
+    ofs.write((const char*)vCHR.data(), vCHR.size());
+    return (bool)ofs;
+}
+
+uint32_t CodeDataLogger::prgOffset(Address address) const {
+    return bus->cart->pMapper->prgBankBase(address) + (address & 0x1FFF);
+}
+
+void CodeDataLogger::logInstruction(Address pc, Address operandEnd) {
+    Byte window = ((pc >> 13) & 0x03) << 2;
+    vPRG[prgOffset(pc)] |= CDLPrg::CODE | window | (bIndirectJump ? CDLPrg::INDIRECT_CODE : 0);
+    bIndirectJump = false;
+
+    // Operands may run into the next window, which can hold any bank
+    for (Address operand = pc + 1; operand != operandEnd && operand >= 0x8000; operand++) {
+        vPRG[prgOffset(operand)] |= CDLPrg::CODE | (((operand >> 13) & 0x03) << 2);
+    }
+}
+
+void CodeDataLogger::logData(Address address, Byte flags) {
+    vPRG[prgOffset(address)] |= flags | (((address >> 13) & 0x03) << 2);
+}
+
+void CodeDataLogger::chr(Address address, CDLChr::Flags flag) {
+    if (!vCHR.empty()) {
+        vCHR[bus->cart->pMapper->chrBankBase(address) + (address & 0x03FF)] |= flag;
+    }
+}
+
+size_t CodeDataLogger::countPRG(Byte flags) const {
+    return std::count_if(vPRG.begin(), vPRG.end(), [flags](Byte b) { return (b & flags) != 0; });
+}
+
+size_t CodeDataLogger::countCHR(Byte flags) const {
+    return std::count_if(vCHR.begin(), vCHR.end(), [flags](Byte b) { return (b & flags) != 0; });
+}
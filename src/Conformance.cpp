@@ -0,0 +1,420 @@
+#include "../include/Conformance.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+// System clocks in an NTSC frame, for turning a log run into frames
+static constexpr uint32_t CLOCKS_PER_FRAME = 341 * 262;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Registers and cycle count before one instruction, as nestest.log has them
+struct LogLine {
+    Address pc = 0x0000;
+    Byte a = 0x00, x = 0x00, y = 0x00, p = 0x00, sp = 0x00;
+    uint64_t nCycle = 0;
+
+    bool operator==(const LogLine& other) const {
+        return pc == other.pc && a == other.a && x == other.x && y == other.y
+            && p == other.p && sp == other.sp && nCycle == other.nCycle;
+    }
+};
+
+static bool parseValue(const std::string& sLine, const char* key, int base, uint64_t& value) {
+    size_t pos = sLine.find(key);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const char *start = sLine.c_str() + pos + std::strlen(key);
+    char *end = nullptr;
+    value = std::strtoull(start, &end, base);
+    return end != start;
+}
+
+static bool parseLogLine(const std::string& sLine, LogLine& line) {
+    // The disassembly comes first and is skipped: registers start at "A:"
+    size_t registers = sLine.find("A:");
+    if (registers == std::string::npos) {
+        return false;
+    }
+    std::string sRegisters = sLine.substr(registers);
+
+    uint64_t pc, a, x, y, p, sp;
+    char *end = nullptr;
+    pc = std::strtoull(sLine.c_str(), &end, 16);
+    bool bOk = end == sLine.c_str() + 4
+        && parseValue(sRegisters, "A:", 16, a) && parseValue(sRegisters, "X:", 16, x)
+        && parseValue(sRegisters, "Y:", 16, y) && parseValue(sRegisters, " P:", 16, p)
+        && parseValue(sRegisters, "SP:", 16, sp) && parseValue(sRegisters, "CYC:", 10, line.nCycle);
+    line.pc = (Address)pc;
+    line.a = (Byte)a;
+    line.x = (Byte)x;
+    line.y = (Byte)y;
+    line.p = (Byte)p;
+    line.sp = (Byte)sp;
+    return bOk;
+}
+
+static std::string formatLogLine(const LogLine& line) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "$%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu",
+        line.pc, line.a, line.x, line.y, line.p, line.sp, (unsigned long long)line.nCycle);
+    return text;
+}
+
+// Clocks until the next clock would start an instruction
+static void runToInstruction(Bus& bus) {
+    while (!(bus.cpuComplete() && bus.clockCount() % 3 == 0)) {
+        bus.clock();
+    }
+}
+
+// NROM image reporting through $6000: JMP ($02FF) lands at $8100, which
+// passes, when the pointer's high byte comes from $0200, and at $8200, which
+// fails, when it comes from $0300
+static std::vector<Byte> jmpIndirectImage() {
+    std::vector<Byte> vImage(16 + 0x4000 + 0x2000, 0x00);
+    const Byte header[] = { 'N', 'E', 'S', 0x1A, 0x01, 0x01 };
+    std::copy(std::begin(header), std::end(header), vImage.begin());
+    Byte *prg = vImage.data() + 16;
+
+    auto place = [&](Address address, std::initializer_list<Byte> code) {
+        std::copy(code.begin(), code.end(), prg + (address & 0x3FFF));
+    };
+    place(0x8000, {
+        0x78, 0xD8, 0xA2, 0xFF, 0x9A,               // SEI, CLD, LDX #$FF, TXS
+        0xA9, 0x80, 0x8D, 0x00, 0x60,               // Running
+        0xA9, 0xDE, 0x8D, 0x01, 0x60,               // Signature DE B0 61
+        0xA9, 0xB0, 0x8D, 0x02, 0x60,
+        0xA9, 0x61, 0x8D, 0x03, 0x60,
+        0xA9, 0x00, 0x8D, 0xFF, 0x02,               // $02FF = $00
+        0xA9, 0x81, 0x8D, 0x00, 0x02,               // $0200 = $81
+        0xA9, 0x82, 0x8D, 0x00, 0x03,               // $0300 = $82
+        0x6C, 0xFF, 0x02                            // JMP ($02FF)
+    });
+    place(0x8100, {
+        0xA9, 0x00, 0x8D, 0x04, 0x60,               // No message
+        0x8D, 0x00, 0x60,                           // Passed
+        0x4C, 0x08, 0x81                            // Hang
+    });
+    place(0x8200, {
+        0xA2, 0x00,                                 // LDX #$00
+        0xBD, 0x80, 0x82, 0x9D, 0x04, 0x60,         // Copy the message at $8280
+        0xF0, 0x03, 0xE8, 0xD0, 0xF5,               // up to its terminator
+        0xA9, 0x01, 0x8D, 0x00, 0x60,               // Failed with code 1
+        0x4C, 0x12, 0x82                            // Hang
+    });
+    const char *sMessage = "JMP ($xxFF) read its high byte from the next page";
+    std::copy(sMessage, sMessage + std::strlen(sMessage) + 1, prg + 0x0280);
+    place(0x8300, { 0x40 });                        // RTI
+    place(0xFFFA, { 0x00, 0x83, 0x00, 0x80, 0x00, 0x83 });
+    return vImage;
+}
+
+// NROM image run from $C000 as a log test: pushes and pulls of P through
+// PHP/PLA, PHA/PLP and BRK/RTI, with B set and U clear in what is pulled
+static std::vector<Byte> statusFlagsImage() {
+    std::vector<Byte> vImage(16 + 0x4000 + 0x2000, 0x00);
+    const Byte header[] = { 'N', 'E', 'S', 0x1A, 0x01, 0x01 };
+    std::copy(std::begin(header), std::end(header), vImage.begin());
+    Byte *prg = vImage.data() + 16;
+
+    auto place = [&](Address address, std::initializer_list<Byte> code) {
+        std::copy(code.begin(), code.end(), prg + (address & 0x3FFF));
+    };
+    place(0xC000, {
+        0x08, 0x68,                                 // PHP, PLA: B and U pushed, P keeps U
+        0xA9, 0xFF, 0x48, 0x28,                     // LDA #$FF, PHA, PLP: B dropped
+        0xA9, 0x00,                                 // LDA #$00
+        0x00, 0x00,                                 // BRK
+        0x08, 0xEA,                                 // PHP, NOP: U still set after RTI
+        0x4C, 0x0C, 0xC0                            // Hang
+    });
+    place(0xC100, {
+        0x68, 0x29, 0xDF, 0x48,                     // PLA, AND #$DF, PHA: U cleared
+        0x40                                        // RTI: B dropped, U set
+    });
+    place(0xC200, { 0x40 });                        // RTI
+    place(0xFFFA, { 0x00, 0xC2, 0x00, 0xC0, 0x00, 0xC1 });
+    return vImage;
+}
+
+static const char *STATUS_FLAGS_LOG =
+    "C000  08        PHP         A:00 X:00 Y:00 P:24 SP:FD CYC:7\n"
+    "C001  68        PLA         A:00 X:00 Y:00 P:24 SP:FC CYC:10\n"
+    "C002  A9 FF     LDA #$FF    A:34 X:00 Y:00 P:24 SP:FD CYC:14\n"
+    "C004  48        PHA         A:FF X:00 Y:00 P:A4 SP:FD CYC:16\n"
+    "C005  28        PLP         A:FF X:00 Y:00 P:A4 SP:FC CYC:19\n"
+    "C006  A9 00     LDA #$00    A:FF X:00 Y:00 P:EF SP:FD CYC:23\n"
+    "C008  00        BRK         A:00 X:00 Y:00 P:6F SP:FD CYC:25\n"
+    "C100  68        PLA         A:00 X:00 Y:00 P:6F SP:FA CYC:32\n"
+    "C101  29 DF     AND #$DF    A:7F X:00 Y:00 P:6D SP:FB CYC:36\n"
+    "C103  48        PHA         A:5F X:00 Y:00 P:6D SP:FB CYC:38\n"
+    "C104  40        RTI         A:5F X:00 Y:00 P:6D SP:FA CYC:41\n"
+    "C00A  08        PHP         A:5F X:00 Y:00 P:6F SP:FD CYC:47\n"
+    "C00B  EA        NOP         A:5F X:00 Y:00 P:6F SP:FC CYC:50\n"
+    "C00C  4C 0C C0  JMP $C00C   A:5F X:00 Y:00 P:6F SP:FC CYC:52\n"
+    "C00C  4C 0C C0  JMP $C00C   A:5F X:00 Y:00 P:6F SP:FC CYC:55\n";
+
+std::vector<Conformance::Test> Conformance::builtinTests() {
+    Test jmp;
+    jmp.sName = "jmp_indirect_wrap";
+    jmp.sROM = "(built in)";
+    jmp.vImage = jmpIndirectImage();
+
+    Test flags;
+    flags.sName = "status_flags";
+    flags.sROM = "(built in)";
+    flags.sLog = "(built in)";
+    flags.vImage = statusFlagsImage();
+    flags.sLogText = STATUS_FLAGS_LOG;
+    return { jmp, flags };
+}
+
+bool Conformance::loadSuite(const std::string& sFileName) {
+    std::ifstream ifs(sFileName);
+    if (!ifs.is_open()) {
+        return false;
+    }
+
+    std::string sLine;
+    while (std::getline(ifs, sLine)) {
+        std::istringstream iss(sLine);
+        Test test;
+        if (!(iss >> test.sName) || test.sName[0] == '#') {
+            continue;
+        }
+        if (!(iss >> test.sROM)) {
+            return false;
+        }
+        if (iss >> test.sLog) {
+            iss >> test.nLogLines;
+        }
+        vTests.push_back(test);
+    }
+    return true;
+}
+
+std::vector<Conformance::Result> Conformance::run(uint32_t nThreads) const {
+    std::vector<Result> vResults(vTests.size());
+    if (nThreads == 0) {
+        nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    nThreads = std::min<uint32_t>(nThreads, vTests.size());
+
+    // Each worker takes the next test until none are left; machines share nothing
+    std::atomic<size_t> nNext{0};
+    auto worker = [&]() {
+        for (size_t i = nNext++; i < vTests.size(); i = nNext++) {
+            vResults[i] = run(vTests[i]);
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    for (uint32_t i = 0; i < nThreads; i++) {
+        vThreads.emplace_back(worker);
+    }
+    for (std::thread &thread : vThreads) {
+        thread.join();
+    }
+    return vResults;
+}
+
+Conformance::Result Conformance::run(const Test& test) const {
+    Clock::time_point start = Clock::now();
+
+    std::shared_ptr<Cartridge> cart = test.vImage.empty() ? std::make_shared<Cartridge>(test.sROM)
+        : std::make_shared<Cartridge>(test.vImage.data(), test.vImage.size());
+    if (!cart->ImageValid()) {
+        Result result;
+        result.sName = test.sName;
+        result.sMessage = "cannot load " + test.sROM;
+        return result;
+    }
+    std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+    // Nothing looks at the picture
+    bus->ppu.outputEnabled = false;
+    bus->insertCartridge(cart);
+    bus->reset();
+
+    Result result = test.sLog.empty() ? runStatus(test, *bus) : runLog(test, *bus);
+    result.sName = test.sName;
+    result.dSeconds = secondsSince(start);
+    return result;
+}
+
+Conformance::Result Conformance::runLog(const Test& test, Bus& bus) const {
+    Result result;
+    std::istringstream iss(test.sLogText);
+    std::ifstream ifs;
+    if (test.sLogText.empty()) {
+        ifs.open(test.sLog);
+        if (!ifs.is_open()) {
+            result.sMessage = "cannot load " + test.sLog;
+            return result;
+        }
+    }
+    std::istream &log = test.sLogText.empty() ? static_cast<std::istream&>(ifs) : iss;
+
+    // Let the reset sequence finish, then start where the log does
+    runToInstruction(bus);
+    CPU::State state;
+    bus.cpu.SaveState(state);
+    state.Accumulator = 0x00;
+    state.X = 0x00;
+    state.Y = 0x00;
+    state.StackPointer = 0xFD;
+    state.StatusRegister = 0x24;
+    state.ProgramCounter = 0xC000;
+    // At an instruction boundary; the cycle core never counts these down
+    state.CyclesLeft = 0;
+    bus.cpu.LoadState(state);
+    if (bus.cycleCpu != nullptr) {
+        // It only reads bus.cpu when it starts over
+        bus.cycleCpu->restart();
+    }
+
+    Clock::time_point start = Clock::now();
+    uint64_t nClocks = 0;
+    uint64_t nFirstCycle = 0;
+    std::string sLine;
+    for (uint32_t line = 0; std::getline(log, sLine); line++) {
+        if (test.nLogLines != 0 && line >= test.nLogLines) {
+            break;
+        }
+
+        LogLine expected;
+        if (!parseLogLine(sLine, expected)) {
+            result.nCode = line + 1;
+            result.sMessage = "unreadable log line " + std::to_string(line + 1);
+            return result;
+        }
+        if (line == 0) {
+            nFirstCycle = expected.nCycle;
+        }
+
+        bus.cpu.SaveState(state);
+        LogLine actual;
+        actual.pc = state.ProgramCounter;
+        actual.a = state.Accumulator;
+        actual.x = state.X;
+        actual.y = state.Y;
+        actual.p = state.StatusRegister;
+        actual.sp = state.StackPointer;
+        actual.nCycle = nFirstCycle + nClocks / 3;
+        if (!(actual == expected)) {
+            result.status = ConformanceStatus::FAILED;
+            result.nCode = line + 1;
+            result.sMessage = "line " + std::to_string(line + 1) + ": expected "
+                + formatLogLine(expected) + ", got " + formatLogLine(actual);
+            result.nFrames = nClocks / CLOCKS_PER_FRAME;
+            return result;
+        }
+
+        uint32_t nBefore = bus.clockCount();
+        bus.clock();
+        runToInstruction(bus);
+        nClocks += bus.clockCount() - nBefore;
+
+        if ((line & 0x3FF) == 0x3FF && secondsSince(start) > dSecondsLimit) {
+            result.status = ConformanceStatus::TIMED_OUT;
+            result.nFrames = nClocks / CLOCKS_PER_FRAME;
+            return result;
+        }
+    }
+
+    result.status = ConformanceStatus::PASSED;
+    result.nFrames = nClocks / CLOCKS_PER_FRAME;
+    return result;
+}
+
+Conformance::Result Conformance::runStatus(const Test&, Bus& bus) const {
+    Result result;
+    result.status = ConformanceStatus::TIMED_OUT;
+
+    // Frames until the reset button is let go of; 100 ms is six frames
+    int32_t nResetIn = -1;
+    Clock::time_point start = Clock::now();
+    for (uint32_t frame = 0; frame < nFrameLimit; frame++) {
+        bus.clockFrame();
+        result.nFrames = frame + 1;
+
+        if (nResetIn >= 0 && nResetIn-- == 0) {
+            bus.reset();
+            continue;
+        }
+
+        bool bSigned = bus.cpuRead(0x6001, true) == 0xDE && bus.cpuRead(0x6002, true) == 0xB0
+            && bus.cpuRead(0x6003, true) == 0x61;
+        if (bSigned) {
+            Byte status = bus.cpuRead(0x6000, true);
+            if (status == 0x81 && nResetIn < 0) {
+                nResetIn = 6;
+            } else if (status < 0x80) {
+                result.status = status == 0x00 ? ConformanceStatus::PASSED : ConformanceStatus::FAILED;
+                result.nCode = status;
+                for (Address address = 0x6004; address < 0x7FFF; address++) {
+                    Byte c = bus.cpuRead(address, true);
+                    if (c == 0x00) {
+                        break;
+                    }
+                    result.sMessage += (char)c;
+                }
+                return result;
+            }
+        }
+
+        if (secondsSince(start) > dSecondsLimit) {
+            break;
+        }
+    }
+    return result;
+}
+
+void Conformance::writeSummary(const std::vector<Result>& vResults, std::ostream& out) {
+    static const char *STATUS[] = { "pass", "FAIL", "TIMEOUT", "ERROR" };
+
+    size_t nWidth = 4;
+    for (const Result &result : vResults) {
+        nWidth = std::max(nWidth, result.sName.size());
+    }
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-*s  %-7s  %6s  %8s  %s\n", (int)nWidth, "Test", "Status", "Frames", "Seconds", "Detail");
+    out << line;
+
+    uint32_t nCounts[4] = { 0, 0, 0, 0 };
+    for (const Result &result : vResults) {
+        nCounts[result.status]++;
+        std::snprintf(line, sizeof(line), "%-*s  %-7s  %6llu  %8.3f  ", (int)nWidth, result.sName.c_str(),
+            STATUS[result.status], (unsigned long long)result.nFrames, result.dSeconds);
+        // Messages from the ROMs span lines
+        std::string sDetail = result.sMessage;
+        std::replace(sDetail.begin(), sDetail.end(), '\n', ' ');
+        out << line << sDetail << '\n';
+    }
+
+    std::snprintf(line, sizeof(line), "%u passed, %u failed, %u timed out, %u errors\n",
+        nCounts[0], nCounts[1], nCounts[2], nCounts[3]);
+    out << line;
+}
+
+bool Conformance::allPassed(const std::vector<Result>& vResults) {
+    return std::all_of(vResults.begin(), vResults.end(),
+        [](const Result& result) { return result.status == ConformanceStatus::PASSED; });
+}
@@ -0,0 +1,503 @@
+#include "../include/CycleCPU.hpp"
+#include "../include/Bus.hpp"
+
+namespace CycleMode {
+    enum Mode : uint8_t {
+        IMP, ACC, IMM, ZP0, ZPX, ZPY, ABS, ABX, ABY, IND, IZX, IZY, REL
+    };
+}
+
+namespace CycleOp {
+    enum Op : uint8_t {
+        ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+        CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+        JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+        RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+        XXX
+    };
+}
+
+struct Decoded {
+    CycleMode::Mode mode;
+    CycleOp::Op op;
+};
+
+// The same instruction set as the opcode table of CPU; illegal opcodes are
+// two-cycle no-ops there too
+static constexpr std::array<Decoded, 256> DECODE = [] {
+    using namespace CycleMode;
+    using namespace CycleOp;
+    return std::array<Decoded, 256>{ {
+        { IMP, BRK }, { IZX, ORA }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZP0, ORA }, { ZP0, ASL }, { IMP, XXX },
+        { IMP, PHP }, { IMM, ORA }, { ACC, ASL }, { IMP, XXX }, { IMP, XXX }, { ABS, ORA }, { ABS, ASL }, { IMP, XXX },
+        { REL, BPL }, { IZY, ORA }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, ORA }, { ZPX, ASL }, { IMP, XXX },
+        { IMP, CLC }, { ABY, ORA }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, ORA }, { ABX, ASL }, { IMP, XXX },
+        { ABS, JSR }, { IZX, AND }, { IMP, XXX }, { IMP, XXX }, { ZP0, BIT }, { ZP0, AND }, { ZP0, ROL }, { IMP, XXX },
+        { IMP, PLP }, { IMM, AND }, { ACC, ROL }, { IMP, XXX }, { ABS, BIT }, { ABS, AND }, { ABS, ROL }, { IMP, XXX },
+        { REL, BMI }, { IZY, AND }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, AND }, { ZPX, ROL }, { IMP, XXX },
+        { IMP, SEC }, { ABY, AND }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, AND }, { ABX, ROL }, { IMP, XXX },
+        { IMP, RTI }, { IZX, EOR }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZP0, EOR }, { ZP0, LSR }, { IMP, XXX },
+        { IMP, PHA }, { IMM, EOR }, { ACC, LSR }, { IMP, XXX }, { ABS, JMP }, { ABS, EOR }, { ABS, LSR }, { IMP, XXX },
+        { REL, BVC }, { IZY, EOR }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, EOR }, { ZPX, LSR }, { IMP, XXX },
+        { IMP, CLI }, { ABY, EOR }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, EOR }, { ABX, LSR }, { IMP, XXX },
+        { IMP, RTS }, { IZX, ADC }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZP0, ADC }, { ZP0, ROR }, { IMP, XXX },
+        { IMP, PLA }, { IMM, ADC }, { ACC, ROR }, { IMP, XXX }, { IND, JMP }, { ABS, ADC }, { ABS, ROR }, { IMP, XXX },
+        { REL, BVS }, { IZY, ADC }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, ADC }, { ZPX, ROR }, { IMP, XXX },
+        { IMP, SEI }, { ABY, ADC }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, ADC }, { ABX, ROR }, { IMP, XXX },
+        { IMP, XXX }, { IZX, STA }, { IMP, XXX }, { IMP, XXX }, { ZP0, STY }, { ZP0, STA }, { ZP0, STX }, { IMP, XXX },
+        { IMP, DEY }, { IMP, XXX }, { IMP, TXA }, { IMP, XXX }, { ABS, STY }, { ABS, STA }, { ABS, STX }, { IMP, XXX },
+        { REL, BCC }, { IZY, STA }, { IMP, XXX }, { IMP, XXX }, { ZPX, STY }, { ZPX, STA }, { ZPY, STX }, { IMP, XXX },
+        { IMP, TYA }, { ABY, STA }, { IMP, TXS }, { IMP, XXX }, { IMP, XXX }, { ABX, STA }, { IMP, XXX }, { IMP, XXX },
+        { IMM, LDY }, { IZX, LDA }, { IMM, LDX }, { IMP, XXX }, { ZP0, LDY }, { ZP0, LDA }, { ZP0, LDX }, { IMP, XXX },
+        { IMP, TAY }, { IMM, LDA }, { IMP, TAX }, { IMP, XXX }, { ABS, LDY }, { ABS, LDA }, { ABS, LDX }, { IMP, XXX },
+        { REL, BCS }, { IZY, LDA }, { IMP, XXX }, { IMP, XXX }, { ZPX, LDY }, { ZPX, LDA }, { ZPY, LDX }, { IMP, XXX },
+        { IMP, CLV }, { ABY, LDA }, { IMP, TSX }, { IMP, XXX }, { ABX, LDY }, { ABX, LDA }, { ABY, LDX }, { IMP, XXX },
+        { IMM, CPY }, { IZX, CMP }, { IMP, XXX }, { IMP, XXX }, { ZP0, CPY }, { ZP0, CMP }, { ZP0, DEC }, { IMP, XXX },
+        { IMP, INY }, { IMM, CMP }, { IMP, DEX }, { IMP, XXX }, { ABS, CPY }, { ABS, CMP }, { ABS, DEC }, { IMP, XXX },
+        { REL, BNE }, { IZY, CMP }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, CMP }, { ZPX, DEC }, { IMP, XXX },
+        { IMP, CLD }, { ABY, CMP }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, CMP }, { ABX, DEC }, { IMP, XXX },
+        { IMM, CPX }, { IZX, SBC }, { IMP, XXX }, { IMP, XXX }, { ZP0, CPX }, { ZP0, SBC }, { ZP0, INC }, { IMP, XXX },
+        { IMP, INX }, { IMM, SBC }, { IMP, NOP }, { IMP, XXX }, { ABS, CPX }, { ABS, SBC }, { ABS, INC }, { IMP, XXX },
+        { REL, BEQ }, { IZY, SBC }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ZPX, SBC }, { ZPX, INC }, { IMP, XXX },
+        { IMP, SED }, { ABY, SBC }, { IMP, XXX }, { IMP, XXX }, { IMP, XXX }, { ABX, SBC }, { ABX, INC }, { IMP, XXX }
+    } };
+}();
+
+static constexpr Address STACK = 0x0100;
+
+CycleCPU::CycleCPU(Bus& b) : bus(b) {
+    restart();
+    bus.cycleCpu = this;
+}
+
+CycleCPU::~CycleCPU() {
+    if (bus.cycleCpu == this) {
+        bus.cycleCpu = nullptr;
+    }
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+void CycleCPU::clock() {
+    if (bWrite) {
+        bus.cpuWrite(accessAddress, data);
+    } else {
+        data = bus.cpuRead(accessAddress);
+    }
+    if (progress.nAccesses < progress.data.size()) {
+        progress.data[progress.nAccesses++] = data;
+    }
+    nCycles++;
+    handle.resume();
+}
+
+void CycleCPU::restart(const Progress* resume) {
+    if (handle) {
+        handle.destroy();
+    }
+
+    const CPU &cpu = bus.cpu;
+    A = cpu.Accumulator;
+    X = cpu.X;
+    Y = cpu.Y;
+    S = cpu.StackPointer;
+    P = (cpu.GetStatusRegister() & ~StatusRegisterFlags::B) | StatusRegisterFlags::U;
+    PC = cpu.ProgramCounter;
+    nStall = cpu.CyclesLeft;
+    progress = Progress{};
+    nReplayInterrupt = resume != nullptr ? resume->nInterrupt : -1;
+    // The old coroutine may have stopped on an opcode fetch
+    bBoundary = false;
+
+    // Up to its first access, which the next clock makes
+    handle = run().handle;
+    if (!handle) {
+        return;
+    }
+    handle.resume();
+
+    // Accesses made before the state was saved are not made again: what they
+    // read is handed back, and what they wrote is in memory already
+    if (resume != nullptr) {
+        for (uint8_t i = 0; i < resume->nAccesses; i++) {
+            data = resume->data[i];
+            progress.data[progress.nAccesses++] = data;
+            handle.resume();
+        }
+    }
+    nReplayInterrupt = -1;
+}
+
+void CycleCPU::publish() {
+    CPU &cpu = bus.cpu;
+    cpu.Accumulator = A;
+    cpu.X = X;
+    cpu.Y = Y;
+    cpu.StackPointer = S;
+    cpu.SetStatusRegister(P);
+    cpu.ProgramCounter = PC;
+    cpu.CyclesLeft = 0;
+}
+
+void CycleCPU::setZN(Byte value) {
+    P = (P & ~(StatusRegisterFlags::Z | StatusRegisterFlags::N))
+        | (value & StatusRegisterFlags::N) | (value == 0x00 ? StatusRegisterFlags::Z : 0);
+}
+
+void CycleCPU::compare(Byte reg, Byte value) {
+    P = (P & ~StatusRegisterFlags::C) | (reg >= value ? StatusRegisterFlags::C : 0);
+    setZN(reg - value);
+}
+
+void CycleCPU::add(Byte value) {
+    uint16_t sum = A + value + (P & StatusRegisterFlags::C);
+    bool bOverflow = (~(A ^ value) & (A ^ sum)) & 0x80;
+    P = (P & ~(StatusRegisterFlags::C | StatusRegisterFlags::V))
+        | (sum > 0xFF ? StatusRegisterFlags::C : 0) | (bOverflow ? StatusRegisterFlags::V : 0);
+    A = sum & 0xFF;
+    setZN(A);
+}
+
+CycleCPU::Task CycleCPU::run() {
+    using namespace StatusRegisterFlags;
+
+    // The rest of a reset or of an instruction the default core had begun;
+    // its registers already hold the result
+    for (; nStall > 0; nStall--) {
+        co_await read(STACK | S);
+    }
+
+    Byte lo, hi, value;
+    Address address, base;
+
+    for (;;) {
+        publish();
+
+        // Polled between instructions: NMI is the edge the PPU latched, IRQ
+        // the level the cartridge holds. The NMI is only taken off the PPU
+        // once its vector is read, so a state saved on the way is not lost.
+        progress.nAccesses = 0;
+        if (nReplayInterrupt >= 0) {
+            progress.nInterrupt = nReplayInterrupt;
+        } else if (bus.ppu.nmi) {
+            progress.nInterrupt = 2;
+        } else {
+            progress.nInterrupt = !(P & I) && bus.cart->GetMapper()->irqState() ? 1 : 0;
+        }
+        nReplayInterrupt = -1;
+
+        bool bNMI = progress.nInterrupt == 2;
+        if (progress.nInterrupt != 0) {
+            bBoundary = true;
+            co_await read(PC);
+            bBoundary = false;
+            co_await read(PC);
+            co_await write(STACK | S--, PC >> 8);
+            co_await write(STACK | S--, PC & 0xFF);
+            co_await write(STACK | S--, (P & ~B) | U);
+            P |= I;
+            address = bNMI ? 0xFFFA : 0xFFFE;
+            lo = co_await read(address);
+            hi = co_await read(address + 1);
+            PC = lo | (hi << 8);
+            if (bNMI) {
+                bus.ppu.nmi = false;
+            }
+            continue;
+        }
+
+        bBoundary = true;
+        Byte opcode = co_await read(PC);
+        bBoundary = false;
+        PC++;
+        const Decoded decoded = DECODE[opcode];
+
+        // Instructions with their own cycle pattern
+        switch (decoded.op) {
+            case CycleOp::BRK:
+                co_await read(PC);
+                PC++;
+                co_await write(STACK | S--, PC >> 8);
+                co_await write(STACK | S--, PC & 0xFF);
+                co_await write(STACK | S--, P | B | U);
+                P |= I;
+                lo = co_await read(0xFFFE);
+                hi = co_await read(0xFFFF);
+                PC = lo | (hi << 8);
+                continue;
+
+            case CycleOp::JSR:
+                lo = co_await read(PC);
+                PC++;
+                co_await read(STACK | S);
+                co_await write(STACK | S--, PC >> 8);
+                co_await write(STACK | S--, PC & 0xFF);
+                hi = co_await read(PC);
+                PC = lo | (hi << 8);
+                continue;
+
+            case CycleOp::RTS:
+                co_await read(PC);
+                co_await read(STACK | S);
+                S++;
+                lo = co_await read(STACK | S);
+                S++;
+                hi = co_await read(STACK | S);
+                PC = lo | (hi << 8);
+                co_await read(PC);
+                PC++;
+                continue;
+
+            case CycleOp::RTI:
+                co_await read(PC);
+                co_await read(STACK | S);
+                S++;
+                value = co_await read(STACK | S);
+                P = (value & ~B) | U;
+                S++;
+                lo = co_await read(STACK | S);
+                S++;
+                hi = co_await read(STACK | S);
+                PC = lo | (hi << 8);
+                continue;
+
+            case CycleOp::PHA:
+            case CycleOp::PHP:
+                co_await read(PC);
+                co_await write(STACK | S--, decoded.op == CycleOp::PHA ? A : (P | B | U));
+                continue;
+
+            case CycleOp::PLA:
+            case CycleOp::PLP:
+                co_await read(PC);
+                co_await read(STACK | S);
+                S++;
+                value = co_await read(STACK | S);
+                if (decoded.op == CycleOp::PLA) {
+                    A = value;
+                    setZN(A);
+                } else {
+                    P = (value & ~B) | U;
+                }
+                continue;
+
+            case CycleOp::JMP:
+                lo = co_await read(PC);
+                PC++;
+                hi = co_await read(PC);
+                PC++;
+                address = lo | (hi << 8);
+                if (decoded.mode == CycleMode::IND) {
+                    // The pointer's high byte never carries into the next page
+                    lo = co_await read(address);
+                    hi = co_await read((address & 0xFF00) | ((address + 1) & 0x00FF));
+                    address = lo | (hi << 8);
+                }
+                PC = address;
+                continue;
+
+            case CycleOp::BCC: case CycleOp::BCS: case CycleOp::BEQ: case CycleOp::BMI:
+            case CycleOp::BNE: case CycleOp::BPL: case CycleOp::BVC: case CycleOp::BVS: {
+                value = co_await read(PC);
+                PC++;
+                bool bTaken = false;
+                switch (decoded.op) {
+                    case CycleOp::BCC: bTaken = !(P & C); break;
+                    case CycleOp::BCS: bTaken = (P & C); break;
+                    case CycleOp::BEQ: bTaken = (P & Z); break;
+                    case CycleOp::BMI: bTaken = (P & N); break;
+                    case CycleOp::BNE: bTaken = !(P & Z); break;
+                    case CycleOp::BPL: bTaken = !(P & N); break;
+                    case CycleOp::BVC: bTaken = !(P & V); break;
+                    default: bTaken = (P & V); break;
+                }
+                if (bTaken) {
+                    co_await read(PC);
+                    address = PC + (int8_t)value;
+                    if ((address ^ PC) & 0xFF00) {
+                        co_await read((PC & 0xFF00) | (address & 0x00FF));
+                    }
+                    PC = address;
+                }
+                continue;
+            }
+
+            default:
+                break;
+        }
+
+        if (decoded.mode == CycleMode::IMP || decoded.mode == CycleMode::ACC) {
+            co_await read(PC);
+            switch (decoded.op) {
+                case CycleOp::CLC: P &= ~C; break;
+                case CycleOp::CLD: P &= ~D; break;
+                case CycleOp::CLI: P &= ~I; break;
+                case CycleOp::CLV: P &= ~V; break;
+                case CycleOp::SEC: P |= C; break;
+                case CycleOp::SED: P |= D; break;
+                case CycleOp::SEI: P |= I; break;
+                case CycleOp::DEX: setZN(--X); break;
+                case CycleOp::DEY: setZN(--Y); break;
+                case CycleOp::INX: setZN(++X); break;
+                case CycleOp::INY: setZN(++Y); break;
+                case CycleOp::TAX: X = A; setZN(X); break;
+                case CycleOp::TAY: Y = A; setZN(Y); break;
+                case CycleOp::TSX: X = S; setZN(X); break;
+                case CycleOp::TXA: A = X; setZN(A); break;
+                case CycleOp::TXS: S = X; break;
+                case CycleOp::TYA: A = Y; setZN(A); break;
+                case CycleOp::ASL:
+                    P = (P & ~C) | (A >> 7);
+                    A <<= 1;
+                    setZN(A);
+                    break;
+                case CycleOp::LSR:
+                    P = (P & ~C) | (A & C);
+                    A >>= 1;
+                    setZN(A);
+                    break;
+                case CycleOp::ROL:
+                    value = (A << 1) | (P & C);
+                    P = (P & ~C) | (A >> 7);
+                    A = value;
+                    setZN(A);
+                    break;
+                case CycleOp::ROR:
+                    value = (A >> 1) | ((P & C) << 7);
+                    P = (P & ~C) | (A & C);
+                    A = value;
+                    setZN(A);
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        // Stores and read-modify-writes always spend the cycle an indexed
+        // address may need to fix its high byte; reads only when it does
+        bool bStore = decoded.op == CycleOp::STA || decoded.op == CycleOp::STX || decoded.op == CycleOp::STY;
+        bool bModify = decoded.op == CycleOp::ASL || decoded.op == CycleOp::LSR || decoded.op == CycleOp::ROL
+            || decoded.op == CycleOp::ROR || decoded.op == CycleOp::INC || decoded.op == CycleOp::DEC;
+
+        switch (decoded.mode) {
+            case CycleMode::IMM:
+                address = PC++;
+                break;
+            case CycleMode::ZP0:
+                address = co_await read(PC);
+                PC++;
+                break;
+            case CycleMode::ZPX:
+            case CycleMode::ZPY:
+                address = co_await read(PC);
+                PC++;
+                co_await read(address);
+                address = (address + (decoded.mode == CycleMode::ZPX ? X : Y)) & 0x00FF;
+                break;
+            case CycleMode::ABS:
+                lo = co_await read(PC);
+                PC++;
+                hi = co_await read(PC);
+                PC++;
+                address = lo | (hi << 8);
+                break;
+            case CycleMode::ABX:
+            case CycleMode::ABY:
+                lo = co_await read(PC);
+                PC++;
+                hi = co_await read(PC);
+                PC++;
+                base = lo | (hi << 8);
+                address = base + (decoded.mode == CycleMode::ABX ? X : Y);
+                if (bStore || bModify || ((address ^ base) & 0xFF00)) {
+                    co_await read((base & 0xFF00) | (address & 0x00FF));
+                }
+                break;
+            case CycleMode::IZX:
+                value = co_await read(PC);
+                PC++;
+                co_await read(value);
+                value += X;
+                lo = co_await read(value);
+                hi = co_await read((Byte)(value + 1));
+                address = lo | (hi << 8);
+                break;
+            case CycleMode::IZY:
+                value = co_await read(PC);
+                PC++;
+                lo = co_await read(value);
+                hi = co_await read((Byte)(value + 1));
+                base = lo | (hi << 8);
+                address = base + Y;
+                if (bStore || bModify || ((address ^ base) & 0xFF00)) {
+                    co_await read((base & 0xFF00) | (address & 0x00FF));
+                }
+                break;
+            default:
+                address = PC;
+                break;
+        }
+
+        if (bStore) {
+            value = decoded.op == CycleOp::STA ? A : (decoded.op == CycleOp::STX ? X : Y);
+            co_await write(address, value);
+            continue;
+        }
+
+        value = co_await read(address);
+
+        if (bModify) {
+            // The unmodified value is written back first
+            co_await write(address, value);
+            Byte result;
+            switch (decoded.op) {
+                case CycleOp::ASL:
+                    result = value << 1;
+                    P = (P & ~C) | (value >> 7);
+                    break;
+                case CycleOp::LSR:
+                    result = value >> 1;
+                    P = (P & ~C) | (value & C);
+                    break;
+                case CycleOp::ROL:
+                    result = (value << 1) | (P & C);
+                    P = (P & ~C) | (value >> 7);
+                    break;
+                case CycleOp::ROR:
+                    result = (value >> 1) | ((P & C) << 7);
+                    P = (P & ~C) | (value & C);
+                    break;
+                case CycleOp::INC:
+                    result = value + 1;
+                    break;
+                default:
+                    result = value - 1;
+                    break;
+            }
+            setZN(result);
+            co_await write(address, result);
+            continue;
+        }
+
+        switch (decoded.op) {
+            case CycleOp::ADC: add(value); break;
+            case CycleOp::SBC: add(value ^ 0xFF); break;
+            case CycleOp::AND: A &= value; setZN(A); break;
+            case CycleOp::EOR: A ^= value; setZN(A); break;
+            case CycleOp::ORA: A |= value; setZN(A); break;
+            case CycleOp::LDA: A = value; setZN(A); break;
+            case CycleOp::LDX: X = value; setZN(X); break;
+            case CycleOp::LDY: Y = value; setZN(Y); break;
+            case CycleOp::CMP: compare(A, value); break;
+            case CycleOp::CPX: compare(X, value); break;
+            case CycleOp::CPY: compare(Y, value); break;
+            case CycleOp::BIT:
+                P = (P & ~(Z | V | N)) | (value & (V | N)) | ((A & value) == 0x00 ? Z : 0);
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#include "../include/Debugger.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+
+Debugger::Debugger(Bus& b) : bus(b) {
+    bus.debugger = this;
+    bus.ppu.debugger = this;
+}
+
+Debugger::~Debugger() {
+    if (bus.debugger == this) {
+        bus.debugger = nullptr;
+    }
+    if (bus.ppu.debugger == this) {
+        bus.ppu.debugger = nullptr;
+    }
+}
+
+uint32_t Debugger::add(const Breakpoint& breakpoint) {
+    vBreakpoints.push_back(breakpoint);
+    vBreakpoints.back().nId = nNextId;
+    refresh();
+    return nNextId++;
+}
+
+bool Debugger::remove(uint32_t nId) {
+    auto found = std::find_if(vBreakpoints.begin(), vBreakpoints.end(),
+        [nId](const Breakpoint& breakpoint) { return breakpoint.nId == nId; });
+    if (found == vBreakpoints.end()) {
+        return false;
+    }
+    vBreakpoints.erase(found);
+    refresh();
+    return true;
+}
+
+void Debugger::clear() {
+    vBreakpoints.clear();
+    refresh();
+}
+
+Debugger::Breakpoint* Debugger::find(uint32_t nId) {
+    for (Breakpoint &breakpoint : vBreakpoints) {
+        if (breakpoint.nId == nId) {
+            return &breakpoint;
+        }
+    }
+    return nullptr;
+}
+
+void Debugger::refresh() {
+    cpuPages.fill(0);
+    ppuPages.fill(0);
+
+    for (const Breakpoint &breakpoint : vBreakpoints) {
+        if (!breakpoint.bEnabled) {
+            continue;
+        }
+
+        if (breakpoint.space == BreakSpace::CPU) {
+            for (uint32_t page = breakpoint.first >> 8; page <= (uint32_t)(breakpoint.last >> 8); page++) {
+                cpuPages[page] |= breakpoint.types;
+            }
+        } else {
+            // The PPU space mirrors every 16 KB
+            Address first = breakpoint.first & 0x3FFF;
+            Address last = std::min<Address>(breakpoint.last, 0x3FFF);
+            for (uint32_t page = first >> 8; page <= (uint32_t)(last >> 8); page++) {
+                ppuPages[page] |= breakpoint.types;
+            }
+        }
+    }
+}
+
+bool Debugger::holds(const BreakCondition& condition, const CPU::State& cpu, Byte value) const {
+    uint16_t operand = 0;
+    switch (condition.operand) {
+        case BreakOperand::A: operand = cpu.Accumulator; break;
+        case BreakOperand::X: operand = cpu.X; break;
+        case BreakOperand::Y: operand = cpu.Y; break;
+        case BreakOperand::SP: operand = cpu.StackPointer; break;
+        case BreakOperand::P: operand = cpu.StatusRegister; break;
+        case BreakOperand::PC: operand = cpu.ProgramCounter; break;
+        case BreakOperand::VALUE: operand = value; break;
+    }
+
+    switch (condition.compare) {
+        case BreakCompare::EQUAL: return operand == condition.value;
+        case BreakCompare::NOT_EQUAL: return operand != condition.value;
+        case BreakCompare::LESS: return operand < condition.value;
+        case BreakCompare::GREATER_EQUAL: return operand >= condition.value;
+        case BreakCompare::ANY_BITS: return (operand & condition.value) != 0;
+    }
+    return false;
+}
+
+void Debugger::check(BreakSpace::Space space, BreakType::Type type, Address address, Byte value) {
+    CPU::State cpu;
+    bus.cpu.SaveState(cpu);
+
+    for (Breakpoint &breakpoint : vBreakpoints) {
+        if (!breakpoint.bEnabled || breakpoint.space != space || !(breakpoint.types & type)
+            || address < breakpoint.first || address > breakpoint.last) {
+            continue;
+        }
+
+        bool bHolds = true;
+        for (const BreakCondition &condition : breakpoint.conditions) {
+            bHolds = bHolds && holds(condition, cpu, value);
+        }
+        if (!bHolds) {
+            continue;
+        }
+
+        breakpoint.nHits++;
+        if (breakpoint.bStop && breakpoint.nHits >= breakpoint.nStopOnHit && !bStopped) {
+            // The first stop of an instruction is the one reported
+            bStopped = true;
+            hit = { breakpoint.nId, space, type, address, value, cpu };
+        }
+    }
+}
+
+void Debugger::cpuAccess(BreakType::Type type, Address address, Byte value) {
+    check(BreakSpace::CPU, type, address, value);
+}
+
+void Debugger::ppuAccess(BreakType::Type type, Address address, Byte value) {
+    check(BreakSpace::PPU, type, address & 0x3FFF, value);
+}
+
+bool Debugger::aboutToExecute() const {
+    // The next Bus::clock() gives the CPU a cycle it will spend on a new opcode
+    return bus.nSystemClockCounter % 3 == 0 && bus.nDMACycles == 0 && bus.cpuComplete();
+}
+
+void Debugger::checkExecute() {
+    CPU::State cpu;
+    bus.cpu.SaveState(cpu);
+    Address pc = cpu.ProgramCounter;
+
+    if (nResumeAddress == pc) {
+        nResumeAddress = -1;
+        return;
+    }
+    nResumeAddress = -1;
+
+    if (cpuPages[pc >> 8] & BreakType::EXECUTE) {
+        check(BreakSpace::CPU, BreakType::EXECUTE, pc, bus.cpuRead(pc, true));
+        if (bStopped) {
+            nResumeAddress = pc;
+        }
+    }
+}
+
+bool Debugger::runFrame() {
+    bStopped = false;
+
+    while (!bus.ppu.frameComplete) {
+        if (aboutToExecute()) {
+            checkExecute();
+            if (bStopped) {
+                return true;
+            }
+        }
+
+        bus.clock();
+        if (bStopped) {
+            return true;
+        }
+    }
+
+    bus.ppu.frameComplete = false;
+    return false;
+}
+
+bool Debugger::stepInstruction() {
+    bStopped = false;
+
+    while (!aboutToExecute()) {
+        bus.clock();
+    }
+
+    // Stepping is explicit, so an execute breakpoint here does not hold it back
+    nResumeAddress = -1;
+    bus.clock();
+    return bStopped;
+}
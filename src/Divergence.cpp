@@ -0,0 +1,141 @@
+#include "../include/Divergence.hpp"
+#include "../include/Bus.hpp"
+#include "../include/Cheats.hpp"
+#include "../include/Debugger.hpp"
+
+#include <cstdio>
+#include <string>
+
+void Divergence::setInput(Bus& bus, const std::vector<Byte>& movie, uint64_t nFrame) {
+    bus.controller[0] = movie[nFrame * 2];
+    bus.controller[1] = movie[nFrame * 2 + 1];
+}
+
+bool Divergence::stepInstruction(Bus& bus, Debugger& debugger) {
+    debugger.stepInstruction();
+    if (bus.ppu.frameComplete) {
+        bus.ppu.frameComplete = false;
+        return false;
+    }
+    return true;
+}
+
+Divergence::Report Divergence::compare(Bus& a, Bus& b, const std::vector<Byte>& movie, uint32_t nMask) {
+    Report report;
+    StateHash hashA, hashB;
+    Bus::State startA, startB;
+
+    uint64_t nFrames = movie.size() / 2;
+    for (uint64_t frame = 0; frame < nFrames; frame++) {
+        a.saveState(startA);
+        b.saveState(startB);
+        setInput(a, movie, frame);
+        setInput(b, movie, frame);
+        a.clockFrame();
+        b.clockFrame();
+
+        StateHash::Parts partsA = hashA.parts(a);
+        StateHash::Parts partsB = hashB.parts(b);
+        for (uint32_t part = 0; part < StatePart::COUNT; part++) {
+            if ((nMask & (1u << part)) && partsA[part] != partsB[part]) {
+                report.nParts |= 1u << part;
+            }
+        }
+        if (report.nParts == 0) {
+            continue;
+        }
+
+        report.bDiverged = true;
+        report.nFrame = frame;
+
+        // Again from the start of the frame, one instruction at a time. This
+        // runs the same clocks as clockFrame(), freezes included.
+        a.loadState(startA);
+        b.loadState(startB);
+        if (a.cheats != nullptr) {
+            a.cheats->freeze();
+        }
+        if (b.cheats != nullptr) {
+            b.cheats->freeze();
+        }
+
+        Debugger debuggerA(a), debuggerB(b);
+        CPU::State beforeA, beforeB;
+        for (int64_t instruction = 0; ; instruction++) {
+            a.cpu.SaveState(beforeA);
+            b.cpu.SaveState(beforeB);
+            bool bMoreA = stepInstruction(a, debuggerA);
+            bool bMoreB = stepInstruction(b, debuggerB);
+
+            if (hashA.cpu(a) != hashB.cpu(b)) {
+                report.nInstruction = instruction;
+                report.a = beforeA;
+                report.b = beforeB;
+                break;
+            }
+            if (!bMoreA || !bMoreB) {
+                break;
+            }
+        }
+        return report;
+    }
+
+    return report;
+}
+
+void Divergence::writeFrameLog(Bus& bus, const std::vector<Byte>& movie, std::ostream& out) {
+    StateHash hash;
+    char line[160];
+
+    uint64_t nFrames = movie.size() / 2;
+    for (uint64_t frame = 0; frame < nFrames; frame++) {
+        setInput(bus, movie, frame);
+        bus.clockFrame();
+
+        StateHash::Parts parts = hash.parts(bus);
+        int n = std::snprintf(line, sizeof(line), "%llu", (unsigned long long)frame);
+        for (uint64_t part : parts) {
+            n += std::snprintf(line + n, sizeof(line) - n, " %016llx", (unsigned long long)part);
+        }
+        out << line << '\n';
+    }
+}
+
+void Divergence::writeInstructionLog(Bus& bus, const std::vector<Byte>& movie, uint64_t nFrame, std::ostream& out) {
+    if (nFrame >= movie.size() / 2) {
+        return;
+    }
+
+    for (uint64_t frame = 0; frame < nFrame; frame++) {
+        setInput(bus, movie, frame);
+        bus.clockFrame();
+    }
+
+    setInput(bus, movie, nFrame);
+    if (bus.cheats != nullptr) {
+        bus.cheats->freeze();
+    }
+
+    StateHash hash;
+    Debugger debugger(bus);
+    CPU::State before;
+    char line[64];
+    bool bMore = true;
+    for (uint64_t instruction = 0; bMore; instruction++) {
+        bus.cpu.SaveState(before);
+        bMore = stepInstruction(bus, debugger);
+        std::snprintf(line, sizeof(line), "%llu $%04X %016llx", (unsigned long long)instruction,
+            before.ProgramCounter, (unsigned long long)hash.cpu(bus));
+        out << line << '\n';
+    }
+}
+
+int64_t Divergence::firstDifference(std::istream& a, std::istream& b) {
+    std::string lineA, lineB;
+    for (int64_t line = 0; std::getline(a, lineA) && std::getline(b, lineB); line++) {
+        if (lineA != lineB) {
+            return line;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,84 @@
+#include "../include/Footprint.hpp"
+#include "../include/Bus.hpp"
+
+#include <cstdio>
+
+// Adds a paged buffer to a component: written pages are owned, the rest shared
+static void addPaged(Footprint::Component& component, const PagedMemory& memory) {
+    size_t nPrivate = memory.privatePages();
+    component.nOwned += nPrivate * PagedMemory::PAGE_SIZE;
+    component.nShared += memory.size() - nPrivate * PagedMemory::PAGE_SIZE;
+}
+
+// A ROM image is only owned while no other cartridge points at it
+template <typename T>
+static void addImage(Footprint::Component& component, const std::shared_ptr<T>& pImage) {
+    if (pImage == nullptr) {
+        return;
+    }
+    size_t nBytes = pImage->size() * sizeof(typename T::value_type);
+    (pImage.use_count() == 1 ? component.nOwned : component.nShared) += nBytes;
+}
+
+std::vector<Footprint::Component> Footprint::measure(const Bus& bus) {
+    std::vector<Component> vComponents;
+
+    // The Bus object holds the CPU, the PPU and CPU RAM by value
+    vComponents.push_back({ "Bus", sizeof(Bus) - sizeof(CPU) - sizeof(PPU) - sizeof(bus.cpuRam), 0 });
+    vComponents.push_back({ "CPU", sizeof(CPU), 0 });
+    vComponents.push_back({ "CPU RAM", sizeof(bus.cpuRam), 0 });
+    vComponents.push_back({ "PPU", sizeof(PPU), 0 });
+
+    Component nametables{ "Nametables" };
+    addPaged(nametables, bus.ppu.nametables());
+    vComponents.push_back(nametables);
+    size_t nFrame = bus.ppu.hasFrame() ? (size_t)SCREEN_WIDTH * SCREEN_HEIGHT : 0;
+    vComponents.push_back({ "Frame buffer", nFrame, 0 });
+
+    const Cartridge *cart = bus.cart.get();
+    if (cart == nullptr) {
+        return vComponents;
+    }
+    vComponents.push_back({ "Cartridge", sizeof(Cartridge), 0 });
+    const Mapper *mapper = cart->pMapper.get();
+    if (mapper != nullptr) {
+        vComponents.push_back({ "Mapper", mapper->objectSize(), 0 });
+        Component prgRam{ "PRG-RAM" };
+        addPaged(prgRam, mapper->prgRam());
+        vComponents.push_back(prgRam);
+    }
+    Component chrRam{ "CHR-RAM" };
+    addPaged(chrRam, cart->vCHRRam);
+    vComponents.push_back(chrRam);
+
+    Component rom{ "ROM" };
+    addImage(rom, cart->pPRGMemory);
+    addImage(rom, cart->pCHRMemory);
+    vComponents.push_back(rom);
+    return vComponents;
+}
+
+size_t Footprint::owned(const std::vector<Component>& vComponents) {
+    size_t nOwned = 0;
+    for (const Component &component : vComponents) {
+        nOwned += component.nOwned;
+    }
+    return nOwned;
+}
+
+void Footprint::write(const std::vector<Component>& vComponents, std::ostream& out) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-14s  %10s  %10s\n", "Component", "Owned", "Shared");
+    out << line;
+
+    size_t nShared = 0;
+    for (const Component &component : vComponents) {
+        nShared += component.nShared;
+        std::snprintf(line, sizeof(line), "%-14s  %10zu  %10zu\n",
+            component.sName.c_str(), component.nOwned, component.nShared);
+        out << line;
+    }
+
+    std::snprintf(line, sizeof(line), "%-14s  %10zu  %10zu\n", "Total", owned(vComponents), nShared);
+    out << line;
+}
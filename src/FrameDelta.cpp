@@ -0,0 +1,157 @@
+#include "../include/FrameDelta.hpp"
+#include "../include/Bus.hpp"
+#include "../include/Movie.hpp"
+#include "../include/StateHash.hpp"
+
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+static uint64_t hashLine(const Byte* row) {
+    StateHasher hasher;
+    hasher.update(row, SCREEN_WIDTH);
+    return hasher.digest();
+}
+
+bool FrameDelta::update(const PPU& ppu) {
+    uint32_t nFrame = ppu.framesDrawn();
+    if (!ppu.hasFrame() || (!bKey && nFrame == nLastFrame)) {
+        return false;
+    }
+
+    // Lines the PPU left alone are only known to match when no frame was missed
+    bool bConsecutive = !bKey && nFrame == nLastFrame + 1;
+    const Byte *frame = ppu.frame();
+    const PPU::LineMask &dirty = ppu.dirtyLines();
+    changedLines.fill(0);
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y++) {
+        if (bConsecutive && !((dirty[y / 64] >> (y % 64)) & 1)) {
+            continue;
+        }
+        uint64_t nHash = hashLine(frame + y * SCREEN_WIDTH);
+        if (bKey || nHash != vLineHashes[y]) {
+            changedLines[y / 64] |= 1ull << (y % 64);
+        }
+        vLineHashes[y] = nHash;
+    }
+
+    nLastFrame = nFrame;
+    bKey = false;
+    return true;
+}
+
+void FrameDelta::reset() {
+    bKey = true;
+}
+
+uint32_t FrameDelta::changedCount() const {
+    uint32_t nCount = 0;
+    for (uint64_t word : changedLines) {
+        nCount += std::bitset<64>(word).count();
+    }
+    return nCount;
+}
+
+void FrameDelta::encode(const PPU& ppu, std::vector<Byte>& vOut) const {
+    const Byte *frame = ppu.frame();
+    for (size_t i = 0; i < MASK_BYTES; i++) {
+        vOut.push_back((Byte)(changedLines[i / 8] >> (i % 8 * 8)));
+    }
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y++) {
+        if (changed(y)) {
+            vOut.insert(vOut.end(), frame + y * SCREEN_WIDTH, frame + (y + 1) * SCREEN_WIDTH);
+        }
+    }
+}
+
+bool FrameDelta::apply(const Byte* pDelta, size_t nSize, Byte* frame) {
+    if (nSize < MASK_BYTES) {
+        return false;
+    }
+    size_t nLines = 0;
+    for (size_t i = 0; i < MASK_BYTES; i++) {
+        nLines += std::bitset<8>(pDelta[i]).count();
+    }
+    if (nSize != MASK_BYTES + nLines * SCREEN_WIDTH) {
+        return false;
+    }
+
+    const Byte *line = pDelta + MASK_BYTES;
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y++) {
+        if ((pDelta[y / 8] >> (y % 8)) & 1) {
+            std::memcpy(frame + y * SCREEN_WIDTH, line, SCREEN_WIDTH);
+            line += SCREEN_WIDTH;
+        }
+    }
+    return true;
+}
+
+std::vector<FrameDelta::Savings> FrameDelta::measure(const std::vector<Benchmark::Title>& vTitles) {
+    std::vector<Savings> vSavings;
+    for (const Benchmark::Title &title : vTitles) {
+        vSavings.push_back(measure(title));
+    }
+    return vSavings;
+}
+
+FrameDelta::Savings FrameDelta::measure(const Benchmark::Title& title) {
+    Savings savings;
+    savings.sName = title.sName;
+
+    Movie movie;
+    std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(title.sROM);
+    if (!movie.load(title.sMovie) || !cart->ImageValid()) {
+        return savings;
+    }
+    std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+    bus->insertCartridge(cart);
+    bus->reset();
+
+    FrameDelta delta;
+    std::vector<Byte> vDelta;
+    for (size_t frame = 0; frame < movie.vFrames.size(); frame++) {
+        movie.apply(*bus, frame);
+        bus->clockFrame();
+        if (!delta.update(bus->ppu)) {
+            continue;
+        }
+        vDelta.clear();
+        delta.encode(bus->ppu, vDelta);
+        savings.nFrames++;
+        savings.nChangedLines += delta.changedCount();
+        savings.nFullBytes += (uint64_t)SCREEN_WIDTH * SCREEN_HEIGHT;
+        savings.nDeltaBytes += vDelta.size();
+    }
+    savings.bValid = true;
+    return savings;
+}
+
+void FrameDelta::writeSavings(const std::vector<Savings>& vSavings, std::ostream& out) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-16s %8s %12s %14s %14s %8s\n",
+        "title", "frames", "lines/frame", "full bytes", "delta bytes", "saved");
+    out << line;
+
+    uint64_t nFull = 0, nDelta = 0;
+    for (const Savings &s : vSavings) {
+        if (!s.bValid) {
+            std::snprintf(line, sizeof(line), "%-16s %8s\n", s.sName.c_str(), "invalid");
+            out << line;
+            continue;
+        }
+        double dLines = s.nFrames > 0 ? (double)s.nChangedLines / s.nFrames : 0.0;
+        double dSaved = s.nFullBytes > 0 ? 100.0 * (1.0 - (double)s.nDeltaBytes / s.nFullBytes) : 0.0;
+        std::snprintf(line, sizeof(line), "%-16s %8llu %12.1f %14llu %14llu %7.1f%%\n", s.sName.c_str(),
+            (unsigned long long)s.nFrames, dLines, (unsigned long long)s.nFullBytes,
+            (unsigned long long)s.nDeltaBytes, dSaved);
+        out << line;
+        nFull += s.nFullBytes;
+        nDelta += s.nDeltaBytes;
+    }
+
+    double dSaved = nFull > 0 ? 100.0 * (1.0 - (double)nDelta / nFull) : 0.0;
+    std::snprintf(line, sizeof(line), "%-16s %8s %12s %14llu %14llu %7.1f%%\n", "total", "", "",
+        (unsigned long long)nFull, (unsigned long long)nDelta, dSaved);
+    out << line;
+}
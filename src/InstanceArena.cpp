@@ -0,0 +1,222 @@
+#include "../include/InstanceArena.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static constexpr size_t roundUp(size_t nSize, size_t nUnit) {
+    return (nSize + nUnit - 1) / nUnit * nUnit;
+}
+
+// The slot whose Scope is innermost on this thread
+static thread_local std::pmr::memory_resource *pCurrent = nullptr;
+
+// Header of one slot, followed by the Bus and then the pool. Blocks are whole
+// cache lines. Freed ones are kept by size and handed out again first: a
+// machine keeps freeing and allocating the same few sizes (1 KB pages as
+// copy-on-write unshares them, mapper objects as states load).
+class InstanceArena::Slot : public std::pmr::memory_resource
+{
+public:
+    Slot(Byte* pBegin, Byte* pEnd) : begin(pBegin), next(pBegin), end(pEnd) {}
+
+    Bus *bus = nullptr;
+    size_t nSpilled = 0;
+
+private:
+    struct FreeList {
+        size_t nSize = 0;
+        void *head = nullptr;
+    };
+
+    FreeList* freeList(size_t nSize, bool bAdd) {
+        for (FreeList &list : vFree) {
+            if (list.nSize == nSize) {
+                return &list;
+            }
+            if (list.nSize == 0 && bAdd) {
+                list.nSize = nSize;
+                return &list;
+            }
+        }
+        return nullptr;
+    }
+
+    void* do_allocate(size_t nBytes, size_t nAlign) override {
+        size_t nSize = roundUp(std::max<size_t>(nBytes, 1), CACHE_LINE);
+        if (nAlign <= CACHE_LINE) {
+            FreeList *list = freeList(nSize, false);
+            if (list != nullptr && list->head != nullptr) {
+                void *p = list->head;
+                list->head = *(void**)p;
+                return p;
+            }
+            if (nSize <= (size_t)(end - next)) {
+                void *p = next;
+                next += nSize;
+                return p;
+            }
+        }
+        nSpilled += nBytes;
+        return std::pmr::new_delete_resource()->allocate(nBytes, nAlign);
+    }
+
+    void do_deallocate(void* p, size_t nBytes, size_t nAlign) override {
+        if ((Byte*)p >= begin && (Byte*)p < end) {
+            // With every list taken by other sizes the block is lost until
+            // the arena goes
+            FreeList *list = freeList(roundUp(std::max<size_t>(nBytes, 1), CACHE_LINE), true);
+            if (list != nullptr) {
+                *(void**)p = list->head;
+                list->head = p;
+            }
+            return;
+        }
+        nSpilled -= nBytes;
+        std::pmr::new_delete_resource()->deallocate(p, nBytes, nAlign);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    Byte *begin, *next, *end;
+    std::array<FreeList, 8> vFree;
+};
+
+static_assert(alignof(Bus) <= InstanceArena::CACHE_LINE, "a Bus must start on a cache line");
+
+// Where the Bus and the pool start in a slot
+static constexpr size_t BUS_SIZE = roundUp(sizeof(Bus), InstanceArena::CACHE_LINE);
+
+InstanceArena::~InstanceArena() {
+    release();
+}
+
+bool InstanceArena::reserve(uint32_t nCount, size_t nSize) {
+    if (pBase != nullptr || nCount == 0) {
+        return false;
+    }
+    size_t nHeader = roundUp(sizeof(Slot), CACHE_LINE);
+    size_t nSlot = roundUp(std::max(nSize, nHeader + BUS_SIZE + CACHE_LINE), CACHE_LINE);
+    size_t nBytes = roundUp(nSlot * nCount, HUGE_PAGE_SIZE);
+
+#ifdef __linux__
+    // Reserved huge pages first; without enough of them the mapping fails
+    void *p = mmap(nullptr, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        pBase = (Byte*)p;
+        nBacking = ArenaBacking::HUGETLB;
+    } else {
+        // One huge page more than needed, trimmed so the arena starts on one
+        size_t nOver = nBytes + HUGE_PAGE_SIZE;
+        p = mmap(nullptr, nOver, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        Byte *aligned = (Byte*)roundUp((uintptr_t)p, HUGE_PAGE_SIZE);
+        size_t nHead = aligned - (Byte*)p;
+        if (nHead > 0) {
+            munmap(p, nHead);
+        }
+        munmap(aligned + nBytes, nOver - nHead - nBytes);
+        pBase = aligned;
+        nBacking = madvise(pBase, nBytes, MADV_HUGEPAGE) == 0 ? ArenaBacking::TRANSPARENT : ArenaBacking::PAGES;
+    }
+#else
+    pBase = (Byte*)std::aligned_alloc(HUGE_PAGE_SIZE, nBytes);
+    if (pBase == nullptr) {
+        return false;
+    }
+    nBacking = ArenaBacking::HEAP;
+#endif
+
+    nMapped = nBytes;
+    nSlots = nCount;
+    nSlotSize = nSlot;
+    vSlots.assign(nSlots, nullptr);
+    return true;
+}
+
+Bus* InstanceArena::create(uint32_t index) {
+    if (index >= nSlots || (vSlots[index] != nullptr && vSlots[index]->bus != nullptr)) {
+        return nullptr;
+    }
+
+    Byte *p = pBase + (size_t)index * nSlotSize;
+    size_t nHeader = roundUp(sizeof(Slot), CACHE_LINE);
+    if (vSlots[index] == nullptr) {
+        // The first touch decides the NUMA node, so it is this thread's
+        std::memset(p, 0, nSlotSize);
+        vSlots[index] = new (p) Slot(p + nHeader + BUS_SIZE, p + nSlotSize);
+    }
+
+    Scope scope(*this, index);
+    vSlots[index]->bus = new (p + nHeader) Bus();
+    return vSlots[index]->bus;
+}
+
+void InstanceArena::destroy(uint32_t index) {
+    if (index >= nSlots || vSlots[index] == nullptr || vSlots[index]->bus == nullptr) {
+        return;
+    }
+    // Blocks go back to the pools they came from whatever is in scope
+    vSlots[index]->bus->~Bus();
+    vSlots[index]->bus = nullptr;
+}
+
+Bus* InstanceArena::machine(uint32_t index) const {
+    return index < nSlots && vSlots[index] != nullptr ? vSlots[index]->bus : nullptr;
+}
+
+size_t InstanceArena::spilled(uint32_t index) const {
+    return index < nSlots && vSlots[index] != nullptr ? vSlots[index]->nSpilled : 0;
+}
+
+void InstanceArena::release() {
+    if (pBase == nullptr) {
+        return;
+    }
+    // Machines first: one may still hold blocks of another slot's pool
+    for (uint32_t i = 0; i < nSlots; i++) {
+        destroy(i);
+    }
+    for (Slot *slot : vSlots) {
+        if (slot != nullptr) {
+            slot->~Slot();
+        }
+    }
+    vSlots.clear();
+
+#ifdef __linux__
+    munmap(pBase, nMapped);
+#else
+    std::free(pBase);
+#endif
+    pBase = nullptr;
+    nMapped = 0;
+    nSlots = 0;
+    nSlotSize = 0;
+    nBacking = ArenaBacking::NONE;
+}
+
+InstanceArena::Scope::Scope(InstanceArena& arena, uint32_t slot) : previous(pCurrent) {
+    if (slot < arena.nSlots && arena.vSlots[slot] != nullptr) {
+        pCurrent = arena.vSlots[slot];
+    }
+}
+
+InstanceArena::Scope::~Scope() {
+    pCurrent = previous;
+}
+
+std::pmr::memory_resource* InstanceArena::resource() {
+    return pCurrent != nullptr ? pCurrent : std::pmr::new_delete_resource();
+}
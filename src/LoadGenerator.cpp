@@ -0,0 +1,147 @@
+#include "../include/LoadGenerator.hpp"
+#include "../include/ServerClient.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct ClientRun {
+    std::string sError;
+    Clock::time_point start, end;
+    std::vector<double> vLatencies;
+    uint64_t nSteps = 0;
+};
+
+static void runClient(const LoadGenerator& generator, const std::vector<uint8_t>& vROM, ClientRun& run) {
+    ServerClient client;
+    std::vector<ServerClient::Result> vResults;
+    if (!client.connect(generator.sSocket)) {
+        run.sError = "cannot connect to " + generator.sSocket;
+        return;
+    }
+
+    for (uint32_t i = 0; i < generator.nInstances; i++) {
+        client.create();
+    }
+    if (!client.execute(vResults)) {
+        run.sError = "connection lost";
+        return;
+    }
+    std::vector<uint32_t> vInstances;
+    for (const ServerClient::Result &result : vResults) {
+        if (result.status != ServerStatus::OK) {
+            run.sError = "CREATE failed";
+            return;
+        }
+        vInstances.push_back(result.value<uint32_t>());
+    }
+
+    for (uint32_t instance : vInstances) {
+        client.setVideo(instance, generator.bVideo);
+        client.loadROM(instance, vROM.data(), vROM.size());
+    }
+    if (!client.execute(vResults)) {
+        run.sError = "connection lost";
+        return;
+    }
+    for (const ServerClient::Result &result : vResults) {
+        if (result.status != ServerStatus::OK) {
+            run.sError = "LOAD_ROM failed";
+            return;
+        }
+    }
+
+    run.vLatencies.reserve(generator.nRequests);
+    run.start = Clock::now();
+    for (uint32_t request = 0; request < generator.nRequests; request++) {
+        for (uint32_t instance : vInstances) {
+            client.step(instance, generator.nFramesPerStep, nullptr);
+        }
+        Clock::time_point sent = Clock::now();
+        if (!client.execute(vResults)) {
+            run.sError = "connection lost";
+            return;
+        }
+        run.vLatencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+        run.nSteps += vResults.size();
+    }
+    run.end = Clock::now();
+}
+
+LoadGenerator::Result LoadGenerator::run() const {
+    Result result;
+
+    std::ifstream ifs(sROM, std::ifstream::binary);
+    std::vector<uint8_t> vROM((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (vROM.empty()) {
+        result.sError = "cannot read " + sROM;
+        return result;
+    }
+
+    std::vector<ClientRun> vRuns(std::max(nClients, 1u));
+    std::vector<std::thread> vThreads;
+    for (ClientRun &run : vRuns) {
+        vThreads.emplace_back(runClient, std::cref(*this), std::cref(vROM), std::ref(run));
+    }
+    for (std::thread &thread : vThreads) {
+        thread.join();
+    }
+
+    std::vector<double> vLatencies;
+    Clock::time_point start = vRuns[0].start, end = vRuns[0].end;
+    for (ClientRun &run : vRuns) {
+        if (!run.sError.empty()) {
+            result.sError = run.sError;
+            return result;
+        }
+        start = std::min(start, run.start);
+        end = std::max(end, run.end);
+        vLatencies.insert(vLatencies.end(), run.vLatencies.begin(), run.vLatencies.end());
+        result.nSteps += run.nSteps;
+    }
+
+    result.bValid = true;
+    result.nRequests = vLatencies.size();
+    result.nFrames = result.nSteps * nFramesPerStep;
+    result.dSeconds = std::chrono::duration<double>(end - start).count();
+    if (result.dSeconds > 0.0) {
+        result.dStepsPerSecond = result.nSteps / result.dSeconds;
+        result.dFramesPerSecond = result.nFrames / result.dSeconds;
+    }
+    if (!vLatencies.empty()) {
+        std::sort(vLatencies.begin(), vLatencies.end());
+        auto percentile = [&](double p) { return vLatencies[(size_t)(p * (vLatencies.size() - 1))]; };
+        result.dLatencyP50 = percentile(0.50);
+        result.dLatencyP90 = percentile(0.90);
+        result.dLatencyP99 = percentile(0.99);
+        result.dLatencyMax = vLatencies.back();
+    }
+    return result;
+}
+
+void LoadGenerator::writeReport(const Result& result, std::ostream& out) {
+    if (!result.bValid) {
+        out << "load test failed: " << result.sError << "\n";
+        return;
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-10s %llu in %.2f s\n", "requests",
+        (unsigned long long)result.nRequests, result.dSeconds);
+    out << line;
+    std::snprintf(line, sizeof(line), "%-10s %llu (%.0f/s)\n", "steps",
+        (unsigned long long)result.nSteps, result.dStepsPerSecond);
+    out << line;
+    std::snprintf(line, sizeof(line), "%-10s %llu (%.0f/s)\n", "frames",
+        (unsigned long long)result.nFrames, result.dFramesPerSecond);
+    out << line;
+    std::snprintf(line, sizeof(line), "%-10s p50 %.0f  p90 %.0f  p99 %.0f  max %.0f us\n", "latency",
+        result.dLatencyP50, result.dLatencyP90, result.dLatencyP99, result.dLatencyMax);
+    out << line;
+}
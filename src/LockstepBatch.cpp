@@ -0,0 +1,725 @@
+#include "../include/LockstepBatch.hpp"
+#include "../include/Typedefs.hpp"
+#include "../include/Bus.hpp"
+#include "../include/LaneVector.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// Lane arrays are padded to this many lanes so every kernel runs whole vectors
+constexpr size_t LANE_PADDING = 64;
+
+inline LaneVector vFlagsNZ(LaneVector r) {
+    return vOr(vAnd(r, vSet(StatusRegisterFlags::N)), vAnd(vEq(r, vSet(0x00)), vSet(StatusRegisterFlags::Z)));
+}
+
+// Runs op on every group lane: result to dst (if any), N/Z from the result plus
+// whatever extra flags op raises, restricted to the flags in 'affected'. op
+// gets the lane's register from src and its operand from operand.
+template <typename Operation>
+void applyToGroup(Byte* dst, const Byte* src, const Byte* operand, Byte* status, const Byte* group, size_t nLanes,
+    Byte affected, Operation op)
+{
+    for (size_t i = 0; i < nLanes; i += LANE_VECTOR_WIDTH) {
+        LaneVector mask = vLoad(group + i);
+        LaneVector in = vLoad(src + i);
+        LaneVector m = vLoad(operand + i);
+        LaneVector p = vLoad(status + i);
+        LaneVector flags = vSet(0x00);
+
+        LaneVector r = op(in, m, p, flags);
+        flags = vOr(flags, vFlagsNZ(r));
+
+        if (dst != nullptr) {
+            vStore(dst + i, vSelect(mask, r, vLoad(dst + i)));
+        }
+        LaneVector updated = vOr(vAnd(p, vSet((Byte)~affected)), vOr(vAnd(flags, vSet(affected)), vSet(StatusRegisterFlags::U)));
+        vStore(status + i, vSelect(mask, updated, p));
+    }
+}
+
+// Opcodes runKernel() has a kernel for; anything else runs on the lanes' CPUs
+// without building a group first
+constexpr std::array<bool, NUMBER_OF_OPCODES> KERNEL_OPCODES = [] {
+    std::array<bool, NUMBER_OF_OPCODES> table{};
+    for (Opcode opcode : {
+        0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9,         // LDA
+        0xA2, 0xA6, 0xB6, 0xAE, 0xBE,               // LDX
+        0xA0, 0xA4, 0xB4, 0xAC, 0xBC,               // LDY
+        0x85, 0x95, 0x8D, 0x9D, 0x99,               // STA
+        0x86, 0x96, 0x8E, 0x84, 0x94, 0x8C,         // STX, STY
+        0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39,         // AND
+        0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19,         // ORA
+        0x49, 0x45, 0x55, 0x4D, 0x5D, 0x59,         // EOR
+        0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79,         // ADC
+        0xE9, 0xE5, 0xF5, 0xED, 0xFD, 0xF9,         // SBC
+        0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9,         // CMP
+        0xE0, 0xE4, 0xEC, 0xC0, 0xC4, 0xCC,         // CPX, CPY
+        0xE6, 0xF6, 0xEE, 0xFE, 0xC6, 0xD6, 0xCE, 0xDE, // INC, DEC
+        0xAA, 0xA8, 0x8A, 0x98, 0xBA, 0x9A,         // Transfers
+        0xE8, 0xC8, 0xCA, 0x88,                     // INX, INY, DEX, DEY
+        0x0A, 0x4A, 0x2A, 0x6A,                     // Accumulator shifts
+        0x18, 0x38, 0x58, 0x78, 0xD8, 0xF8, 0xB8, 0xEA, // Flag operations, NOP
+        0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0, // Branches
+        0x4C, 0x20, 0x60, 0x48, 0x68 }) {            // JMP, JSR, RTS, PHA, PLA
+        table[opcode] = true;
+    }
+    return table;
+}();
+
+// Carry-in from P, sum, carry-out and signed overflow, as CPU::ADC computes them
+inline LaneVector vAddWithCarry(LaneVector a, LaneVector m, LaneVector p, LaneVector& flags) {
+    LaneVector sum = vAdd(a, m);
+    LaneVector result = vAdd(sum, vAnd(p, vSet(StatusRegisterFlags::C)));
+    LaneVector carry = vOr(vNot(vGeU(sum, a)), vNot(vGeU(result, sum)));
+    LaneVector overflow = vAnd(vAnd(vNot(vXor(a, m)), vXor(a, result)), vSet(0x80));
+    flags = vOr(flags, vOr(vAnd(carry, vSet(StatusRegisterFlags::C)), vShr1(overflow)));
+    return result;
+}
+
+}
+
+LockstepBatch::LockstepBatch(const std::string& sFileName, size_t nLanesRequested)
+    : nLanes(nLanesRequested)
+{
+    nPaddedLanes = (nLanes + LANE_PADDING - 1) / LANE_PADDING * LANE_PADDING;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        lanes.emplace_back(std::make_unique<Bus>());
+        lanes.back()->insertCartridge(std::make_shared<Cartridge>(sFileName));
+    }
+
+    A.assign(nPaddedLanes, 0x00);
+    X.assign(nPaddedLanes, 0x00);
+    Y.assign(nPaddedLanes, 0x00);
+    SP.assign(nPaddedLanes, 0x00);
+    P.assign(nPaddedLanes, 0x00);
+    PC.assign(nPaddedLanes, 0x0000);
+    ram.assign((size_t)MEMORY_SIZE * nPaddedLanes, 0x00);
+    operandLanes.assign(nPaddedLanes, 0x00);
+    addressLanes.assign(nPaddedLanes, 0x0000);
+    active.assign(nPaddedLanes, 0x00);
+    group.assign(nPaddedLanes, 0x00);
+    laneCycles.assign(nPaddedLanes, 0);
+    laneFrames.assign(nPaddedLanes, 0);
+
+    reset();
+}
+
+LockstepBatch::~LockstepBatch() {
+
+}
+
+size_t LockstepBatch::laneCount() const {
+    return nLanes;
+}
+
+Bus& LockstepBatch::lane(size_t index) {
+    return *lanes[index];
+}
+
+void LockstepBatch::reset() {
+    for (size_t i = 0; i < nLanes; i++) {
+        lanes[i]->reset();
+        copyFromCPU(i);
+        active[i] = 0xFF;
+        laneFrames[i] = 0;
+
+        // The reset sequence takes as long as CPU::Reset says, and starts
+        // like an instruction would
+        clockPPU(i, 1);
+        advanceLane(i, lanes[i]->cpu.CyclesLeft);
+    }
+}
+
+void LockstepBatch::copyToCPU(size_t index) {
+    CPU &cpu = lanes[index]->cpu;
+    cpu.Accumulator = A[index];
+    cpu.X = X[index];
+    cpu.Y = Y[index];
+    cpu.StackPointer = SP[index];
+    cpu.SetStatusRegister(P[index]);
+    cpu.ProgramCounter = PC[index];
+    cpu.CyclesLeft = 0;
+}
+
+void LockstepBatch::copyFromCPU(size_t index) {
+    CPU &cpu = lanes[index]->cpu;
+    A[index] = cpu.Accumulator;
+    X[index] = cpu.X;
+    Y[index] = cpu.Y;
+    SP[index] = cpu.StackPointer;
+    P[index] = cpu.GetStatusRegister();
+    PC[index] = cpu.ProgramCounter;
+}
+
+void LockstepBatch::syncLanes() {
+    for (size_t i = 0; i < nLanes; i++) {
+        copyToCPU(i);
+    }
+}
+
+uint8_t LockstepBatch::instructionLength(AddressingMode mode) {
+    if (mode == &CPU::IMP) {
+        return 1;
+    }
+    if (mode == &CPU::ABS || mode == &CPU::ABX || mode == &CPU::ABY || mode == &CPU::IND) {
+        return 3;
+    }
+    return 2;
+}
+
+void LockstepBatch::attachRam() {
+    for (size_t i = 0; i < nLanes; i++) {
+        Bus &bus = *lanes[i];
+        for (Address addr = 0; addr < MEMORY_SIZE; addr++) {
+            laneRam(i, addr) = bus.cpuRam[addr];
+        }
+        bus.ramMirror = &ram[i];
+        bus.nRamMirrorStride = nPaddedLanes;
+    }
+}
+
+void LockstepBatch::detachRam() {
+    for (size_t i = 0; i < nLanes; i++) {
+        lanes[i]->ramMirror = nullptr;
+    }
+}
+
+void LockstepBatch::writeLaneRam(size_t index, Address addr, Byte data) {
+    laneRam(index, addr) = data;
+    lanes[index]->cpuRam[addr & MEMORY_UNIT.second] = data;
+}
+
+void LockstepBatch::stepScalar(size_t index) {
+    CPU &cpu = lanes[index]->cpu;
+    copyToCPU(index);
+    cpu.Clock();
+    laneCycles[index] = cpu.CyclesLeft + 1;
+    copyFromCPU(index);
+    nScalarInstructions++;
+}
+
+void LockstepBatch::clockPPU(size_t index, uint32_t nDots) {
+    Bus &bus = *lanes[index];
+    for (uint32_t dot = 0; dot < nDots; dot++) {
+        bus.ppu.clock();
+    }
+    bus.nSystemClockCounter += nDots;
+}
+
+void LockstepBatch::advanceLane(size_t index, uint8_t nCycles) {
+    Bus &bus = *lanes[index];
+
+    // Bus::clock runs an instruction on the first dot of its first cycle,
+    // which step() has clocked, and polls interrupts on the first dot of its
+    // last one. An OAM DMA started by the instruction halts the CPU in between.
+    uint16_t nStall = bus.nDMACycles;
+    bus.nDMACycles = 0;
+    clockPPU(index, (nCycles + nStall - 1) * 3);
+
+    // Same interrupt rules as Bus::clock. The interrupt sequence is polled
+    // again on its own last cycle.
+    while (true) {
+        uint8_t nInterruptCycles = 0;
+        if (bus.ppu.nmi) {
+            bus.ppu.nmi = false;
+            copyToCPU(index);
+            bus.cpu.NMI();
+            nInterruptCycles = bus.cpu.CyclesLeft;
+            copyFromCPU(index);
+        } else if (bus.cart->pMapper->irqState() && !(P[index] & StatusRegisterFlags::I)) {
+            copyToCPU(index);
+            bus.cpu.IRQ();
+            nInterruptCycles = bus.cpu.CyclesLeft;
+            copyFromCPU(index);
+        }
+        if (nInterruptCycles == 0) {
+            break;
+        }
+        clockPPU(index, nInterruptCycles * 3);
+    }
+
+    // Up to the first dot of the next instruction, which step() clocks
+    clockPPU(index, 2);
+
+    if (bus.ppu.frameComplete) {
+        bus.ppu.frameComplete = false;
+        laneFrames[index]++;
+    }
+}
+
+size_t LockstepBatch::electLeader() const {
+    // Boyer-Moore majority vote: if most lanes share a PC, that lane wins
+    size_t candidate = nLanes;
+    uint32_t nVotes = 0;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (!active[i]) {
+            continue;
+        }
+        if (nVotes == 0) {
+            candidate = i;
+            nVotes = 1;
+        } else if (PC[i] == PC[candidate]) {
+            nVotes++;
+        } else {
+            nVotes--;
+        }
+    }
+
+    return candidate;
+}
+
+size_t LockstepBatch::buildGroup(size_t leader) {
+    // Lanes only share the instruction if the CPU reads the same bytes at PC:
+    // the same PRG bank, patched by the same ROM patches (Game Genie codes)
+    // or by none. Kernels bypass the bus, so lanes with a debugger watching
+    // it stay out.
+    Address leaderPC = PC[leader];
+    const Mapper &leaderMapper = *lanes[leader]->cart->pMapper;
+    uint32_t leaderBank = leaderMapper.prgReadBase(leaderPC);
+    const std::vector<uint32_t> *leaderOverlay = leaderMapper.prgOverlay();
+    size_t nMembers = 0;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        const Mapper &mapper = *lanes[i]->cart->pMapper;
+        bool bMember = active[i] && PC[i] == leaderPC && lanes[i]->debugger == nullptr
+            && mapper.prgReadBase(leaderPC) == leaderBank && mapper.prgOverlay() == leaderOverlay;
+        group[i] = bMember ? 0xFF : 0x00;
+        nMembers += bMember;
+    }
+
+    return nMembers;
+}
+
+size_t LockstepBatch::runBranch(Byte flag, bool bTakenWhenSet, Byte operand) {
+    Address offset = operand;
+    if (offset & 0x80) {
+        offset |= 0xFF00;
+    }
+
+    size_t nRetired = 0;
+    for (size_t i = 0; i < nLanes; i++) {
+        if (!group[i]) {
+            continue;
+        }
+        Address next = PC[i] + 2;
+        uint8_t nCycles = 2;
+        if (((P[i] & flag) != 0) == bTakenWhenSet) {
+            Address target = next + offset;
+            nCycles += ((target & 0xFF00) != (next & 0xFF00)) ? 2 : 1;
+            next = target;
+        }
+        PC[i] = next;
+        P[i] |= StatusRegisterFlags::U;
+        laneCycles[i] = nCycles;
+        nRetired++;
+    }
+
+    return nRetired;
+}
+
+const Byte* LockstepBatch::resolveAddresses(AddressingMode mode, Address operand) {
+    // Zero page and absolute operands are one row of ram for the whole group
+    if (mode == &CPU::ZP0 || mode == &CPU::ABS) {
+        uniformAddress = mode == &CPU::ZP0 ? (operand & 0x00FF) : operand;
+        bUniformAddress = true;
+        return uniformAddress <= 0x1FFF ? &laneRam(0, uniformAddress) : nullptr;
+    }
+
+    // Indexed ones are gathered lane by lane. Lanes whose address is not
+    // CPU RAM leave the group and run on their own CPU.
+    const std::vector<Byte> &index = (mode == &CPU::ZPX || mode == &CPU::ABX) ? X : Y;
+    bool bZeroPage = mode == &CPU::ZPX || mode == &CPU::ZPY;
+    size_t nMembers = 0;
+    bUniformAddress = false;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (!group[i]) {
+            continue;
+        }
+        Address addr = bZeroPage ? ((operand + index[i]) & 0x00FF) : (Address)(operand + index[i]);
+        if (addr > 0x1FFF) {
+            group[i] = 0x00;
+            continue;
+        }
+        addressLanes[i] = addr;
+        operandLanes[i] = laneRam(i, addr);
+        nMembers++;
+    }
+
+    return nMembers > 0 ? operandLanes.data() : nullptr;
+}
+
+void LockstepBatch::storeToGroup(const Byte* values) {
+    if (bUniformAddress) {
+        Byte *row = &laneRam(0, uniformAddress);
+        for (size_t i = 0; i < nPaddedLanes; i += LANE_VECTOR_WIDTH) {
+            vStore(row + i, vSelect(vLoad(&group[i]), vLoad(values + i), vLoad(row + i)));
+        }
+        // The lanes' own RAM stays current for their CPUs and for callers
+        for (size_t i = 0; i < nLanes; i++) {
+            if (group[i]) {
+                lanes[i]->cpuRam[uniformAddress & MEMORY_UNIT.second] = values[i];
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (group[i]) {
+            writeLaneRam(i, addressLanes[i], values[i]);
+        }
+    }
+}
+
+size_t LockstepBatch::runStackKernel(Opcode opcode, Address operand) {
+    // The stack is page 1 of CPU RAM, at each lane's own SP
+    using namespace StatusRegisterFlags;
+    size_t nRetired = 0;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (!group[i]) {
+            continue;
+        }
+        switch (opcode) {
+        case 0x4C: // JMP
+            PC[i] = operand;
+            break;
+        case 0x20: { // JSR pushes the address of its own last byte
+            Address ret = PC[i] + 2;
+            writeLaneRam(i, 0x0100 + SP[i]--, ret >> 8);
+            writeLaneRam(i, 0x0100 + SP[i]--, ret & 0x00FF);
+            PC[i] = operand;
+            break;
+        }
+        case 0x60: { // RTS
+            Address ret = laneRam(i, 0x0100 + ++SP[i]);
+            ret |= laneRam(i, 0x0100 + ++SP[i]) << 8;
+            PC[i] = ret + 1;
+            break;
+        }
+        case 0x48: // PHA
+            writeLaneRam(i, 0x0100 + SP[i]--, A[i]);
+            PC[i]++;
+            break;
+        case 0x68: // PLA
+            A[i] = laneRam(i, 0x0100 + ++SP[i]);
+            P[i] = (P[i] & ~(N | Z)) | (A[i] & N) | (A[i] == 0x00 ? Z : 0x00);
+            PC[i]++;
+            break;
+        }
+        P[i] |= U;
+        laneCycles[i] = CPU::OpcodeTable[opcode].cyclesCount;
+        nRetired++;
+    }
+
+    return nRetired;
+}
+
+size_t LockstepBatch::runKernel(Opcode opcode, Address operand) {
+    using namespace StatusRegisterFlags;
+    const Instruction &instruction = CPU::OpcodeTable[opcode];
+    const AddressingMode mode = instruction.addressingMode;
+    const size_t n = nPaddedLanes;
+    const Byte* g = group.data();
+    const Byte NZ = N | Z;
+
+    switch (opcode) {
+    case 0x4C: case 0x20: case 0x60: case 0x48: case 0x68:
+        return runStackKernel(opcode, operand);
+
+    // Branches resolve per lane, which is where lanes split off the group
+    case 0x10: return runBranch(N, false, operand); // BPL
+    case 0x30: return runBranch(N, true, operand);  // BMI
+    case 0x50: return runBranch(V, false, operand); // BVC
+    case 0x70: return runBranch(V, true, operand);  // BVS
+    case 0x90: return runBranch(C, false, operand); // BCC
+    case 0xB0: return runBranch(C, true, operand);  // BCS
+    case 0xD0: return runBranch(Z, false, operand); // BNE
+    case 0xF0: return runBranch(Z, true, operand);  // BEQ
+    }
+
+    // The operand of every lane: the immediate byte, or what the lane's RAM
+    // holds at its effective address
+    const Byte *M = operandLanes.data();
+    bool bMemory = mode != &CPU::IMP && mode != &CPU::IMM;
+    if (bMemory) {
+        M = resolveAddresses(mode, operand);
+        if (M == nullptr) {
+            return 0;
+        }
+    } else {
+        for (size_t i = 0; i < n; i += LANE_VECTOR_WIDTH) {
+            vStore(&operandLanes[i], vSet(operand & 0x00FF));
+        }
+    }
+
+    auto load = [](LaneVector, LaneVector m, LaneVector, LaneVector&) { return m; };
+    auto copy = [](LaneVector in, LaneVector, LaneVector, LaneVector&) { return in; };
+    auto increment = [](LaneVector in, LaneVector, LaneVector, LaneVector&) { return vAdd(in, vSet(0x01)); };
+    auto decrement = [](LaneVector in, LaneVector, LaneVector, LaneVector&) { return vSub(in, vSet(0x01)); };
+    auto compare = [](LaneVector in, LaneVector m, LaneVector, LaneVector& flags) {
+        flags = vOr(flags, vAnd(vGeU(in, m), vSet(C)));
+        return vSub(in, m);
+    };
+    auto setFlag = [&](Byte flag, bool bSet) {
+        for (size_t i = 0; i < n; i += LANE_VECTOR_WIDTH) {
+            LaneVector p = vLoad(&P[i]);
+            LaneVector updated = vOr(vAnd(p, vSet((Byte)~flag)), vSet((bSet ? flag : 0x00) | U));
+            vStore(&P[i], vSelect(vLoad(g + i), updated, p));
+        }
+    };
+
+    // Indexed reads take a cycle more when the index crosses a page
+    bool bMayCrossPage = mode == &CPU::ABX || mode == &CPU::ABY;
+
+    switch (opcode) {
+    // Loads
+    case 0xA9: case 0xA5: case 0xB5: case 0xAD: case 0xBD: case 0xB9: // LDA
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ, load);
+        break;
+    case 0xA2: case 0xA6: case 0xB6: case 0xAE: case 0xBE: // LDX
+        applyToGroup(X.data(), X.data(), M, P.data(), g, n, NZ, load);
+        break;
+    case 0xA0: case 0xA4: case 0xB4: case 0xAC: case 0xBC: // LDY
+        applyToGroup(Y.data(), Y.data(), M, P.data(), g, n, NZ, load);
+        break;
+
+    // Stores and read-modify-writes, which always take their full cycles
+    case 0x85: case 0x95: case 0x8D: case 0x9D: case 0x99: storeToGroup(A.data()); bMayCrossPage = false; break; // STA
+    case 0x86: case 0x96: case 0x8E: storeToGroup(X.data()); break; // STX
+    case 0x84: case 0x94: case 0x8C: storeToGroup(Y.data()); break; // STY
+    case 0xE6: case 0xF6: case 0xEE: case 0xFE: // INC
+        applyToGroup(operandLanes.data(), M, M, P.data(), g, n, NZ, increment);
+        storeToGroup(operandLanes.data());
+        bMayCrossPage = false;
+        break;
+    case 0xC6: case 0xD6: case 0xCE: case 0xDE: // DEC
+        applyToGroup(operandLanes.data(), M, M, P.data(), g, n, NZ, decrement);
+        storeToGroup(operandLanes.data());
+        bMayCrossPage = false;
+        break;
+
+    // Arithmetic and logic with an immediate or memory operand
+    case 0x29: case 0x25: case 0x35: case 0x2D: case 0x3D: case 0x39: // AND
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ,
+            [](LaneVector a, LaneVector m, LaneVector, LaneVector&) { return vAnd(a, m); });
+        break;
+    case 0x09: case 0x05: case 0x15: case 0x0D: case 0x1D: case 0x19: // ORA
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ,
+            [](LaneVector a, LaneVector m, LaneVector, LaneVector&) { return vOr(a, m); });
+        break;
+    case 0x49: case 0x45: case 0x55: case 0x4D: case 0x5D: case 0x59: // EOR
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ,
+            [](LaneVector a, LaneVector m, LaneVector, LaneVector&) { return vXor(a, m); });
+        break;
+    case 0x69: case 0x65: case 0x75: case 0x6D: case 0x7D: case 0x79: // ADC
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C | V,
+            [](LaneVector a, LaneVector m, LaneVector p, LaneVector& flags) { return vAddWithCarry(a, m, p, flags); });
+        break;
+    case 0xE9: case 0xE5: case 0xF5: case 0xED: case 0xFD: case 0xF9: // SBC is ADC of the inverted operand
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C | V,
+            [](LaneVector a, LaneVector m, LaneVector p, LaneVector& flags) { return vAddWithCarry(a, vNot(m), p, flags); });
+        break;
+    case 0xC9: case 0xC5: case 0xD5: case 0xCD: case 0xDD: case 0xD9: // CMP
+        applyToGroup(nullptr, A.data(), M, P.data(), g, n, NZ | C, compare);
+        break;
+    case 0xE0: case 0xE4: case 0xEC: applyToGroup(nullptr, X.data(), M, P.data(), g, n, NZ | C, compare); break; // CPX
+    case 0xC0: case 0xC4: case 0xCC: applyToGroup(nullptr, Y.data(), M, P.data(), g, n, NZ | C, compare); break; // CPY
+
+    // Register transfers, increments and decrements
+    case 0xAA: applyToGroup(X.data(), A.data(), M, P.data(), g, n, NZ, copy); break; // TAX
+    case 0xA8: applyToGroup(Y.data(), A.data(), M, P.data(), g, n, NZ, copy); break; // TAY
+    case 0x8A: applyToGroup(A.data(), X.data(), M, P.data(), g, n, NZ, copy); break; // TXA
+    case 0x98: applyToGroup(A.data(), Y.data(), M, P.data(), g, n, NZ, copy); break; // TYA
+    case 0xBA: applyToGroup(X.data(), SP.data(), M, P.data(), g, n, NZ, copy); break; // TSX
+    case 0x9A: applyToGroup(SP.data(), X.data(), M, P.data(), g, n, 0x00, copy); break; // TXS
+    case 0xE8: applyToGroup(X.data(), X.data(), M, P.data(), g, n, NZ, increment); break; // INX
+    case 0xC8: applyToGroup(Y.data(), Y.data(), M, P.data(), g, n, NZ, increment); break; // INY
+    case 0xCA: applyToGroup(X.data(), X.data(), M, P.data(), g, n, NZ, decrement); break; // DEX
+    case 0x88: applyToGroup(Y.data(), Y.data(), M, P.data(), g, n, NZ, decrement); break; // DEY
+
+    // Accumulator shifts
+    case 0x0A: // ASL A
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C,
+            [](LaneVector a, LaneVector, LaneVector, LaneVector& flags) {
+                flags = vOr(flags, vAnd(vEq(vAnd(a, vSet(0x80)), vSet(0x80)), vSet(C)));
+                return vAdd(a, a);
+            });
+        break;
+    case 0x4A: // LSR A
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C,
+            [](LaneVector a, LaneVector, LaneVector, LaneVector& flags) {
+                flags = vOr(flags, vAnd(a, vSet(C)));
+                return vShr1(a);
+            });
+        break;
+    case 0x2A: // ROL A
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C,
+            [](LaneVector a, LaneVector, LaneVector p, LaneVector& flags) {
+                LaneVector r = vOr(vAdd(a, a), vAnd(p, vSet(C)));
+                flags = vOr(flags, vAnd(vEq(vAnd(a, vSet(0x80)), vSet(0x80)), vSet(C)));
+                return r;
+            });
+        break;
+    case 0x6A: // ROR A
+        applyToGroup(A.data(), A.data(), M, P.data(), g, n, NZ | C,
+            [](LaneVector a, LaneVector, LaneVector p, LaneVector& flags) {
+                LaneVector carryIn = vAnd(vEq(vAnd(p, vSet(C)), vSet(C)), vSet(0x80));
+                flags = vOr(flags, vAnd(a, vSet(C)));
+                return vOr(vShr1(a), carryIn);
+            });
+        break;
+
+    // Flag operations
+    case 0x18: setFlag(C, false); break; // CLC
+    case 0x38: setFlag(C, true); break;  // SEC
+    case 0x58: setFlag(I, false); break; // CLI
+    case 0x78: setFlag(I, true); break;  // SEI
+    case 0xD8: setFlag(D, false); break; // CLD
+    case 0xF8: setFlag(D, true); break;  // SED
+    case 0xB8: setFlag(V, false); break; // CLV
+    case 0xEA: setFlag(0x00, false); break; // NOP
+
+    default:
+        return 0;
+    }
+
+    uint8_t nLength = instructionLength(mode);
+    size_t nRetired = 0;
+    for (size_t i = 0; i < nLanes; i++) {
+        if (group[i]) {
+            PC[i] += nLength;
+            laneCycles[i] = instruction.cyclesCount
+                + ((bMayCrossPage && (addressLanes[i] & 0xFF00) != (operand & 0xFF00)) ? 1 : 0);
+            nRetired++;
+        }
+    }
+
+    return nRetired;
+}
+
+void LockstepBatch::step() {
+    attachRam();
+    stepLanes();
+    detachRam();
+}
+
+void LockstepBatch::stepLanes() {
+    size_t leader = electLeader();
+    if (leader == nLanes) {
+        return;
+    }
+
+    // Every lane's instruction runs on the first dot of its first cycle
+    for (size_t i = 0; i < nLanes; i++) {
+        if (active[i]) {
+            clockPPU(i, 1);
+        }
+    }
+
+    Address leaderPC = PC[leader];
+    size_t nVectorised = 0;
+
+    // Only code in PRG-ROM is shared between lanes, and the whole
+    // instruction has to sit inside one bank window
+    if (leaderPC >= 0x8000) {
+        Bus &bus = *lanes[leader];
+        Opcode opcode = bus.cpuRead(leaderPC, true);
+        uint8_t nLength = instructionLength(CPU::OpcodeTable[opcode].addressingMode);
+        if (KERNEL_OPCODES[opcode] && (leaderPC & 0x1FFF) + nLength <= 0x2000 && buildGroup(leader) > 1) {
+            Address operand = nLength > 1 ? bus.cpuRead(leaderPC + 1, true) : 0x0000;
+            if (nLength > 2) {
+                operand |= bus.cpuRead(leaderPC + 2, true) << 8;
+            }
+            nVectorised = runKernel(opcode, operand);
+            nVectorInstructions += nVectorised;
+        }
+    }
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (active[i] && !(nVectorised > 0 && group[i])) {
+            stepScalar(i);
+        }
+    }
+
+    for (size_t i = 0; i < nLanes; i++) {
+        if (active[i]) {
+            advanceLane(i, laneCycles[i]);
+        }
+    }
+}
+
+void LockstepBatch::stepFrames(uint32_t nFrames) {
+    for (uint32_t frame = 0; frame < nFrames; frame++) {
+        if (nFramesAloneLeft > 0) {
+            nFramesAloneLeft--;
+            stepFramesAlone(1);
+            continue;
+        }
+
+        uint64_t nVector = nVectorInstructions;
+        uint64_t nRetired = nVectorInstructions + nScalarInstructions;
+        stepFramesLockstep(1);
+        nVector = nVectorInstructions - nVector;
+        nRetired = nVectorInstructions + nScalarInstructions - nRetired;
+        if (nRetired > 0 && nVector < dMinVectorShare * nRetired) {
+            nFramesAloneLeft = nFramesAlone;
+        }
+    }
+}
+
+void LockstepBatch::stepFramesAlone(uint32_t nFrames) {
+    for (size_t i = 0; i < nLanes; i++) {
+        Bus &bus = *lanes[i];
+        copyToCPU(i);
+        if (bus.cycleCpu != nullptr) {
+            bus.cycleCpu->restart();
+        }
+        for (uint32_t frame = 0; frame < nFrames; frame++) {
+            bus.clockFrame();
+        }
+
+        // On to where step() would pick the lane up: the next clock starts an
+        // instruction, with any DMA and interrupt before it already taken
+        while (!(bus.cpuComplete() && bus.nDMACycles == 0 && bus.nSystemClockCounter % 3 == 0)) {
+            bus.clock();
+        }
+        copyFromCPU(i);
+        laneFrames[i] += nFrames;
+    }
+    nLaneFramesAlone += (uint64_t)nLanes * nFrames;
+}
+
+void LockstepBatch::stepFramesLockstep(uint32_t nFrames) {
+    std::vector<uint32_t> target(nLanes);
+    bool bAnyActive = false;
+
+    for (size_t i = 0; i < nLanes; i++) {
+        target[i] = laneFrames[i] + nFrames;
+        active[i] = nFrames > 0 ? 0xFF : 0x00;
+        bAnyActive |= nFrames > 0;
+    }
+
+    attachRam();
+    while (bAnyActive) {
+        stepLanes();
+
+        bAnyActive = false;
+        for (size_t i = 0; i < nLanes; i++) {
+            if (laneFrames[i] >= target[i]) {
+                active[i] = 0x00;
+            }
+            bAnyActive |= active[i] != 0;
+        }
+    }
+
+    detachRam();
+
+    std::fill(active.begin(), active.end(), 0x00);
+    std::fill(active.begin(), active.begin() + nLanes, 0xFF);
+}
@@ -0,0 +1,165 @@
+#include "../include/LockstepBenchmark.hpp"
+#include "../include/Bus.hpp"
+#include "../include/LockstepBatch.hpp"
+#include "../include/Movie.hpp"
+#include "../include/StateHash.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+typedef std::chrono::steady_clock Clock;
+
+// What lane plays in a frame: the movie, or now and then a pad of its own
+static Byte laneInput(const LockstepBenchmark& benchmark, const std::vector<Byte>& vInput, size_t lane,
+    size_t frame, size_t port) {
+    Byte movie = vInput[frame * 2 + port];
+    if (lane == 0 || benchmark.nExploreEvery == 0 || (frame + lane) % benchmark.nExploreEvery != 0) {
+        return movie;
+    }
+    uint32_t x = (uint32_t)lane * 2654435761u ^ (uint32_t)(frame * 2 + port) * 40503u;
+    x ^= x >> 13;
+    x *= 0x5BD1E995u;
+    x ^= x >> 15;
+    return (Byte)x;
+}
+
+// RAM and cartridge of each lane, in lane order
+static std::vector<uint64_t> laneHashes(const std::vector<Bus*>& vLanes) {
+    StateHash hash;
+    std::vector<uint64_t> vHashes;
+    for (const Bus *bus : vLanes) {
+        vHashes.push_back(hash(*bus, (1u << StatePart::RAM) | (1u << StatePart::CARTRIDGE)));
+    }
+    return vHashes;
+}
+
+std::vector<LockstepBenchmark::Result> LockstepBenchmark::run() const {
+    return { run(false), run(true) };
+}
+
+LockstepBenchmark::Result LockstepBenchmark::run(bool bLockstep) const {
+    Result result;
+    result.sMode = bLockstep ? "lockstep" : "scalar";
+    result.nLanes = nLanes;
+
+    Movie movie;
+    if (!movie.load(title.sMovie)) {
+        return result;
+    }
+    std::vector<Byte> vInput = movie.controllerBytes();
+    size_t nPlayed = movie.vFrames.size();
+    if (nFrames != 0) {
+        nPlayed = std::min<size_t>(nPlayed, nFrames);
+    }
+
+    double dBest = 0.0;
+    for (uint32_t repeat = 0; repeat < std::max(nRepeats, 1u); repeat++) {
+        std::unique_ptr<LockstepBatch> batch;
+        std::vector<std::unique_ptr<Bus>> vBuses;
+        std::vector<Bus*> vLanes;
+        if (bLockstep) {
+            batch = std::make_unique<LockstepBatch>(title.sROM, nLanes);
+            for (size_t i = 0; i < nLanes; i++) {
+                vLanes.push_back(&batch->lane(i));
+            }
+        } else {
+            for (size_t i = 0; i < nLanes; i++) {
+                vBuses.push_back(std::make_unique<Bus>());
+                vBuses.back()->insertCartridge(std::make_shared<Cartridge>(title.sROM));
+                vBuses.back()->reset();
+                vLanes.push_back(vBuses.back().get());
+            }
+        }
+        if (vLanes.empty() || !vLanes[0]->cart->ImageValid()) {
+            return result;
+        }
+        for (Bus *bus : vLanes) {
+            bus->ppu.outputEnabled = bVideo;
+        }
+
+        Clock::time_point start = Clock::now();
+        for (size_t frame = 0; frame < nPlayed; frame++) {
+            for (size_t i = 0; i < nLanes; i++) {
+                vLanes[i]->controller[0] = laneInput(*this, vInput, i, frame, 0);
+                vLanes[i]->controller[1] = laneInput(*this, vInput, i, frame, 1);
+                if (!bLockstep) {
+                    vLanes[i]->clockFrame();
+                }
+            }
+            if (bLockstep) {
+                batch->stepFrames(1);
+            }
+        }
+        double dSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (repeat == 0 || dSeconds < dBest) {
+            dBest = dSeconds;
+        }
+        if (bLockstep) {
+            batch->syncLanes();
+            uint64_t nRetired = batch->nVectorInstructions + batch->nScalarInstructions;
+            result.dVectorFraction = nRetired > 0 ? (double)batch->nVectorInstructions / nRetired : 0.0;
+            result.dAloneFraction = nPlayed > 0 ? (double)batch->nLaneFramesAlone / (nPlayed * nLanes) : 0.0;
+        }
+        result.vLaneHashes = laneHashes(vLanes);
+    }
+
+    StateHasher hasher;
+    for (uint64_t nHash : result.vLaneHashes) {
+        hasher.value(nHash);
+    }
+    result.nStateHash = hasher.digest();
+
+    result.bValid = true;
+    result.nFrames = nPlayed * nLanes;
+    result.dSeconds = dBest;
+    if (dBest > 0.0) {
+        result.dFramesPerSecond = result.nFrames / dBest;
+    }
+    return result;
+}
+
+std::vector<size_t> LockstepBenchmark::differingLanes(const Result& first, const Result& second) {
+    std::vector<size_t> vLanes;
+    size_t nLanes = std::max(first.vLaneHashes.size(), second.vLaneHashes.size());
+    for (size_t i = 0; i < nLanes; i++) {
+        if (i >= first.vLaneHashes.size() || i >= second.vLaneHashes.size()
+            || first.vLaneHashes[i] != second.vLaneHashes[i]) {
+            vLanes.push_back(i);
+        }
+    }
+    return vLanes;
+}
+
+void LockstepBenchmark::writeReport(const std::vector<Result>& vResults, std::ostream& out) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-9s %6s %10s %10s %12s %8s %8s  %s\n",
+        "mode", "lanes", "frames", "seconds", "frames/s", "vector", "alone", "state hash");
+    out << line;
+
+    for (const Result &r : vResults) {
+        if (!r.bValid) {
+            std::snprintf(line, sizeof(line), "%-9s invalid\n", r.sMode.c_str());
+            out << line;
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "%-9s %6zu %10llu %10.3f %12.0f %7.1f%% %7.1f%%  %016llx\n",
+            r.sMode.c_str(), r.nLanes, (unsigned long long)r.nFrames, r.dSeconds, r.dFramesPerSecond,
+            r.dVectorFraction * 100.0, r.dAloneFraction * 100.0, (unsigned long long)r.nStateHash);
+        out << line;
+    }
+
+    if (vResults.size() == 2 && vResults[0].bValid && vResults[1].bValid && vResults[0].dFramesPerSecond > 0.0) {
+        std::snprintf(line, sizeof(line), "lockstep/scalar throughput: %.3fx\n",
+            vResults[1].dFramesPerSecond / vResults[0].dFramesPerSecond);
+        out << line;
+        std::vector<size_t> vDiffering = differingLanes(vResults[0], vResults[1]);
+        if (!vDiffering.empty()) {
+            std::snprintf(line, sizeof(line), "STATE DIFFERS in %zu lanes, first lane %zu\n",
+                vDiffering.size(), vDiffering[0]);
+            out << line;
+        }
+    }
+}
@@ -3,4 +3,77 @@
 Mapper::Mapper(uint8_t prgBanks, uint8_t chrBanks)
     : nPRGBanks(prgBanks), nCHRBanks(chrBanks) {}
 
-Mapper::~Mapper() {}
\ No newline at end of file
+Mapper::~Mapper() {}
+
+bool Mapper::cpuMapRead(Address address, uint32_t &mappedAddress, Byte &data) {
+    if (address >= 0x8000) {
+        mappedAddress = prgReadTable[(address >> 13) & 0x03] + (address & 0x1FFF);
+        return true;
+    }
+
+    if (address >= 0x6000 && !vPRGRam.empty()) {
+        mappedAddress = MAPPED_INTERNALLY;
+        data = vPRGRam.read(address & 0x1FFF);
+        return true;
+    }
+
+    return false;
+}
+
+bool Mapper::ppuMapRead(Address address, uint32_t &mappedAddress) {
+    if (address <= 0x1FFF) {
+        mappedAddress = chrBankTable[address >> 10] + (address & 0x03FF);
+        return true;
+    }
+
+    return false;
+}
+
+bool Mapper::ppuMapWrite(Address address, uint32_t &mappedAddress) {
+    // Only CHR-RAM is writable
+    if (address <= 0x1FFF && nCHRBanks == 0) {
+        mappedAddress = chrBankTable[address >> 10] + (address & 0x03FF);
+        return true;
+    }
+
+    return false;
+}
+
+void Mapper::setPRGOverlay(std::shared_ptr<const std::vector<uint32_t>> pOverlay) {
+    pPRGOverlay = std::move(pOverlay);
+    for (uint8_t slot = 0; slot < 4; slot++) {
+        mapPRG8k(slot, prgBankTable[slot] / 0x2000);
+    }
+}
+
+void Mapper::mapPRG8k(uint8_t slot, uint32_t bank) {
+    bank %= prgBankCount8k();
+    prgBankTable[slot] = bank * 0x2000;
+    prgReadTable[slot] = pPRGOverlay == nullptr ? prgBankTable[slot]
+        : (*pPRGOverlay)[slot * prgBankCount8k() + bank];
+}
+
+void Mapper::mapPRG16k(uint8_t slot, uint32_t bank) {
+    mapPRG8k(slot * 2, bank * 2);
+    mapPRG8k(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::mapPRG32k(uint32_t bank) {
+    mapPRG16k(0, bank * 2);
+    mapPRG16k(1, bank * 2 + 1);
+}
+
+void Mapper::mapCHR1k(uint8_t slot, uint32_t bank) {
+    chrBankTable[slot] = (bank % chrBankCount1k()) * 0x0400;
+}
+
+void Mapper::mapCHR4k(uint8_t slot, uint32_t bank) {
+    for (uint8_t i = 0; i < 4; i++) {
+        mapCHR1k(slot * 4 + i, bank * 4 + i);
+    }
+}
+
+void Mapper::mapCHR8k(uint32_t bank) {
+    mapCHR4k(0, bank * 2);
+    mapCHR4k(1, bank * 2 + 1);
+}
@@ -3,47 +3,40 @@
 #include "../../include/Mapper.hpp"
 
 Mapper_000::Mapper_000(uint8_t prgBanks, uint8_t chrBanks)
-    : Mapper(prgBanks, chrBanks) {}
+    : Mapper(prgBanks, chrBanks) {
+    // Family Basic boards carry work RAM, and test ROMs report through it
+    vPRGRam.resize(8192);
+    reset();
+}
 
 Mapper_000::~Mapper_000() {}
 
-bool Mapper_000::cpuMapRead(Address address, uint32_t &mappedAddress) {
-    if (address >= 0x8000 && address <= 0xFFFF) {
-        mappedAddress = address & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
+bool Mapper_000::cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data) {
+    if (address >= 0x6000 && address <= 0x7FFF) {
+        mappedAddress = MAPPED_INTERNALLY;
+        vPRGRam.write(address & 0x1FFF, data);
         return true;
     }
 
     return false;
 }
 
-bool Mapper_000::cpuMapWrite(Address address, uint32_t &mappedAddress) {
-    if (address >= 0x8000 && address <= 0xFFFF) {
-        mappedAddress = address & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
-        return true;
-    }
-
-    return false;
+void Mapper_000::reset() {
+    // A 16 KB image is mirrored into both halves of $8000-$FFFF
+    mapPRG16k(0, 0);
+    mapPRG16k(1, nPRGBanks > 1 ? 1 : 0);
+    mapCHR8k(0);
 }
 
-// TODO: Maybe has to change.
-
-bool Mapper_000::ppuMapRead(Address address, uint32_t &mappedAddress) {
-    if (address >= 0x0000 && address <= 0x1FFF) {
-        mappedAddress = address;
-        return true;
-    }
-
-    return false;
+std::shared_ptr<Mapper> Mapper_000::clone() const {
+    return InstanceArena::makeShared<Mapper_000>(*this);
 }
 
-bool Mapper_000::ppuMapWrite(Address address, uint32_t &mappedAddress) {
-    if (address >= 0x0000 && address <= 0x1FFF) {
-        if (nCHRBanks == 0) {
-            mappedAddress = address;
-            return true;
-        }
+bool Mapper_000::copyFrom(const Mapper& other) {
+    const Mapper_000 *source = dynamic_cast<const Mapper_000*>(&other);
+    if (source == nullptr) {
+        return false;
     }
-
-    return false;
+    *this = *source;
+    return true;
 }
-
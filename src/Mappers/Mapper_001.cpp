@@ -0,0 +1,114 @@
+#include "../../include/Mappers/Mapper_001.hpp"
+#include "../../include/Typedefs.hpp"
+#include "../../include/Mapper.hpp"
+
+Mapper_001::Mapper_001(uint8_t prgBanks, uint8_t chrBanks)
+    : Mapper(prgBanks, chrBanks) {
+    vPRGRam.resize(8192);
+    reset();
+}
+
+Mapper_001::~Mapper_001() {}
+
+bool Mapper_001::cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data) {
+    if (address >= 0x6000 && address <= 0x7FFF) {
+        mappedAddress = MAPPED_INTERNALLY;
+        vPRGRam.write(address & 0x1FFF, data);
+        return true;
+    }
+
+    if (address >= 0x8000) {
+        mappedAddress = MAPPED_INTERNALLY;
+
+        if (data & 0x80) {
+            // Reset the shift register and lock the last bank at $C000
+            nLoadRegister = 0x00;
+            nLoadRegisterCount = 0;
+            nControlRegister |= 0x0C;
+            updateBanks();
+            return true;
+        }
+
+        nLoadRegister >>= 1;
+        nLoadRegister |= (data & 0x01) << 4;
+        nLoadRegisterCount++;
+
+        if (nLoadRegisterCount == 5) {
+            // The fifth write commits; bits 13-14 of its address pick the register
+            switch ((address >> 13) & 0x03) {
+                case 0: nControlRegister = nLoadRegister & 0x1F; break;
+                case 1: nCHRBankSelect0 = nLoadRegister & 0x1F; break;
+                case 2: nCHRBankSelect1 = nLoadRegister & 0x1F; break;
+                case 3: nPRGBankSelect = nLoadRegister & 0x0F; break;
+            }
+
+            nLoadRegister = 0x00;
+            nLoadRegisterCount = 0;
+            updateBanks();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void Mapper_001::updateBanks() {
+    switch (nControlRegister & 0x03) {
+        case 0: mirrormode = Mirroring::ONESCREEN_LO; break;
+        case 1: mirrormode = Mirroring::ONESCREEN_HI; break;
+        case 2: mirrormode = Mirroring::VERTICAL; break;
+        case 3: mirrormode = Mirroring::HORIZONTAL; break;
+    }
+
+    if (nControlRegister & 0x10) {
+        mapCHR4k(0, nCHRBankSelect0);
+        mapCHR4k(1, nCHRBankSelect1);
+    } else {
+        mapCHR8k(nCHRBankSelect0 >> 1);
+    }
+
+    switch ((nControlRegister >> 2) & 0x03) {
+        case 0:
+        case 1:
+            mapPRG32k(nPRGBankSelect >> 1);
+            break;
+        case 2:
+            mapPRG16k(0, 0);
+            mapPRG16k(1, nPRGBankSelect);
+            break;
+        case 3:
+            mapPRG16k(0, nPRGBankSelect);
+            mapPRG16k(1, nPRGBanks - 1);
+            break;
+    }
+}
+
+void Mapper_001::reset() {
+    nLoadRegister = 0x00;
+    nLoadRegisterCount = 0;
+    nControlRegister = 0x1C;
+
+    nCHRBankSelect0 = 0x00;
+    nCHRBankSelect1 = 0x00;
+    nPRGBankSelect = 0x00;
+
+    updateBanks();
+}
+
+std::shared_ptr<Mapper> Mapper_001::clone() const {
+    return InstanceArena::makeShared<Mapper_001>(*this);
+}
+
+bool Mapper_001::copyFrom(const Mapper& other) {
+    const Mapper_001 *source = dynamic_cast<const Mapper_001*>(&other);
+    if (source == nullptr) {
+        return false;
+    }
+    *this = *source;
+    return true;
+}
+
+Mirroring::Mode Mapper_001::mirror() {
+    return mirrormode;
+}
@@ -0,0 +1,39 @@
+#include "../../include/Mappers/Mapper_002.hpp"
+#include "../../include/Typedefs.hpp"
+#include "../../include/Mapper.hpp"
+
+Mapper_002::Mapper_002(uint8_t prgBanks, uint8_t chrBanks)
+    : Mapper(prgBanks, chrBanks) {
+    reset();
+}
+
+Mapper_002::~Mapper_002() {}
+
+bool Mapper_002::cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data) {
+    if (address >= 0x8000) {
+        mappedAddress = MAPPED_INTERNALLY;
+        mapPRG16k(0, data & 0x0F);
+        return true;
+    }
+
+    return false;
+}
+
+void Mapper_002::reset() {
+    mapPRG16k(0, 0);
+    mapPRG16k(1, nPRGBanks - 1);
+    mapCHR8k(0);
+}
+
+std::shared_ptr<Mapper> Mapper_002::clone() const {
+    return InstanceArena::makeShared<Mapper_002>(*this);
+}
+
+bool Mapper_002::copyFrom(const Mapper& other) {
+    const Mapper_002 *source = dynamic_cast<const Mapper_002*>(&other);
+    if (source == nullptr) {
+        return false;
+    }
+    *this = *source;
+    return true;
+}
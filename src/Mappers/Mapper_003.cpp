@@ -0,0 +1,39 @@
+#include "../../include/Mappers/Mapper_003.hpp"
+#include "../../include/Typedefs.hpp"
+#include "../../include/Mapper.hpp"
+
+Mapper_003::Mapper_003(uint8_t prgBanks, uint8_t chrBanks)
+    : Mapper(prgBanks, chrBanks) {
+    reset();
+}
+
+Mapper_003::~Mapper_003() {}
+
+bool Mapper_003::cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data) {
+    if (address >= 0x8000) {
+        mappedAddress = MAPPED_INTERNALLY;
+        mapCHR8k(data & 0x03);
+        return true;
+    }
+
+    return false;
+}
+
+void Mapper_003::reset() {
+    mapPRG16k(0, 0);
+    mapPRG16k(1, nPRGBanks > 1 ? 1 : 0);
+    mapCHR8k(0);
+}
+
+std::shared_ptr<Mapper> Mapper_003::clone() const {
+    return InstanceArena::makeShared<Mapper_003>(*this);
+}
+
+bool Mapper_003::copyFrom(const Mapper& other) {
+    const Mapper_003 *source = dynamic_cast<const Mapper_003*>(&other);
+    if (source == nullptr) {
+        return false;
+    }
+    *this = *source;
+    return true;
+}
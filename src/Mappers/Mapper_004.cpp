@@ -0,0 +1,157 @@
+#include "../../include/Mappers/Mapper_004.hpp"
+#include "../../include/Typedefs.hpp"
+#include "../../include/Mapper.hpp"
+
+Mapper_004::Mapper_004(uint8_t prgBanks, uint8_t chrBanks)
+    : Mapper(prgBanks, chrBanks) {
+    vPRGRam.resize(8192);
+    reset();
+}
+
+Mapper_004::~Mapper_004() {}
+
+bool Mapper_004::cpuMapWrite(Address address, uint32_t &mappedAddress, Byte data) {
+    if (address >= 0x6000 && address <= 0x7FFF) {
+        mappedAddress = MAPPED_INTERNALLY;
+        vPRGRam.write(address & 0x1FFF, data);
+        return true;
+    }
+
+    if (address < 0x8000) {
+        return false;
+    }
+
+    mappedAddress = MAPPED_INTERNALLY;
+    bool bEven = !(address & 0x0001);
+
+    if (address <= 0x9FFF) {
+        if (bEven) {
+            // Bank select
+            nTargetRegister = data & 0x07;
+            bPRGBankMode = (data & 0x40);
+            bCHRInversion = (data & 0x80);
+        } else {
+            // Bank data
+            pRegister[nTargetRegister] = data;
+        }
+        updateBanks();
+    } else if (address <= 0xBFFF) {
+        if (bEven) {
+            mirrormode = (data & 0x01) ? Mirroring::HORIZONTAL : Mirroring::VERTICAL;
+        }
+        // Odd addresses hold the PRG-RAM protect bits, which we don't enforce
+    } else if (address <= 0xDFFF) {
+        if (bEven) {
+            nIRQLatch = data;
+        } else {
+            nIRQCounter = 0x00;
+            bIRQReload = true;
+        }
+    } else {
+        if (bEven) {
+            bIRQEnable = false;
+            bIRQActive = false;
+        } else {
+            bIRQEnable = true;
+        }
+    }
+
+    return true;
+}
+
+bool Mapper_004::ppuMapRead(Address address, uint32_t &mappedAddress) {
+    watchA12(address);
+    return Mapper::ppuMapRead(address, mappedAddress);
+}
+
+bool Mapper_004::ppuMapWrite(Address address, uint32_t &mappedAddress) {
+    watchA12(address);
+    return Mapper::ppuMapWrite(address, mappedAddress);
+}
+
+void Mapper_004::watchA12(Address address) {
+    if (address & 0x1000) {
+        if (nA12LowCount >= A12_LOW_FILTER) {
+            scanline();
+        }
+        nA12LowCount = 0;
+    } else if (nA12LowCount < A12_LOW_FILTER) {
+        nA12LowCount++;
+    }
+}
+
+void Mapper_004::scanline() {
+    if (nIRQCounter == 0 || bIRQReload) {
+        nIRQCounter = nIRQLatch;
+        bIRQReload = false;
+    } else {
+        nIRQCounter--;
+    }
+
+    if (nIRQCounter == 0 && bIRQEnable) {
+        bIRQActive = true;
+    }
+}
+
+void Mapper_004::updateBanks() {
+    // R0/R1 select 2 KB CHR banks, R2-R5 1 KB; inversion swaps the two halves
+    uint8_t nBig = bCHRInversion ? 4 : 0;
+    uint8_t nSmall = bCHRInversion ? 0 : 4;
+    mapCHR1k(nBig + 0, pRegister[0] & 0xFE);
+    mapCHR1k(nBig + 1, pRegister[0] | 0x01);
+    mapCHR1k(nBig + 2, pRegister[1] & 0xFE);
+    mapCHR1k(nBig + 3, pRegister[1] | 0x01);
+    mapCHR1k(nSmall + 0, pRegister[2]);
+    mapCHR1k(nSmall + 1, pRegister[3]);
+    mapCHR1k(nSmall + 2, pRegister[4]);
+    mapCHR1k(nSmall + 3, pRegister[5]);
+
+    // R6 swaps between $8000 and $C000; the other slot holds the second-last bank
+    uint32_t nSecondLast = prgBankCount8k() - 2;
+    mapPRG8k(bPRGBankMode ? 2 : 0, pRegister[6] & 0x3F);
+    mapPRG8k(1, pRegister[7] & 0x3F);
+    mapPRG8k(bPRGBankMode ? 0 : 2, nSecondLast);
+    mapPRG8k(3, prgBankCount8k() - 1);
+}
+
+void Mapper_004::reset() {
+    nTargetRegister = 0x00;
+    bPRGBankMode = false;
+    bCHRInversion = false;
+    mirrormode = Mirroring::HORIZONTAL;
+
+    bIRQActive = false;
+    bIRQEnable = false;
+    bIRQReload = false;
+    nIRQCounter = 0x00;
+    nIRQLatch = 0x00;
+    nA12LowCount = 0x00;
+
+    pRegister = { 0, 2, 4, 5, 6, 7, 0, 1 };
+    updateBanks();
+}
+
+std::shared_ptr<Mapper> Mapper_004::clone() const {
+    return InstanceArena::makeShared<Mapper_004>(*this);
+}
+
+bool Mapper_004::copyFrom(const Mapper& other) {
+    const Mapper_004 *source = dynamic_cast<const Mapper_004*>(&other);
+    if (source == nullptr) {
+        return false;
+    }
+    *this = *source;
+    return true;
+}
+
+Mirroring::Mode Mapper_004::mirror() {
+    return mirrormode;
+}
+
+bool Mapper_004::irqState() {
+    return bIRQActive;
+}
+
+void Mapper_004::irqClear() {
+    bIRQActive = false;
+}
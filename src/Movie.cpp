@@ -0,0 +1,80 @@
+#include "../include/Movie.hpp"
+#include "../include/Bus.hpp"
+
+#include <cstdlib>
+#include <fstream>
+
+// Button characters of an input line, bit 0 first
+static Byte parseButtons(const std::string& sField) {
+    Byte buttons = 0x00;
+    for (size_t i = 0; i < sField.size() && i < 8; i++) {
+        if (sField[i] != '.' && sField[i] != ' ') {
+            buttons |= 1 << i;
+        }
+    }
+    return buttons;
+}
+
+bool Movie::load(const std::string& sFileName) {
+    std::ifstream ifs(sFileName);
+    if (!ifs.is_open()) {
+        return false;
+    }
+    return parse(ifs);
+}
+
+bool Movie::parse(std::istream& is) {
+    vFrames.clear();
+
+    std::string sLine;
+    while (std::getline(is, sLine)) {
+        if (sLine.empty() || sLine[0] != '|') {
+            continue;
+        }
+
+        // "|commands|port0|port1|port2|"
+        std::vector<std::string> vFields;
+        size_t start = 1;
+        for (size_t bar = sLine.find('|', start); bar != std::string::npos; bar = sLine.find('|', start)) {
+            vFields.push_back(sLine.substr(start, bar - start));
+            start = bar + 1;
+        }
+        if (vFields.empty()) {
+            return false;
+        }
+
+        Frame frame;
+        char *end = nullptr;
+        frame.commands = (Byte)std::strtoul(vFields[0].c_str(), &end, 10);
+        if (end == vFields[0].c_str()) {
+            return false;
+        }
+        for (size_t port = 0; port < 2 && port + 1 < vFields.size(); port++) {
+            frame.controller[port] = parseButtons(vFields[port + 1]);
+        }
+        vFrames.push_back(frame);
+    }
+    return !vFrames.empty();
+}
+
+void Movie::apply(Bus& bus, size_t nFrame) const {
+    const Frame &frame = vFrames[nFrame];
+    if (frame.commands & MovieCommand::HARD_RESET) {
+        bus.cpuRam.fill(0x00);
+        bus.reset();
+    } else if (frame.commands & MovieCommand::SOFT_RESET) {
+        bus.reset();
+    }
+    bus.controller[0] = frame.controller[0];
+    bus.controller[1] = frame.controller[1];
+}
+
+std::vector<Byte> Movie::controllerBytes() const {
+    std::vector<Byte> vBytes;
+    vBytes.reserve(vFrames.size() * 2);
+    for (const Frame &frame : vFrames) {
+        vBytes.push_back(frame.controller[0]);
+        vBytes.push_back(frame.controller[1]);
+    }
+    return vBytes;
+}
@@ -0,0 +1,124 @@
+#include "../include/Observation.hpp"
+#include "../include/LaneVector.hpp"
+
+#include <algorithm>
+
+static_assert(SCREEN_WIDTH * SCREEN_HEIGHT % 64 == 0, "frame must be whole lane vectors");
+
+ObservationStage::ObservationStage(uint16_t w, uint16_t h, uint16_t nStackRequested, Byte* ring,
+                                   GrayscaleConversion::Mode mode)
+    : width(w), height(h), nStack(nStackRequested), pRing(ring), nSlot(nStackRequested - 1)
+{
+    for (size_t i = 0; i < lut.size(); i++) {
+        const Byte* rgb = PPU::PALETTE_RGB[i];
+        if (mode == GrayscaleConversion::LUMA) {
+            lut[i] = (Byte)((299 * rgb[0] + 587 * rgb[1] + 114 * rgb[2] + 500) / 1000);
+        } else {
+            lut[i] = (Byte)((rgb[0] + rgb[1] + rgb[2] + 1) / 3);
+        }
+    }
+
+    columns = buildTaps(SCREEN_WIDTH, width);
+    rows = buildTaps(SCREEN_HEIGHT, height);
+
+    vLast.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+    vPooled.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+}
+
+ObservationStage::~ObservationStage() {
+
+}
+
+ObservationStage::Taps ObservationStage::buildTaps(uint16_t nSource, uint16_t nOutput) {
+    // Output pixel i covers [i * nSource, (i + 1) * nSource) and source pixel
+    // s covers [s * nOutput, (s + 1) * nOutput), so the weights of one output
+    // pixel add up to nSource
+    Taps taps;
+    for (uint32_t i = 0; i < nOutput; i++) {
+        uint32_t begin = i * nSource;
+        uint32_t end = begin + nSource;
+        uint16_t first = begin / nOutput;
+
+        taps.first.push_back(first);
+        taps.offset.push_back(taps.weight.size());
+        uint16_t count = 0;
+        for (uint32_t s = first; s * nOutput < end; s++) {
+            uint32_t lo = std::max(begin, s * nOutput);
+            uint32_t hi = std::min(end, (s + 1) * nOutput);
+            taps.weight.push_back(hi - lo);
+            count++;
+        }
+        taps.count.push_back(count);
+    }
+    return taps;
+}
+
+void ObservationStage::downscale(const Byte* in, Byte* out) {
+    // Rows first, a whole source row at a time so the inner loop runs over
+    // contiguous pixels, then columns of the reduced row. The weights of each
+    // output pixel add up to SCREEN_WIDTH * SCREEN_HEIGHT, divided out at the end.
+    const uint32_t nTotal = (uint32_t)SCREEN_WIDTH * SCREEN_HEIGHT;
+    // Local, so the compiler can see the frame bytes never alias it
+    std::array<uint32_t, SCREEN_WIDTH> sum;
+
+    for (uint16_t y = 0; y < height; y++) {
+        const uint32_t* rowWeight = rows.weight.data() + rows.offset[y];
+        const Byte* src = in + rows.first[y] * SCREEN_WIDTH;
+        uint16_t nTaps = rows.count[y];
+
+        sum.fill(0);
+        for (uint16_t k = 0; k < nTaps; k++, src += SCREEN_WIDTH) {
+            const uint32_t weight = rowWeight[k];
+            for (size_t x = 0; x < SCREEN_WIDTH; x++) {
+                sum[x] += weight * src[x];
+            }
+        }
+
+        Byte* dst = out + y * width;
+        for (uint16_t x = 0; x < width; x++) {
+            const uint32_t* columnWeight = columns.weight.data() + columns.offset[x];
+            const uint32_t* s = sum.data() + columns.first[x];
+            uint16_t nColumnTaps = columns.count[x];
+            uint32_t total = nTotal / 2;
+            for (uint16_t k = 0; k < nColumnTaps; k++) {
+                total += columnWeight[k] * s[k];
+            }
+            dst[x] = (Byte)(total / nTotal);
+        }
+    }
+}
+
+void ObservationStage::pool(const Byte* frame) {
+    for (size_t i = 0; i < vLast.size(); i += LANE_VECTOR_WIDTH) {
+        vStore(vLast.data() + i, vLookup64(lut.data(), vLoad(frame + i)));
+    }
+    bHaveLast = true;
+}
+
+void ObservationStage::observe(const Byte* frame) {
+    // Grey conversion and pooling in one pass; this frame's grey copy then
+    // becomes the last frame for the next observation
+    LaneVector keepLast = vSet(bHaveLast ? 0xFF : 0x00);
+    for (size_t i = 0; i < vLast.size(); i += LANE_VECTOR_WIDTH) {
+        LaneVector current = vLookup64(lut.data(), vLoad(frame + i));
+        LaneVector last = vAnd(vLoad(vLast.data() + i), keepLast);
+        vStore(vPooled.data() + i, vMaxU(current, last));
+        vStore(vLast.data() + i, current);
+    }
+    bHaveLast = true;
+
+    nSlot = (nSlot + 1) % nStack;
+    downscale(vPooled.data(), pRing + (size_t)nSlot * width * height);
+}
+
+void ObservationStage::clear() {
+    bHaveLast = false;
+}
+
+uint16_t ObservationStage::newestSlot() const {
+    return nSlot;
+}
+
+size_t ObservationStage::observationSize() const {
+    return (size_t)width * height;
+}
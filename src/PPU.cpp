@@ -1,34 +1,98 @@
 #include "../include/PPU.hpp"
 #include "../include/Typedefs.hpp"
 #include "../include/Constants.hpp"
+#include "../include/CorePolicy.hpp"
 #include "../include/Bus.hpp"
+#include "../include/LaneVector.hpp"
+#include "../include/Debugger.hpp"
+#include "../include/CodeDataLogger.hpp"
+#include "../include/InstanceArena.hpp"
 
-PPU::PPU() {
+#include <cstring>
+
+namespace SpriteLine {
+    enum Flags {
+        BEHIND_BACKGROUND = (1 << 4),
+        SPRITE_ZERO = (1 << 5)
+    };
+}
+
+const Byte PPU::PALETTE_RGB[64][3] = {
+    {  84,  84,  84 }, {   0,  30, 116 }, {   8,  16, 144 }, {  48,   0, 136 }, {  68,   0, 100 }, {  92,   0,  48 }, {  84,   4,   0 }, {  60,  24,   0 },
+    {  32,  42,   0 }, {   8,  58,   0 }, {   0,  64,   0 }, {   0,  60,   0 }, {   0,  50,  60 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 152, 150, 152 }, {   8,  76, 196 }, {  48,  50, 236 }, {  92,  30, 228 }, { 136,  20, 176 }, { 160,  20, 100 }, { 152,  34,  32 }, { 120,  60,   0 },
+    {  84,  90,   0 }, {  40, 114,   0 }, {   8, 124,   0 }, {   0, 118,  40 }, {   0, 102, 120 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, {  76, 154, 236 }, { 120, 124, 236 }, { 176,  98, 236 }, { 228,  84, 236 }, { 236,  88, 180 }, { 236, 106, 100 }, { 212, 136,  32 },
+    { 160, 170,   0 }, { 116, 196,   0 }, {  76, 208,  32 }, {  56, 204, 108 }, {  56, 180, 204 }, {  60,  60,  60 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, { 168, 204, 236 }, { 188, 188, 236 }, { 212, 178, 236 }, { 236, 174, 236 }, { 236, 174, 212 }, { 236, 180, 176 }, { 228, 196, 144 },
+    { 204, 210, 120 }, { 180, 222, 120 }, { 168, 226, 144 }, { 152, 226, 180 }, { 160, 214, 228 }, { 160, 162, 160 }, {   0,   0,   0 }, {   0,   0,   0 }
+};
+
+PPU::PPU() : frameBuffer(InstanceArena::resource()) {
     // Initialize the PPU
+    tblPalette.fill(0x00);
+    oam.fill(0x00);
+    secondaryOAM.fill(0xFF);
+    spritePatternLo.fill(0x00);
+    spritePatternHi.fill(0x00);
+    spriteLine.fill(0x00);
+    bgLine.fill(0x00);
+    tblName.resize(2048);
+    mapNametables();
 }
 
 PPU::~PPU() {
     // Deinitialize the PPU
 }
 
+const Byte* PPU::frame() const {
+    if (frameBuffer.empty()) {
+        frameBuffer.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+    }
+    return frameBuffer.data();
+}
+
 void PPU::cpuWrite(Address addr, Byte data) {
     switch (addr)
 	{
 	case 0x0000: // Control
+        control = data;
+        tramAddr = (tramAddr & ~0x0C00) | ((data & 0x03) << 10);
 		break;
 	case 0x0001: // Mask
+        mask = data;
 		break;
 	case 0x0002: // Status
 		break;
 	case 0x0003: // OAM Address
+        oamAddr = data;
 		break;
 	case 0x0004: // OAM Data
+        oam[oamAddr++] = data;
 		break;
 	case 0x0005: // Scroll
+        if (addressLatch == 0) {
+            fineX = data & 0x07;
+            tramAddr = (tramAddr & ~0x001F) | (data >> 3);
+            addressLatch = 1;
+        } else {
+            tramAddr = (tramAddr & ~0x73E0) | ((data & 0x07) << 12) | ((data >> 3) << 5);
+            addressLatch = 0;
+        }
 		break;
 	case 0x0006: // PPU Address
+        if (addressLatch == 0) {
+            tramAddr = (tramAddr & 0x00FF) | ((data & 0x3F) << 8);
+            addressLatch = 1;
+        } else {
+            tramAddr = (tramAddr & 0xFF00) | data;
+            vramAddr = tramAddr;
+            addressLatch = 0;
+        }
 		break;
 	case 0x0007: // PPU Data
+        ppuWrite(vramAddr, data);
+        vramAddr += (control & PPUControlFlags::INCREMENT_MODE) ? 32 : 1;
 		break;
 	}
 }
@@ -37,28 +101,97 @@ Byte PPU::cpuRead(Address addr, bool bReadOnly) {
     Byte data = 0x00;
 	addr &= 0x3FFF;
 
+    if (bReadOnly) {
+        // Inspection without the read side effects
+        switch (addr) {
+        case 0x0000: data = control; break;
+        case 0x0001: data = mask; break;
+        case 0x0002:
+            resolveSpriteZeroHit();
+            data = status;
+            break;
+        case 0x0004: data = oam[oamAddr]; break;
+        }
+        return data;
+    }
+
+    switch (addr) {
+    case 0x0002: // Status
+        resolveSpriteZeroHit();
+        // The low bits float and return whatever was last on the PPU data bus
+        data = (status & 0xE0) | (ppuDataBuffer & 0x1F);
+        status &= ~PPUStatusFlags::VERTICAL_BLANK;
+        addressLatch = 0;
+        break;
+    case 0x0004: // OAM Data
+        data = oam[oamAddr];
+        break;
+    case 0x0007: // PPU Data
+        // Reads are delayed one access through the buffer, except for palette memory
+        data = ppuDataBuffer;
+        ppuDataBuffer = ppuRead(vramAddr);
+        if (CorePolicy::bInstrumented && cdl != nullptr && (vramAddr & 0x3FFF) < 0x2000) {
+            cdl->chr(vramAddr & 0x3FFF, CDLChr::READ);
+        }
+        if (vramAddr >= 0x3F00) {
+            data = ppuDataBuffer;
+        }
+        vramAddr += (control & PPUControlFlags::INCREMENT_MODE) ? 32 : 1;
+        break;
+    }
+
 	return data;
 }
 
+// Page of tblName behind each quadrant of $2000-$2FFF, for each Mirroring::Mode
+static const uint8_t NAMETABLE_PAGES[][4] = {
+    { 0, 1, 0, 1 },  // HARDWARE, which the cartridge resolves before it gets here
+    { 0, 0, 1, 1 },  // HORIZONTAL
+    { 0, 1, 0, 1 },  // VERTICAL
+    { 0, 0, 0, 0 },  // ONESCREEN_LO
+    { 1, 1, 1, 1 },  // ONESCREEN_HI
+    { 0, 1, 2, 3 }   // FOUR_SCREEN
+};
+
+void PPU::mapNametables() {
+    for (uint8_t quadrant = 0; quadrant < 4; quadrant++) {
+        nametablePage[quadrant] = NAMETABLE_PAGES[nametableMirror][quadrant];
+        nametable[quadrant] = tblName.page(nametablePage[quadrant]);
+    }
+}
+
+void PPU::updateMirroring() {
+    Mirroring::Mode mode = cart->Mirror();
+    if (mode != nametableMirror) {
+        nametableMirror = mode;
+        mapNametables();
+    }
+}
+
 void PPU::ppuWrite(Address addr, Byte data) {
     addr &= 0x3FFF;
-    if (cart->ppuWrite(addr, data)) {
-        // The cartridge "may" handle the write
-    } else if (addr >= 0x0000 && addr <= 0x1FFF) {
-        if (cart->nCHRBanks == 0) {
-            tblPattern[0][addr] = data;
-        }
-    } else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        addr &= 0x0FFF;
-        if (cart->nCHRBanks == 0) {
-            tblPattern[0][addr] = data;
-        }
-    } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
+    if (CorePolicy::bInstrumented && debugger != nullptr && (debugger->ppuPages[addr >> 8] & BreakType::WRITE)) {
+        debugger->ppuAccess(BreakType::WRITE, addr, data);
+    }
+
+    // Pattern tables are the cartridge's: CHR-RAM lives there, and writes to
+    // CHR-ROM go nowhere
+    if (addr <= 0x1FFF || bMapperWatchesBus) {
+        cart->ppuWrite(addr, data);
+    }
+
+    if (addr >= 0x2000 && addr <= 0x3EFF) {
+        uint8_t quadrant = (addr >> 10) & 0x03;
+        Byte *page = tblName.writablePage(nametablePage[quadrant]);
+        page[addr & 0x03FF] = data;
+        if (page != nametable[quadrant]) {
+            // The page was shared with a clone and has just been copied
+            mapNametables();
+        }
+    } else if (addr >= 0x3F00) {
+        // $3F10, $3F14, $3F18 and $3F1C are the backdrop entries of $3F00-$3F0C
         addr &= 0x001F;
-        if (addr == 0x0010) addr = 0x0000;
-        if (addr == 0x0014) addr = 0x0004;
-        if (addr == 0x0018) addr = 0x0008;
-        if (addr == 0x001C) addr = 0x000C;
+        if ((addr & 0x0013) == 0x0010) addr &= 0x000F;
         tblPalette[addr] = data;
     }
 }
@@ -68,27 +201,601 @@ Byte PPU::ppuRead(Address addr, bool bReadOnly) {
     Byte data = 0x00;
     addr &= 0x3FFF;
 
-    if (cart->ppuRead(addr, data)) {
-        // The cartridge "may" handle the read
-    } else if (addr >= 0x0000 && addr <= 0x1FFF) {
-        return cart->ppuRead(addr, data);
-    } else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        addr &= 0x0FFF;
-        if (cart->nCHRBanks == 0) {
-            data = tblPattern[0][addr];
-        }
-    } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
-        addr &= 0x001F;
-        if (addr == 0x0010) addr = 0x0000;
-        if (addr == 0x0014) addr = 0x0004;
-        if (addr == 0x0018) addr = 0x0008;
-        if (addr == 0x001C) addr = 0x000C;
-        return tblPalette[addr] & 0x3F;
+    if (CorePolicy::bInstrumented && debugger != nullptr && !bReadOnly
+        && (debugger->ppuPages[addr >> 8] & BreakType::READ)) {
+        debugger->ppuAccess(BreakType::READ, addr, ppuRead(addr, true));
+    }
+
+    if (addr <= 0x1FFF) {
+        cart->ppuRead(addr, data);
+        return data;
+    }
+    if (bMapperWatchesBus) {
+        cart->ppuRead(addr, data);
     }
 
-    return 0x00;
+    if (addr <= 0x3EFF) {
+        return nametable[(addr >> 10) & 0x03][addr & 0x03FF];
+    }
+    addr &= 0x001F;
+    if ((addr & 0x0013) == 0x0010) addr &= 0x000F;
+    return tblPalette[addr] & 0x3F;
+}
+
+// A background fetch from the nametables, which skips the decoding in
+// ppuRead() unless the mapper or a debugger has to see it
+Byte PPU::fetchNametable(Address addr) {
+    if (bMapperWatchesBus || (CorePolicy::bInstrumented && debugger != nullptr)) {
+        return ppuRead(addr);
+    }
+    return nametable[(addr >> 10) & 0x03][addr & 0x03FF];
+}
+
+void PPU::oamDMA(const Byte* page) {
+    // Two block copies either side of the point where the OAM address wraps
+    size_t nFirst = oam.size() - oamAddr;
+    std::memcpy(oam.data() + oamAddr, page, nFirst);
+    std::memcpy(oam.data(), page + nFirst, oamAddr);
 }
 
 void PPU::ConnectCartridge(const std::shared_ptr<Cartridge>& cartridge) {
     cart = cartridge;
-}
\ No newline at end of file
+    Mapper *mapper = cart->GetMapper();
+    if (mapper == nullptr) {
+        // No valid image; nothing will run
+        return;
+    }
+    bMapperWatchesBus = mapper->observesPPUBus();
+    nametableMirror = cart->Mirror();
+
+    // Four-screen boards carry the other 2 KB of nametable RAM themselves
+    size_t nSize = (nametableMirror == Mirroring::FOUR_SCREEN ? 4 : 2) * PagedMemory::PAGE_SIZE;
+    if (tblName.size() != nSize) {
+        tblName.resize(nSize);
+    }
+    mapNametables();
+}
+
+void PPU::reset() {
+    control = 0x00;
+    mask = 0x00;
+    status = 0x00;
+    oamAddr = 0x00;
+    vramAddr = 0x0000;
+    tramAddr = 0x0000;
+    fineX = 0x00;
+    addressLatch = 0x00;
+    ppuDataBuffer = 0x00;
+
+    scanline = 0;
+    cycle = 0;
+    oddFrame = false;
+    nmi = false;
+    frameComplete = false;
+
+    bgNextTileId = 0x00;
+    bgNextTileAttrib = 0x00;
+    bgNextTileLsb = 0x00;
+    bgNextTileMsb = 0x00;
+    bgShifterPatternLo = 0x0000;
+    bgShifterPatternHi = 0x0000;
+    bgShifterAttribLo = 0x0000;
+    bgShifterAttribHi = 0x0000;
+
+    secondaryOAM.fill(0xFF);
+    spriteCount = 0;
+    spriteZeroPicked = false;
+    spriteLine.fill(0x00);
+    spriteZeroOnLine = false;
+    // The rest of this frame already follows outputEnabled; skipping fetches
+    // waits for the next frame, which knows about the mapper
+    bSkipPixels = !outputEnabled;
+    bSkipFetches = false;
+    spriteZeroHitLine = -1;
+    // Reset starts a frame without passing the pre-render line
+    if (!bSkipPixels) {
+        dirtyLineMask.fill(0);
+        nFramesDrawn++;
+    }
+}
+
+void PPU::saveState(State &state) const {
+    state.tblName = tblName;
+    state.tblPalette = tblPalette;
+    state.oam = oam;
+    state.oamAddr = oamAddr;
+    state.secondaryOAM = secondaryOAM;
+    state.spriteCount = spriteCount;
+    state.spriteZeroPicked = spriteZeroPicked;
+    state.spritePatternLo = spritePatternLo;
+    state.spritePatternHi = spritePatternHi;
+    state.spriteLine = spriteLine;
+    state.spriteZeroOnLine = spriteZeroOnLine;
+    state.bSkipPixels = bSkipPixels;
+    state.bSkipFetches = bSkipFetches;
+    state.spriteZeroHitLine = spriteZeroHitLine;
+    state.spriteZeroHitCycle = spriteZeroHitCycle;
+    state.control = control;
+    state.mask = mask;
+    state.status = status;
+    state.vramAddr = vramAddr;
+    state.tramAddr = tramAddr;
+    state.fineX = fineX;
+    state.addressLatch = addressLatch;
+    state.ppuDataBuffer = ppuDataBuffer;
+    state.scanline = scanline;
+    state.cycle = cycle;
+    state.oddFrame = oddFrame;
+    state.nmi = nmi;
+    state.frameComplete = frameComplete;
+    state.bgNextTileId = bgNextTileId;
+    state.bgNextTileAttrib = bgNextTileAttrib;
+    state.bgNextTileLsb = bgNextTileLsb;
+    state.bgNextTileMsb = bgNextTileMsb;
+    state.bgShifterPatternLo = bgShifterPatternLo;
+    state.bgShifterPatternHi = bgShifterPatternHi;
+    state.bgShifterAttribLo = bgShifterAttribLo;
+    state.bgShifterAttribHi = bgShifterAttribHi;
+}
+
+void PPU::loadState(const State &state) {
+    tblName = state.tblName;
+    mapNametables();
+    tblPalette = state.tblPalette;
+    oam = state.oam;
+    oamAddr = state.oamAddr;
+    secondaryOAM = state.secondaryOAM;
+    spriteCount = state.spriteCount;
+    spriteZeroPicked = state.spriteZeroPicked;
+    spritePatternLo = state.spritePatternLo;
+    spritePatternHi = state.spritePatternHi;
+    spriteLine = state.spriteLine;
+    spriteZeroOnLine = state.spriteZeroOnLine;
+    bSkipPixels = state.bSkipPixels;
+    bSkipFetches = state.bSkipFetches;
+    spriteZeroHitLine = state.spriteZeroHitLine;
+    spriteZeroHitCycle = state.spriteZeroHitCycle;
+    control = state.control;
+    mask = state.mask;
+    status = state.status;
+    vramAddr = state.vramAddr;
+    tramAddr = state.tramAddr;
+    fineX = state.fineX;
+    addressLatch = state.addressLatch;
+    ppuDataBuffer = state.ppuDataBuffer;
+    scanline = state.scanline;
+    cycle = state.cycle;
+    oddFrame = state.oddFrame;
+    nmi = state.nmi;
+    frameComplete = state.frameComplete;
+    bgNextTileId = state.bgNextTileId;
+    bgNextTileAttrib = state.bgNextTileAttrib;
+    bgNextTileLsb = state.bgNextTileLsb;
+    bgNextTileMsb = state.bgNextTileMsb;
+    bgShifterPatternLo = state.bgShifterPatternLo;
+    bgShifterPatternHi = state.bgShifterPatternHi;
+    bgShifterAttribLo = state.bgShifterAttribLo;
+    bgShifterAttribHi = state.bgShifterAttribHi;
+}
+
+bool PPU::renderingEnabled() const {
+    return mask & (PPUMaskFlags::RENDER_BACKGROUND | PPUMaskFlags::RENDER_SPRITES);
+}
+
+void PPU::incrementScrollX() {
+    if ((vramAddr & 0x001F) == 31) {
+        // Wrap coarse X into the horizontally adjacent nametable
+        vramAddr &= ~0x001F;
+        vramAddr ^= 0x0400;
+    } else {
+        vramAddr++;
+    }
+}
+
+void PPU::incrementScrollY() {
+    if ((vramAddr & 0x7000) != 0x7000) {
+        vramAddr += 0x1000;
+        return;
+    }
+
+    vramAddr &= ~0x7000;
+    Byte coarseY = (vramAddr >> 5) & 0x1F;
+    if (coarseY == 29) {
+        // Row 29 is the last tile row; the attribute rows are skipped
+        coarseY = 0;
+        vramAddr ^= 0x0800;
+    } else if (coarseY == 31) {
+        coarseY = 0;
+    } else {
+        coarseY++;
+    }
+    vramAddr = (vramAddr & ~0x03E0) | (coarseY << 5);
+}
+
+void PPU::transferAddressX() {
+    vramAddr = (vramAddr & ~0x041F) | (tramAddr & 0x041F);
+}
+
+void PPU::transferAddressY() {
+    vramAddr = (vramAddr & ~0x7BE0) | (tramAddr & 0x7BE0);
+}
+
+void PPU::loadBackgroundShifters() {
+    bgShifterPatternLo = (bgShifterPatternLo & 0xFF00) | bgNextTileLsb;
+    bgShifterPatternHi = (bgShifterPatternHi & 0xFF00) | bgNextTileMsb;
+    bgShifterAttribLo = (bgShifterAttribLo & 0xFF00) | ((bgNextTileAttrib & 0x01) ? 0xFF : 0x00);
+    bgShifterAttribHi = (bgShifterAttribHi & 0xFF00) | ((bgNextTileAttrib & 0x02) ? 0xFF : 0x00);
+}
+
+void PPU::updateShifters() {
+    if (mask & PPUMaskFlags::RENDER_BACKGROUND) {
+        bgShifterPatternLo <<= 1;
+        bgShifterPatternHi <<= 1;
+        bgShifterAttribLo <<= 1;
+        bgShifterAttribHi <<= 1;
+    }
+}
+
+void PPU::evaluateSprites() {
+    spriteCount = 0;
+    spriteZeroPicked = false;
+    secondaryOAM.fill(0xFF);
+
+    if (scanline < 0) {
+        // Nothing is evaluated on the pre-render line, so line 0 has no sprites
+        return;
+    }
+
+    // Compare every OAM byte against the line at once and keep the hits on Y
+    // bytes. A sprite is on the next line when 0 <= scanline - Y < height;
+    // the first test stops sprites near the bottom wrapping round to the top.
+    Byte height = (control & PPUControlFlags::SPRITE_SIZE) ? 16 : 8;
+    LaneVector line = vSet((Byte)scanline);
+    uint64_t yLanes = 0x1111111111111111ULL;
+    if constexpr (LANE_VECTOR_WIDTH < 64) {
+        yLanes &= (1ULL << LANE_VECTOR_WIDTH) - 1;
+    }
+
+    std::array<uint64_t, 4> inRange{};
+    size_t nStep = LANE_VECTOR_WIDTH < 4 ? 4 : LANE_VECTOR_WIDTH;
+    for (size_t i = 0; i < oam.size(); i += nStep) {
+        LaneVector y = vLoad(oam.data() + i);
+        LaneVector hit = vAnd(vGeU(line, y), vNot(vGeU(vSub(line, y), vSet(height))));
+        inRange[i / 64] |= (vMaskBits(hit) & yLanes) << (i % 64);
+    }
+
+    // Copy the first eight in OAM order; a ninth raises the overflow flag.
+    // (The hardware's buggy search can miss or invent an overflow in rare
+    // layouts; this reports the plain count.)
+    for (size_t word = 0; word < inRange.size(); word++) {
+        uint64_t bits = inRange[word];
+        while (bits != 0) {
+            size_t n = (word * 64 + __builtin_ctzll(bits)) / 4;
+            bits &= bits - 1;
+
+            if (spriteCount == 8) {
+                status |= PPUStatusFlags::SPRITE_OVERFLOW;
+                return;
+            }
+
+            std::memcpy(&secondaryOAM[spriteCount * 4], &oam[n * 4], 4);
+            spriteZeroPicked |= n == 0;
+            spriteCount++;
+        }
+    }
+}
+
+Address PPU::spritePatternAddress(uint8_t slot) {
+    // Empty slots still fetch tile $FF, as the hardware does
+    Byte y = secondaryOAM[slot * 4];
+    Byte tile = secondaryOAM[slot * 4 + 1];
+    Byte attrib = secondaryOAM[slot * 4 + 2];
+    Byte row = slot < spriteCount ? (Byte)(scanline - y) : 0;
+
+    if (control & PPUControlFlags::SPRITE_SIZE) {
+        // 8x16 sprites pick their table from bit 0 of the tile number
+        if (attrib & 0x80) row = 15 - row;
+        Address table = (tile & 0x01) << 12;
+        tile = (tile & 0xFE) + (row >> 3);
+        return table + ((Address)tile << 4) + (row & 0x07);
+    }
+
+    if (attrib & 0x80) row = 7 - row;
+    return ((control & PPUControlFlags::PATTERN_SPRITE) << 9) + ((Address)tile << 4) + row;
+}
+
+void PPU::logTileRow(Address pattern) {
+    // Both bit planes of the row are drawn together
+    cdl->chr(pattern, CDLChr::RENDERED);
+    cdl->chr(pattern + 8, CDLChr::RENDERED);
+}
+
+void PPU::buildSpriteLine() {
+    spriteLine.fill(0x00);
+    spriteZeroOnLine = false;
+
+    // Lower OAM entries win, so draw from the last slot up to the first
+    for (int slot = spriteCount - 1; slot >= 0; slot--) {
+        Byte attrib = secondaryOAM[slot * 4 + 2];
+        Byte x = secondaryOAM[slot * 4 + 3];
+        Byte lo = spritePatternLo[slot];
+        Byte hi = spritePatternHi[slot];
+
+        Byte flags = ((attrib & 0x03) << 2) | ((attrib & 0x20) ? SpriteLine::BEHIND_BACKGROUND : 0);
+        bool bSpriteZero = slot == 0 && spriteZeroPicked;
+        if (bSpriteZero) {
+            flags |= SpriteLine::SPRITE_ZERO;
+        }
+
+        for (uint16_t i = 0; i < 8 && x + i < SCREEN_WIDTH; i++) {
+            uint8_t bit = (attrib & 0x40) ? i : 7 - i;
+            Byte pixel = (((hi >> bit) & 0x01) << 1) | ((lo >> bit) & 0x01);
+            if (pixel != 0 && (x + i >= 8 || (mask & PPUMaskFlags::RENDER_SPRITES_LEFT))) {
+                spriteLine[x + i] = flags | pixel;
+                spriteZeroOnLine |= bSpriteZero;
+            }
+        }
+    }
+}
+
+void PPU::compositeLine() {
+    // Priority between the two layers for the whole line, a vector at a time,
+    // giving the palette RAM index of each pixel
+    std::array<Byte, SCREEN_WIDTH> index;
+    LaneVector zero = vSet(0x00);
+    LaneVector spritesOn = vSet((mask & PPUMaskFlags::RENDER_SPRITES) ? 0xFF : 0x00);
+
+    for (size_t x = 0; x < SCREEN_WIDTH; x += LANE_VECTOR_WIDTH) {
+        LaneVector bg = vLoad(bgLine.data() + x);
+        LaneVector sp = vAnd(vLoad(spriteLine.data() + x), spritesOn);
+
+        LaneVector bgOpaque = vNot(vEq(bg, zero));
+        LaneVector spOpaque = vNot(vEq(vAnd(sp, vSet(0x03)), zero));
+        LaneVector behind = vNot(vEq(vAnd(sp, vSet(SpriteLine::BEHIND_BACKGROUND)), zero));
+        LaneVector useSprite = vAnd(spOpaque, vNot(vAnd(behind, bgOpaque)));
+
+        // Sprite palettes are entries 0x10-0x1F of palette RAM
+        LaneVector spIndex = vOr(vAnd(sp, vSet(0x0F)), vSet(0x10));
+        vStore(index.data() + x, vSelect(useSprite, spIndex, bg));
+    }
+
+    // Colour 0 of every palette shows the universal backdrop
+    Byte greyscale = (mask & PPUMaskFlags::GRAYSCALE) ? 0x30 : 0x3F;
+    if (frameBuffer.empty()) {
+        frameBuffer.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+    }
+    Byte* row = frameBuffer.data() + scanline * SCREEN_WIDTH;
+    Byte changed = 0x00;
+    for (size_t x = 0; x < SCREEN_WIDTH; x++) {
+        Byte i = index[x];
+        Byte colour = tblPalette[(i & 0x03) == 0 ? 0 : i] & greyscale;
+        changed |= row[x] ^ colour;
+        row[x] = colour;
+    }
+    if (changed != 0x00) {
+        dirtyLineMask[scanline / 64] |= 1ull << (scanline % 64);
+    }
+}
+
+void PPU::predictSpriteZeroHit() {
+    // Called at the end of line S's sprite fetches with the VRAM address
+    // already set up for line S + 1. Only sprite 0's pattern and the (at most
+    // two) background tiles under it are fetched; this assumes neither the
+    // scroll nor the mask changes partway through the line. The real PPU
+    // makes none of these reads, so they are peeks.
+    int16_t line = scanline + 1;
+    if (!spriteZeroPicked || line >= 240
+        || !(mask & PPUMaskFlags::RENDER_BACKGROUND) || !(mask & PPUMaskFlags::RENDER_SPRITES)) {
+        return;
+    }
+
+    Byte attrib = secondaryOAM[2];
+    Byte spriteX = secondaryOAM[3];
+    Byte spriteLo = ppuRead(spritePatternAddress(0), true);
+    Byte spriteHi = ppuRead(spritePatternAddress(0) + 8, true);
+
+    // Opaque pixels of the two background tiles sprite 0 can overlap
+    LargeRegister v = vramAddr;
+    uint16_t nFirstTile = (spriteX + fineX) / 8;
+    Byte bgOpaque[2] = { 0x00, 0x00 };
+    Address table = (control & PPUControlFlags::PATTERN_BACKGROUND) << 8;
+
+    for (uint16_t t = 0; t <= nFirstTile + 1; t++) {
+        if (t >= nFirstTile) {
+            Address tile = nametable[(v >> 10) & 0x03][v & 0x03FF];
+            Address pattern = table + (tile << 4) + ((v >> 12) & 0x07);
+            bgOpaque[t - nFirstTile] = ppuRead(pattern, true) | ppuRead(pattern + 8, true);
+        }
+        // Same horizontal wrap as incrementScrollX
+        v = ((v & 0x001F) == 31) ? ((v & ~0x001F) ^ 0x0400) : v + 1;
+    }
+
+    for (uint16_t i = 0; i < 8; i++) {
+        uint16_t x = spriteX + i;
+        if (x >= 255) {
+            break;
+        }
+
+        uint8_t bit = (attrib & 0x40) ? i : 7 - i;
+        bool bSprite = ((spriteLo | spriteHi) >> bit) & 0x01;
+        if (x < 8 && (!(mask & PPUMaskFlags::RENDER_SPRITES_LEFT) || !(mask & PPUMaskFlags::RENDER_BACKGROUND_LEFT))) {
+            bSprite = false;
+        }
+
+        uint16_t fine = x + fineX;
+        bool bBackground = (bgOpaque[fine / 8 - nFirstTile] >> (7 - fine % 8)) & 0x01;
+        if (bSprite && bBackground) {
+            spriteZeroHitLine = line;
+            spriteZeroHitCycle = x + 1;
+            return;
+        }
+    }
+}
+
+void PPU::resolveSpriteZeroHit() {
+    if (spriteZeroHitLine < 0) {
+        return;
+    }
+
+    if (scanline > spriteZeroHitLine || (scanline == spriteZeroHitLine && cycle > spriteZeroHitCycle)) {
+        status |= PPUStatusFlags::SPRITE_ZERO_HIT;
+        spriteZeroHitLine = -1;
+    }
+}
+
+void PPU::clock() {
+    if (scanline == -1 && cycle == 0) {
+        bSkipPixels = !outputEnabled;
+        bSkipFetches = bSkipPixels && !bMapperWatchesBus
+            && (!CorePolicy::bInstrumented || cdl == nullptr);
+        if (!bSkipPixels) {
+            dirtyLineMask.fill(0);
+            nFramesDrawn++;
+        }
+    }
+
+    if (scanline >= -1 && scanline < 240 && renderingEnabled()) {
+        if (scanline == 0 && cycle == 0 && oddFrame) {
+            // Odd frames drop the idle dot when rendering
+            cycle = 1;
+        }
+
+        if (bSkipFetches && ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338))) {
+            // Nothing will use the tiles; only the address keeps moving
+            if ((cycle - 1) % 8 == 7) {
+                incrementScrollX();
+            }
+        } else if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338)) {
+            updateShifters();
+
+            switch ((cycle - 1) % 8) {
+            case 0:
+                loadBackgroundShifters();
+                bgNextTileId = fetchNametable(0x2000 | (vramAddr & 0x0FFF));
+                break;
+            case 2:
+                bgNextTileAttrib = fetchNametable(0x23C0 | (vramAddr & 0x0C00)
+                    | ((vramAddr >> 4) & 0x38) | ((vramAddr >> 2) & 0x07));
+                if (vramAddr & 0x0040) bgNextTileAttrib >>= 4;
+                if (vramAddr & 0x0002) bgNextTileAttrib >>= 2;
+                bgNextTileAttrib &= 0x03;
+                break;
+            case 4:
+                bgNextTileLsb = ppuRead(((control & PPUControlFlags::PATTERN_BACKGROUND) << 8)
+                    + ((Address)bgNextTileId << 4) + ((vramAddr >> 12) & 0x07));
+                if (CorePolicy::bInstrumented && cdl != nullptr) {
+                    logTileRow(((control & PPUControlFlags::PATTERN_BACKGROUND) << 8)
+                        + ((Address)bgNextTileId << 4) + ((vramAddr >> 12) & 0x07));
+                }
+                break;
+            case 6:
+                bgNextTileMsb = ppuRead(((control & PPUControlFlags::PATTERN_BACKGROUND) << 8)
+                    + ((Address)bgNextTileId << 4) + ((vramAddr >> 12) & 0x07) + 8);
+                break;
+            case 7:
+                incrementScrollX();
+                break;
+            }
+        }
+
+        if (cycle == 256) {
+            incrementScrollY();
+        }
+
+        if (cycle == 257) {
+            loadBackgroundShifters();
+            transferAddressX();
+            evaluateSprites();
+        }
+
+        if (cycle >= 257 && cycle <= 320) {
+            // Sprite pattern fetches: two nametable accesses then the tile
+            // planes of each picked sprite. These put the A12 edges on the
+            // bus that scanline-counting mappers rely on.
+            uint8_t slot = (cycle - 257) / 8;
+            oamAddr = 0x00;
+            if (!bSkipFetches) {
+                switch ((cycle - 257) % 8) {
+                case 0: case 2: fetchNametable(0x2000 | (vramAddr & 0x0FFF)); break;
+                case 4: spritePatternLo[slot] = ppuRead(spritePatternAddress(slot)); break;
+                case 6: spritePatternHi[slot] = ppuRead(spritePatternAddress(slot) + 8); break;
+                }
+
+                if (CorePolicy::bInstrumented && cdl != nullptr && slot < spriteCount && (cycle - 257) % 8 == 4) {
+                    // Empty slots fetch tile $FF without drawing it
+                    logTileRow(spritePatternAddress(slot));
+                }
+            }
+
+            if (cycle == 320) {
+                if (bSkipFetches) {
+                    predictSpriteZeroHit();
+                } else {
+                    buildSpriteLine();
+                }
+            }
+        }
+
+        if (!bSkipFetches && (cycle == 338 || cycle == 340)) {
+            bgNextTileId = fetchNametable(0x2000 | (vramAddr & 0x0FFF));
+        }
+
+        if (scanline == -1 && cycle >= 280 && cycle < 305) {
+            transferAddressY();
+        }
+    }
+
+    if (scanline == -1 && cycle == 1) {
+        status &= ~(PPUStatusFlags::VERTICAL_BLANK | PPUStatusFlags::SPRITE_ZERO_HIT | PPUStatusFlags::SPRITE_OVERFLOW);
+        spriteZeroHitLine = -1;
+    }
+
+    if (scanline == 241 && cycle == 1) {
+        status |= PPUStatusFlags::VERTICAL_BLANK;
+        if (control & PPUControlFlags::ENABLE_NMI) {
+            nmi = true;
+        }
+    }
+
+    if (!bSkipFetches && scanline >= 0 && scanline < 240 && cycle >= 1 && cycle <= 256) {
+        Byte bgPixel = 0x00;
+        Byte bgPalette = 0x00;
+
+        if ((mask & PPUMaskFlags::RENDER_BACKGROUND) && (cycle > 8 || (mask & PPUMaskFlags::RENDER_BACKGROUND_LEFT))) {
+            uint16_t bitMux = 0x8000 >> fineX;
+            bgPixel = (((bgShifterPatternHi & bitMux) > 0) << 1) | ((bgShifterPatternLo & bitMux) > 0);
+            bgPalette = (((bgShifterAttribHi & bitMux) > 0) << 1) | ((bgShifterAttribLo & bitMux) > 0);
+        }
+
+        uint8_t x = cycle - 1;
+        if (!bSkipPixels) {
+            bgLine[x] = bgPixel == 0 ? 0x00 : (bgPalette << 2) | bgPixel;
+        }
+
+        // Sprite 0 hit is raised on the exact dot an opaque sprite 0 pixel
+        // meets opaque background, never on the last column
+        if (spriteZeroOnLine && bgPixel != 0 && x != 255 && (spriteLine[x] & SpriteLine::SPRITE_ZERO)
+            && (mask & PPUMaskFlags::RENDER_SPRITES)) {
+            status |= PPUStatusFlags::SPRITE_ZERO_HIT;
+        }
+
+        if (cycle == 256 && !bSkipPixels) {
+            compositeLine();
+        }
+    }
+
+    cycle++;
+    if (cycle >= 341) {
+        cycle = 0;
+        scanline++;
+        if (scanline == 240) {
+            // Any hit still pending happened during the picture
+            resolveSpriteZeroHit();
+        }
+        if (scanline >= 261) {
+            scanline = -1;
+            frameComplete = true;
+            oddFrame = !oddFrame;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#include "../include/PagedMemory.hpp"
+
+PagedMemory::PagedMemory() {}
+
+PagedMemory::PagedMemory(size_t nSize) {
+    resize(nSize);
+}
+
+void PagedMemory::resize(size_t nSize) {
+    pages.clear();
+    for (size_t i = 0; i < (nSize + PAGE_SIZE - 1) / PAGE_SIZE; i++) {
+        pages.push_back(InstanceArena::makeShared<Page>());
+    }
+}
+
+size_t PagedMemory::size() const {
+    return pages.size() * PAGE_SIZE;
+}
+
+bool PagedMemory::empty() const {
+    return pages.empty();
+}
+
+size_t PagedMemory::privatePages() const {
+    size_t nPrivate = 0;
+    for (const auto &p : pages) {
+        nPrivate += p.use_count() == 1;
+    }
+    return nPrivate;
+}
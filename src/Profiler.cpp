@@ -0,0 +1,253 @@
+#include "../include/Profiler.hpp"
+#include "../include/Bus.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+// The deepest a 256-byte stack can nest with two bytes per call
+static constexpr size_t MAX_STACK_DEPTH = 128;
+
+static bool isBackwardJump(Opcode opcode) {
+    // Bxx are $10, $30 ... $F0; JMP absolute and indirect
+    return (opcode & 0x1F) == 0x10 || opcode == 0x4C || opcode == 0x6C;
+}
+
+Profiler::Profiler() {
+    vStack.reserve(MAX_STACK_DEPTH);
+    clear();
+}
+
+Profiler::~Profiler() {
+    detach();
+}
+
+bool Profiler::attach(Bus& b) {
+#ifdef NES_PROFILER
+    detach();
+    bus = &b;
+    bus->cpu.profiler = this;
+    ensureLocations(0x8000 + (uint32_t)bus->cart->pPRGMemory->size());
+    return true;
+#else
+    (void)b;
+    return false;
+#endif
+}
+
+void Profiler::detach() {
+    if (bus != nullptr && bus->cpu.profiler == this) {
+        bus->cpu.profiler = nullptr;
+    }
+    bus = nullptr;
+}
+
+void Profiler::clear() {
+    std::fill(vCycles.begin(), vCycles.end(), 0);
+    std::fill(vBackEdges.begin(), vBackEdges.end(), BackEdge{0, 0, 0});
+
+    vNodes.clear();
+    vNodes.push_back({0, 0, 0, ProfilerFrame::CALL, 0});
+    children.clear();
+    vStack.clear();
+    nCurrentNode = 0;
+    nTotalCycles = 0;
+}
+
+uint32_t Profiler::location(Address pc) const {
+    if (pc < 0x8000) {
+        return pc;
+    }
+    return 0x8000 + bus->cart->pMapper->prgBankBase(pc) + (pc & 0x1FFF);
+}
+
+void Profiler::ensureLocations(uint32_t n) {
+    if (vCycles.size() < n) {
+        vCycles.resize(n, 0);
+        vBackEdges.resize(n, BackEdge{0, 0, 0});
+    }
+}
+
+void Profiler::instruction(Address pc, Opcode opcode, Address nextPC, Register sp, uint8_t cycles) {
+    uint32_t at = location(pc);
+    if (at >= vCycles.size()) {
+        // A bigger cartridge went in since attach()
+        ensureLocations(0x8000 + (uint32_t)bus->cart->pPRGMemory->size());
+    }
+
+    vCycles[at] += cycles;
+    vNodes[nCurrentNode].nCycles += cycles;
+    nTotalCycles += cycles;
+
+    switch (opcode) {
+    case 0x20: // JSR
+        enter(ProfilerFrame::CALL, nextPC, sp);
+        break;
+    case 0x60: // RTS pulled two bytes
+        leave(sp - 2);
+        break;
+    case 0x40: // RTI pulled three
+        leave(sp - 3);
+        break;
+    default:
+        if (nextPC <= pc && isBackwardJump(opcode)) {
+            BackEdge &edge = vBackEdges[at];
+            edge.nTaken++;
+            edge.head = nextPC;
+            edge.tail = pc;
+        }
+        break;
+    }
+}
+
+void Profiler::interrupt(ProfilerFrame::Kind kind, Address handler, Register sp, uint8_t cycles) {
+    enter(kind, handler, sp);
+    vNodes[nCurrentNode].nCycles += cycles;
+    nTotalCycles += cycles;
+}
+
+void Profiler::enter(ProfilerFrame::Kind kind, Address entry, Register sp) {
+    if (vStack.size() == MAX_STACK_DEPTH) {
+        // Only a stack that is never unwound gets here; start over from the top
+        vStack.clear();
+        nCurrentNode = 0;
+    }
+
+    uint32_t at = location(entry);
+    uint64_t key = ((uint64_t)nCurrentNode << 32) | ((uint64_t)kind << 28) | at;
+    auto child = children.find(key);
+    uint32_t node;
+    if (child == children.end()) {
+        node = (uint32_t)vNodes.size();
+        vNodes.push_back({nCurrentNode, at, entry, kind, 0});
+        children.emplace(key, node);
+    } else {
+        node = child->second;
+    }
+
+    vStack.push_back({node, sp});
+    nCurrentNode = node;
+}
+
+void Profiler::leave(Register sp) {
+    // Frames below the stack pointer the return starts from were abandoned
+    while (!vStack.empty() && vStack.back().sp < sp) {
+        vStack.pop_back();
+    }
+    // A return from deeper down is an RTS used as a jump and leaves the frame be
+    if (!vStack.empty() && vStack.back().sp == sp) {
+        vStack.pop_back();
+    }
+    nCurrentNode = vStack.empty() ? 0 : vStack.back().node;
+}
+
+uint64_t Profiler::cyclesAt(Address pc) const {
+    if (bus == nullptr) {
+        return 0;
+    }
+    uint32_t at = location(pc);
+    return at < vCycles.size() ? vCycles[at] : 0;
+}
+
+static std::string locationName(uint32_t location, Address address) {
+    char text[16];
+    if (location < 0x8000) {
+        std::snprintf(text, sizeof(text), "ram:%04X", address);
+    } else {
+        std::snprintf(text, sizeof(text), "%02X:%04X", (location - 0x8000) >> 13, address);
+    }
+    return text;
+}
+
+std::string Profiler::nodeName(const Node& node) const {
+    switch (node.kind) {
+    case ProfilerFrame::NMI:
+        return "NMI " + locationName(node.location, node.address);
+    case ProfilerFrame::IRQ:
+        return "IRQ " + locationName(node.location, node.address);
+    default:
+        return locationName(node.location, node.address);
+    }
+}
+
+void Profiler::writeFoldedStacks(std::ostream& out) const {
+    std::vector<uint32_t> path;
+    for (uint32_t i = 0; i < vNodes.size(); i++) {
+        if (vNodes[i].nCycles == 0) {
+            continue;
+        }
+
+        path.clear();
+        for (uint32_t node = i; node != 0; node = vNodes[node].parent) {
+            path.push_back(node);
+        }
+
+        out << "main";
+        for (auto node = path.rbegin(); node != path.rend(); ++node) {
+            out << ';' << nodeName(vNodes[*node]);
+        }
+        out << ' ' << vNodes[i].nCycles << '\n';
+    }
+}
+
+std::string Profiler::disassembly(Address pc) const {
+    std::map<Address, std::string> lines = bus->cpu.Disassemble(pc, pc);
+    return lines.empty() ? std::string() : lines.begin()->second;
+}
+
+std::vector<Profiler::HotLoop> Profiler::hotLoops(size_t n) const {
+    std::vector<HotLoop> loops;
+    for (uint32_t at = 0; at < vBackEdges.size(); at++) {
+        const BackEdge &edge = vBackEdges[at];
+        if (edge.nTaken == 0) {
+            continue;
+        }
+
+        // The loop body sits just before the branch in the same bank
+        uint32_t length = edge.tail - edge.head;
+        uint32_t first = at >= length ? at - length : 0;
+        uint64_t cycles = 0;
+        for (uint32_t i = first; i <= at; i++) {
+            cycles += vCycles[i];
+        }
+
+        int32_t bank = at < 0x8000 ? -1 : (int32_t)((at - 0x8000) >> 13);
+        loops.push_back({bank, edge.head, edge.tail, edge.nTaken, cycles, ""});
+    }
+
+    n = std::min(n, loops.size());
+    std::partial_sort(loops.begin(), loops.begin() + n, loops.end(),
+        [](const HotLoop& a, const HotLoop& b) { return a.cycles > b.cycles; });
+    loops.resize(n);
+
+    if (bus != nullptr) {
+        for (HotLoop &loop : loops) {
+            // ROM code is only labelled while its bank is still mapped; RAM code
+            // is labelled as it is now
+            bool bMapped = loop.bank < 0
+                || (location(loop.tail) - 0x8000) >> 13 == (uint32_t)loop.bank;
+            if (bMapped) {
+                loop.label = disassembly(loop.head);
+                if (loop.tail != loop.head) {
+                    loop.label += " .. " + disassembly(loop.tail);
+                }
+            }
+        }
+    }
+
+    return loops;
+}
+
+void Profiler::writeHotLoops(std::ostream& out, size_t n) const {
+    char line[96];
+    for (const HotLoop &loop : hotLoops(n)) {
+        double share = nTotalCycles == 0 ? 0.0 : 100.0 * loop.cycles / nTotalCycles;
+        if (loop.bank < 0) {
+            std::snprintf(line, sizeof(line), "ram  $%04X-$%04X %12llu cycles %6.2f%% %10llu iterations  ",
+                loop.head, loop.tail, (unsigned long long)loop.cycles, share, (unsigned long long)loop.iterations);
+        } else {
+            std::snprintf(line, sizeof(line), "%02X   $%04X-$%04X %12llu cycles %6.2f%% %10llu iterations  ",
+                loop.bank, loop.head, loop.tail, (unsigned long long)loop.cycles, share, (unsigned long long)loop.iterations);
+        }
+        out << line << loop.label << '\n';
+    }
+}
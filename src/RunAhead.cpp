@@ -0,0 +1,83 @@
+#include "../include/RunAhead.hpp"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t nanosecondsSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+RunAhead::RunAhead(Bus& b) : bus(b) {
+
+}
+
+RunAhead::~RunAhead() {
+
+}
+
+void RunAhead::setFrames(uint32_t n) {
+    nFrames = n;
+    resetStats();
+}
+
+uint32_t RunAhead::frames() const {
+    return nFrames;
+}
+
+void RunAhead::runFrame() {
+    bus.clockFrame();
+    nEmulatedFrames++;
+}
+
+void RunAhead::frame() {
+    Clock::time_point start = Clock::now();
+
+    if (nFrames == 0) {
+        runFrame();
+        nRealNanoseconds += nanosecondsSince(start);
+        nDisplayedFrames++;
+        return;
+    }
+
+    // The real frame is never shown; the look-ahead frame replaces it. Only
+    // that one is drawn, and only if the caller wants video at all.
+    bool bOutput = bus.ppu.outputEnabled;
+    bus.ppu.outputEnabled = false;
+    runFrame();
+    nRealNanoseconds += nanosecondsSince(start);
+
+    start = Clock::now();
+    bus.saveState(state);
+
+    for (uint32_t i = 1; i < nFrames; i++) {
+        runFrame();
+    }
+
+    bus.ppu.outputEnabled = bOutput;
+    runFrame();
+
+    // The frame buffer is not part of the state, so it keeps the frame just drawn
+    bus.loadState(state);
+    nExtraNanoseconds += nanosecondsSince(start);
+    nDisplayedFrames++;
+}
+
+void RunAhead::resetStats() {
+    nDisplayedFrames = 0;
+    nEmulatedFrames = 0;
+    nRealNanoseconds = 0;
+    nExtraNanoseconds = 0;
+}
+
+double RunAhead::realFrameMicroseconds() const {
+    return nDisplayedFrames == 0 ? 0.0 : nRealNanoseconds / 1000.0 / nDisplayedFrames;
+}
+
+double RunAhead::extraMicroseconds() const {
+    return nDisplayedFrames == 0 ? 0.0 : nExtraNanoseconds / 1000.0 / nDisplayedFrames;
+}
+
+double RunAhead::extraMicrosecondsPerLagFrame() const {
+    return nFrames == 0 ? 0.0 : extraMicroseconds() / nFrames;
+}
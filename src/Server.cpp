@@ -0,0 +1,462 @@
+#include "../include/Server.hpp"
+#include "../include/ServerProtocol.hpp"
+#include "../include/Bus.hpp"
+#include "../include/StateHash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+struct Server::Instance {
+    Bus bus;
+    std::shared_ptr<Cartridge> cart;
+    std::map<uint32_t, Bus::State> states;
+    uint64_t nFrames = 0;
+    // The memfd mapped writable; the client maps the same pages read-only
+    Byte *view = nullptr;
+
+    ~Instance();
+};
+
+struct Server::Connection {
+    // Indexed by instance id; destroyed ones leave a null to be reused
+    std::vector<std::unique_ptr<Instance>> vInstances;
+    StateHash hash;
+
+    Instance* find(uint32_t id) {
+        return id < vInstances.size() ? vInstances[id].get() : nullptr;
+    }
+};
+
+// Takes fields off a request, failing once it runs out
+struct Reader {
+    const Byte *p;
+    size_t nLeft;
+
+    template <typename T>
+    bool take(T& value) {
+        if (nLeft < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        nLeft -= sizeof(T);
+        return true;
+    }
+};
+
+template <typename T>
+static void append(std::vector<Byte>& v, T value) {
+    const Byte *bytes = (const Byte*)&value;
+    v.insert(v.end(), bytes, bytes + sizeof(T));
+}
+
+#ifdef __linux__
+
+Server::Instance::~Instance() {
+    if (view != nullptr) {
+        munmap(view, ServerView::SIZE);
+    }
+}
+
+static bool readAll(int fd, void* pData, size_t nSize) {
+    Byte *p = (Byte*)pData;
+    while (nSize > 0) {
+        ssize_t n = recv(fd, p, nSize, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        nSize -= n;
+    }
+    return true;
+}
+
+// Sends the message with the descriptors attached to its first bytes
+static bool writeAll(int fd, const std::vector<Byte>& vMessage, const std::vector<int>& vDescriptors) {
+    const Byte *p = vMessage.data();
+    size_t nSize = vMessage.size();
+
+    if (!vDescriptors.empty()) {
+        std::vector<char> control(CMSG_SPACE(vDescriptors.size() * sizeof(int)));
+        iovec iov = { (void*)p, nSize };
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(vDescriptors.size() * sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), vDescriptors.data(), vDescriptors.size() * sizeof(int));
+
+        ssize_t n;
+        do {
+            n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        nSize -= n;
+    }
+
+    while (nSize > 0) {
+        ssize_t n = send(fd, p, nSize, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        nSize -= n;
+    }
+    return true;
+}
+
+Server::~Server() {
+    stop();
+    for (std::thread &thread : vThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    if (nListen >= 0) {
+        close(nListen);
+        unlink(sPath.c_str());
+    }
+}
+
+bool Server::listen(const std::string& sSocketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (nListen >= 0 || sSocketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, sSocketPath.c_str(), sSocketPath.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    unlink(sSocketPath.c_str());
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return false;
+    }
+
+    sPath = sSocketPath;
+    nListen = fd;
+    return true;
+}
+
+void Server::serve() {
+    while (nListen >= 0 && !bStopping) {
+        int fd = accept4(nListen, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (bStopping) {
+            close(fd);
+            break;
+        }
+        reapConnections();
+        vSockets.push_back(fd);
+        nConnections++;
+        vThreads.emplace_back(&Server::serveConnection, this, fd);
+    }
+
+    std::vector<std::thread> vDone;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        vDone.swap(vThreads);
+        vFinished.clear();
+    }
+    for (std::thread &thread : vDone) {
+        thread.join();
+    }
+}
+
+void Server::reapConnections() {
+    for (std::thread::id id : vFinished) {
+        auto thread = std::find_if(vThreads.begin(), vThreads.end(),
+            [id](const std::thread& t) { return t.get_id() == id; });
+        if (thread != vThreads.end()) {
+            // It is past its last use of the lock and about to return
+            thread->join();
+            vThreads.erase(thread);
+        }
+    }
+    vFinished.clear();
+}
+
+void Server::stop() {
+    bStopping = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nListen >= 0) {
+        // Wakes accept()
+        shutdown(nListen, SHUT_RDWR);
+    }
+    for (int fd : vSockets) {
+        shutdown(fd, SHUT_RDWR);
+    }
+}
+
+void Server::serveConnection(int fd) {
+    Connection connection;
+    std::vector<Byte> vRequest, vResponse;
+    std::vector<int> vDescriptors;
+
+    for (;;) {
+        uint32_t nSize = 0;
+        if (!readAll(fd, &nSize, sizeof(nSize)) || nSize > SERVER_MAX_REQUEST) {
+            break;
+        }
+        vRequest.resize(nSize);
+        if (!readAll(fd, vRequest.data(), nSize)) {
+            break;
+        }
+
+        vDescriptors.clear();
+        bool bOk = execute(connection, vRequest, vResponse, vDescriptors);
+        bOk = bOk && writeAll(fd, vResponse, vDescriptors);
+        // The client has its own copies now; the mappings stay
+        for (int descriptor : vDescriptors) {
+            close(descriptor);
+        }
+        if (!bOk) {
+            break;
+        }
+    }
+
+    nConnections--;
+    std::lock_guard<std::mutex> lock(mutex);
+    vSockets.erase(std::find(vSockets.begin(), vSockets.end(), fd));
+    close(fd);
+    // Joined by serve() when it next accepts, or when it returns
+    vFinished.push_back(std::this_thread::get_id());
+}
+
+bool Server::execute(Connection& connection, const std::vector<Byte>& vRequest, std::vector<Byte>& vResponse,
+    std::vector<int>& vDescriptors) {
+    Reader request{ vRequest.data(), vRequest.size() };
+    uint16_t nCommands = 0;
+    if (!request.take(nCommands)) {
+        return false;
+    }
+
+    vResponse.clear();
+    append<uint32_t>(vResponse, 0);
+    append(vResponse, nCommands);
+    for (uint16_t i = 0; i < nCommands; i++) {
+        uint8_t command = 0;
+        uint32_t id = 0, nArgs = 0;
+        if (!request.take(command) || !request.take(id) || !request.take(nArgs) || nArgs > request.nLeft) {
+            return false;
+        }
+        const Byte *args = request.p;
+        request.p += nArgs;
+        request.nLeft -= nArgs;
+
+        size_t nStatusAt = vResponse.size();
+        append<int8_t>(vResponse, 0);
+        append<uint32_t>(vResponse, 0);
+        size_t nDataAt = vResponse.size();
+
+        int8_t status = run(connection, command, id, args, nArgs, vResponse, vDescriptors);
+        uint32_t nData = vResponse.size() - nDataAt;
+        std::memcpy(vResponse.data() + nStatusAt, &status, sizeof(status));
+        std::memcpy(vResponse.data() + nStatusAt + sizeof(status), &nData, sizeof(nData));
+    }
+
+    uint32_t nSize = vResponse.size() - sizeof(uint32_t);
+    std::memcpy(vResponse.data(), &nSize, sizeof(nSize));
+    return true;
+}
+
+int8_t Server::create(Connection& connection, std::vector<Byte>& vData, std::vector<int>& vDescriptors) {
+    // One SCM_RIGHTS message carries at most 253 descriptors
+    if (vDescriptors.size() >= 253) {
+        return ServerStatus::BAD_COMMAND;
+    }
+
+    int fd = memfd_create("nes-view", MFD_CLOEXEC);
+    if (fd < 0) {
+        return ServerStatus::NO_MEMORY;
+    }
+    void *view = MAP_FAILED;
+    if (ftruncate(fd, ServerView::SIZE) == 0) {
+        view = mmap(nullptr, ServerView::SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (view == MAP_FAILED) {
+        close(fd);
+        return ServerStatus::NO_MEMORY;
+    }
+
+    std::unique_ptr<Instance> instance = std::make_unique<Instance>();
+    instance->view = (Byte*)view;
+    instance->bus.ppu.outputEnabled = false;
+
+    std::vector<std::unique_ptr<Instance>> &vInstances = connection.vInstances;
+    uint32_t id = std::find(vInstances.begin(), vInstances.end(), nullptr) - vInstances.begin();
+    if (id == vInstances.size()) {
+        vInstances.push_back(std::move(instance));
+    } else {
+        vInstances[id] = std::move(instance);
+    }
+    vDescriptors.push_back(fd);
+    append(vData, id);
+    return ServerStatus::OK;
+}
+
+int8_t Server::run(Connection& connection, uint8_t command, uint32_t id, const Byte* pArgs, size_t nArgs,
+    std::vector<Byte>& vData, std::vector<int>& vDescriptors) {
+    if (command == ServerCommand::CREATE) {
+        return create(connection, vData, vDescriptors);
+    }
+
+    Reader args{ pArgs, nArgs };
+    Instance *instance = connection.find(id);
+    if (instance == nullptr) {
+        return command < ServerCommand::COUNT ? ServerStatus::NO_INSTANCE : ServerStatus::BAD_COMMAND;
+    }
+    Bus &bus = instance->bus;
+
+    switch (command) {
+    case ServerCommand::DESTROY:
+        connection.vInstances[id].reset();
+        return ServerStatus::OK;
+
+    case ServerCommand::LOAD_ROM: {
+        std::shared_ptr<Cartridge> cart = std::make_shared<Cartridge>(args.p, args.nLeft);
+        if (!cart->ImageValid()) {
+            return ServerStatus::BAD_ROM;
+        }
+        instance->cart = cart;
+        instance->states.clear();
+        instance->nFrames = 0;
+        bus.insertCartridge(cart);
+        bus.reset();
+        return ServerStatus::OK;
+    }
+
+    case ServerCommand::SET_VIDEO: {
+        uint8_t enabled = 0;
+        if (!args.take(enabled)) {
+            return ServerStatus::BAD_COMMAND;
+        }
+        bus.ppu.outputEnabled = enabled != 0;
+        return ServerStatus::OK;
+    }
+
+    default:
+        break;
+    }
+
+    if (command >= ServerCommand::COUNT) {
+        return ServerStatus::BAD_COMMAND;
+    }
+    if (instance->cart == nullptr) {
+        return ServerStatus::NO_ROM;
+    }
+
+    switch (command) {
+    case ServerCommand::RESET:
+        bus.reset();
+        instance->nFrames = 0;
+        return ServerStatus::OK;
+
+    case ServerCommand::STEP: {
+        uint32_t nFrames = 0;
+        if (!args.take(nFrames) || (args.nLeft != 0 && args.nLeft != (size_t)nFrames * 2)) {
+            return ServerStatus::BAD_COMMAND;
+        }
+        const Byte *inputs = args.nLeft != 0 ? args.p : nullptr;
+        for (uint32_t frame = 0; frame < nFrames; frame++) {
+            if (inputs != nullptr) {
+                bus.controller[0] = inputs[frame * 2];
+                bus.controller[1] = inputs[frame * 2 + 1];
+            }
+            bus.clockFrame();
+        }
+        instance->nFrames += nFrames;
+
+        if (bus.ppu.outputEnabled) {
+            std::memcpy(instance->view + ServerView::FRAME_OFFSET, bus.ppu.frame(), ServerView::FRAME_SIZE);
+        }
+        std::memcpy(instance->view + ServerView::MEMORY_OFFSET, bus.cpuRam.data(), bus.cpuRam.size());
+        append(vData, instance->nFrames);
+        return ServerStatus::OK;
+    }
+
+    case ServerCommand::SAVE_STATE: {
+        uint32_t slot = 0;
+        if (!args.take(slot)) {
+            return ServerStatus::BAD_COMMAND;
+        }
+        bus.saveState(instance->states[slot]);
+        return ServerStatus::OK;
+    }
+
+    case ServerCommand::LOAD_STATE: {
+        uint32_t slot = 0;
+        if (!args.take(slot)) {
+            return ServerStatus::BAD_COMMAND;
+        }
+        auto state = instance->states.find(slot);
+        if (state == instance->states.end()) {
+            return ServerStatus::NO_STATE;
+        }
+        bus.loadState(state->second);
+        return ServerStatus::OK;
+    }
+
+    case ServerCommand::READ_MEMORY: {
+        uint16_t address = 0;
+        uint32_t nLength = 0;
+        if (!args.take(address) || !args.take(nLength) || address + nLength > ServerView::MEMORY_SIZE) {
+            return ServerStatus::BAD_COMMAND;
+        }
+        Byte *memory = instance->view + ServerView::MEMORY_OFFSET;
+        for (uint32_t offset = address; offset < address + nLength; offset++) {
+            memory[offset] = bus.cpuRead(offset, true);
+        }
+        return ServerStatus::OK;
+    }
+
+    case ServerCommand::STATE_HASH:
+        append<uint64_t>(vData, connection.hash(bus));
+        return ServerStatus::OK;
+
+    default:
+        return ServerStatus::BAD_COMMAND;
+    }
+}
+
+#else
+
+Server::Instance::~Instance() {}
+Server::~Server() {}
+bool Server::listen(const std::string&) { return false; }
+void Server::serve() {}
+void Server::stop() {}
+
+#endif
@@ -0,0 +1,256 @@
+#include "../include/ServerClient.hpp"
+
+#include <cstring>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+ServerClient::~ServerClient() {
+    disconnect();
+}
+
+void ServerClient::queue(uint8_t command, uint32_t instance, const void* pArgs, size_t nArgs) {
+    uint32_t nSize = nArgs;
+    const uint8_t *fields[] = { &command, (const uint8_t*)&instance, (const uint8_t*)&nSize };
+    const size_t sizes[] = { sizeof(command), sizeof(instance), sizeof(nSize) };
+    for (size_t i = 0; i < 3; i++) {
+        vBatch.insert(vBatch.end(), fields[i], fields[i] + sizes[i]);
+    }
+    vBatch.insert(vBatch.end(), (const uint8_t*)pArgs, (const uint8_t*)pArgs + nArgs);
+    vCommands.push_back({ command, instance });
+}
+
+void ServerClient::create() {
+    queue(ServerCommand::CREATE, 0, nullptr, 0);
+}
+
+void ServerClient::destroy(uint32_t instance) {
+    queue(ServerCommand::DESTROY, instance, nullptr, 0);
+}
+
+void ServerClient::loadROM(uint32_t instance, const uint8_t* image, size_t nSize) {
+    queue(ServerCommand::LOAD_ROM, instance, image, nSize);
+}
+
+void ServerClient::reset(uint32_t instance) {
+    queue(ServerCommand::RESET, instance, nullptr, 0);
+}
+
+void ServerClient::step(uint32_t instance, uint32_t nFrames, const uint8_t* inputs) {
+    std::vector<uint8_t> vArgs(sizeof(nFrames) + (inputs != nullptr ? nFrames * 2 : 0));
+    std::memcpy(vArgs.data(), &nFrames, sizeof(nFrames));
+    if (inputs != nullptr) {
+        std::memcpy(vArgs.data() + sizeof(nFrames), inputs, nFrames * 2);
+    }
+    queue(ServerCommand::STEP, instance, vArgs.data(), vArgs.size());
+}
+
+void ServerClient::setVideo(uint32_t instance, bool bEnabled) {
+    uint8_t enabled = bEnabled ? 1 : 0;
+    queue(ServerCommand::SET_VIDEO, instance, &enabled, sizeof(enabled));
+}
+
+void ServerClient::saveState(uint32_t instance, uint32_t slot) {
+    queue(ServerCommand::SAVE_STATE, instance, &slot, sizeof(slot));
+}
+
+void ServerClient::loadState(uint32_t instance, uint32_t slot) {
+    queue(ServerCommand::LOAD_STATE, instance, &slot, sizeof(slot));
+}
+
+void ServerClient::readMemory(uint32_t instance, uint16_t address, uint32_t nLength) {
+    uint8_t args[sizeof(address) + sizeof(nLength)];
+    std::memcpy(args, &address, sizeof(address));
+    std::memcpy(args + sizeof(address), &nLength, sizeof(nLength));
+    queue(ServerCommand::READ_MEMORY, instance, args, sizeof(args));
+}
+
+void ServerClient::stateHash(uint32_t instance) {
+    queue(ServerCommand::STATE_HASH, instance, nullptr, 0);
+}
+
+const uint8_t* ServerClient::frame(uint32_t instance) const {
+    auto view = views.find(instance);
+    return view == views.end() ? nullptr : view->second + ServerView::FRAME_OFFSET;
+}
+
+const uint8_t* ServerClient::memory(uint32_t instance) const {
+    auto view = views.find(instance);
+    return view == views.end() ? nullptr : view->second + ServerView::MEMORY_OFFSET;
+}
+
+#ifdef __linux__
+
+bool ServerClient::connect(const std::string& sPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (fd >= 0 || sPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, sPath.c_str(), sPath.size() + 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd >= 0;
+}
+
+void ServerClient::disconnect() {
+    for (auto &view : views) {
+        munmap((void*)view.second, ServerView::SIZE);
+    }
+    views.clear();
+    vBatch.clear();
+    vCommands.clear();
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Reads exactly nSize bytes, collecting any descriptors that come with them
+static bool readAll(int fd, uint8_t* p, size_t nSize, std::vector<int>& vDescriptors) {
+    alignas(cmsghdr) char control[CMSG_SPACE(253 * sizeof(int))];
+    while (nSize > 0) {
+        iovec iov = { p, nSize };
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                size_t nCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const uint8_t *data = CMSG_DATA(cmsg);
+                for (size_t i = 0; i < nCount; i++) {
+                    int descriptor;
+                    std::memcpy(&descriptor, data + i * sizeof(int), sizeof(int));
+                    vDescriptors.push_back(descriptor);
+                }
+            }
+        }
+        p += n;
+        nSize -= n;
+    }
+    return true;
+}
+
+bool ServerClient::receive(std::vector<uint8_t>& vMessage, std::vector<int>& vDescriptors) {
+    uint32_t nSize = 0;
+    if (!readAll(fd, (uint8_t*)&nSize, sizeof(nSize), vDescriptors)) {
+        return false;
+    }
+    vMessage.resize(nSize);
+    return readAll(fd, vMessage.data(), nSize, vDescriptors);
+}
+
+bool ServerClient::execute(std::vector<Result>& vResults) {
+    vResults.clear();
+    std::vector<std::pair<uint8_t, uint32_t>> vCommandsSent;
+    vCommandsSent.swap(vCommands);
+
+    uint16_t nCommands = vCommandsSent.size();
+    uint32_t nSize = sizeof(nCommands) + vBatch.size();
+    std::vector<uint8_t> vMessage(sizeof(nSize) + nSize);
+    std::memcpy(vMessage.data(), &nSize, sizeof(nSize));
+    std::memcpy(vMessage.data() + sizeof(nSize), &nCommands, sizeof(nCommands));
+    std::memcpy(vMessage.data() + sizeof(nSize) + sizeof(nCommands), vBatch.data(), vBatch.size());
+    vBatch.clear();
+
+    bool bOk = fd >= 0;
+    for (size_t nSent = 0; bOk && nSent < vMessage.size();) {
+        ssize_t n = send(fd, vMessage.data() + nSent, vMessage.size() - nSent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        bOk = n > 0;
+        nSent += bOk ? n : 0;
+    }
+
+    std::vector<int> vDescriptors;
+    bOk = bOk && receive(vMessage, vDescriptors);
+
+    // Parse the results, mapping a view for each instance created
+    const uint8_t *p = vMessage.data();
+    size_t nLeft = bOk ? vMessage.size() : 0;
+    uint16_t nResults = 0;
+    bOk = bOk && nLeft >= sizeof(nResults);
+    if (bOk) {
+        std::memcpy(&nResults, p, sizeof(nResults));
+        p += sizeof(nResults);
+        nLeft -= sizeof(nResults);
+        bOk = nResults == nCommands;
+    }
+    size_t nDescriptor = 0;
+    for (uint16_t i = 0; bOk && i < nResults; i++) {
+        Result result;
+        uint32_t nData = 0;
+        bOk = nLeft >= sizeof(result.status) + sizeof(nData);
+        if (!bOk) {
+            break;
+        }
+        std::memcpy(&result.status, p, sizeof(result.status));
+        std::memcpy(&nData, p + sizeof(result.status), sizeof(nData));
+        p += sizeof(result.status) + sizeof(nData);
+        nLeft -= sizeof(result.status) + sizeof(nData);
+        bOk = nLeft >= nData;
+        if (!bOk) {
+            break;
+        }
+        result.vData.assign(p, p + nData);
+        p += nData;
+        nLeft -= nData;
+
+        uint8_t command = vCommandsSent[i].first;
+        if (result.status == ServerStatus::OK && command == ServerCommand::CREATE
+            && nDescriptor < vDescriptors.size()) {
+            void *view = mmap(nullptr, ServerView::SIZE, PROT_READ, MAP_SHARED, vDescriptors[nDescriptor++], 0);
+            if (view != MAP_FAILED) {
+                views[result.value<uint32_t>()] = (const uint8_t*)view;
+            }
+        } else if (result.status == ServerStatus::OK && command == ServerCommand::DESTROY) {
+            auto view = views.find(vCommandsSent[i].second);
+            if (view != views.end()) {
+                munmap((void*)view->second, ServerView::SIZE);
+                views.erase(view);
+            }
+        }
+        vResults.push_back(std::move(result));
+    }
+
+    for (int descriptor : vDescriptors) {
+        close(descriptor);
+    }
+    if (!bOk) {
+        disconnect();
+    }
+    return bOk;
+}
+
+#else
+
+bool ServerClient::connect(const std::string&) { return false; }
+void ServerClient::disconnect() {}
+bool ServerClient::receive(std::vector<uint8_t>&, std::vector<int>&) { return false; }
+bool ServerClient::execute(std::vector<Result>& vResults) {
+    vResults.clear();
+    vBatch.clear();
+    vCommands.clear();
+    return false;
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include "../include/StateHash.hpp"
+#include "../include/Bus.hpp"
+#include "../include/PagedMemory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mixLane(uint64_t lane, uint64_t input) {
+    lane += input * PRIME64_2;
+    return rotateLeft(lane, 31) * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t hash, uint64_t lane) {
+    hash ^= mixLane(0, lane);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+static inline uint64_t read64(const Byte* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const Byte* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+StateHasher::StateHasher(uint64_t seed) : nSeed(seed) {
+    lanes = { seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1 };
+}
+
+void StateHasher::update(const void* pData, size_t nSize) {
+    const Byte *p = (const Byte*)pData;
+    nTotal += nSize;
+
+    if (nBuffered > 0) {
+        size_t nTake = std::min(nSize, stripe.size() - nBuffered);
+        std::memcpy(stripe.data() + nBuffered, p, nTake);
+        nBuffered += nTake;
+        p += nTake;
+        nSize -= nTake;
+        if (nBuffered < stripe.size()) {
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            lanes[i] = mixLane(lanes[i], read64(stripe.data() + i * 8));
+        }
+        nBuffered = 0;
+    }
+
+    // Straight from the input while whole stripes remain
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    for (; nSize >= 32; p += 32, nSize -= 32) {
+        v1 = mixLane(v1, read64(p));
+        v2 = mixLane(v2, read64(p + 8));
+        v3 = mixLane(v3, read64(p + 16));
+        v4 = mixLane(v4, read64(p + 24));
+    }
+    lanes = { v1, v2, v3, v4 };
+
+    std::memcpy(stripe.data(), p, nSize);
+    nBuffered = nSize;
+}
+
+uint64_t StateHasher::digest() const {
+    uint64_t hash;
+    if (nTotal >= 32) {
+        hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7)
+            + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes) {
+            hash = mergeRound(hash, lane);
+        }
+    } else {
+        hash = nSeed + PRIME64_5;
+    }
+    hash += nTotal;
+
+    // The tail that did not fill a stripe
+    const Byte *p = stripe.data();
+    size_t nLeft = nBuffered;
+    for (; nLeft >= 8; p += 8, nLeft -= 8) {
+        hash ^= mixLane(0, read64(p));
+        hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (nLeft >= 4) {
+        hash ^= (uint64_t)read32(p) * PRIME64_1;
+        hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        nLeft -= 4;
+    }
+    for (; nLeft > 0; p++, nLeft--) {
+        hash ^= (*p) * PRIME64_5;
+        hash = rotateLeft(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void StateHash::hashPaged(StateHasher& hasher, const PagedMemory& memory) {
+    for (size_t page = 0; page < memory.size() / PagedMemory::PAGE_SIZE; page++) {
+        hasher.update(memory.page(page), PagedMemory::PAGE_SIZE);
+    }
+}
+
+StateHash::Parts StateHash::parts(const Bus& bus) {
+    Parts parts;
+
+    parts[StatePart::CPU] = registers(bus);
+    {
+        StateHasher hasher;
+        hasher.update(bus.cpuRam.data(), bus.cpuRam.size());
+        parts[StatePart::RAM] = hasher.digest();
+    }
+
+    {
+        // Field by field: the struct has padding and pipeline state
+        bus.ppu.saveState(ppuState);
+        StateHasher hasher;
+        hashPaged(hasher, ppuState.tblName);
+        hasher.update(ppuState.tblPalette.data(), ppuState.tblPalette.size());
+        hasher.update(ppuState.oam.data(), ppuState.oam.size());
+        hasher.value(ppuState.oamAddr);
+        hasher.value(ppuState.control);
+        hasher.value(ppuState.mask);
+        hasher.value(ppuState.status);
+        hasher.value(ppuState.vramAddr);
+        hasher.value(ppuState.tramAddr);
+        hasher.value(ppuState.fineX);
+        hasher.value(ppuState.addressLatch);
+        hasher.value(ppuState.ppuDataBuffer);
+        hasher.value(ppuState.scanline);
+        hasher.value(ppuState.cycle);
+        hasher.value(ppuState.oddFrame);
+        hasher.value(ppuState.nmi);
+        parts[StatePart::PPU] = hasher.digest();
+        // Holding on to the pages would make the PPU copy them on its next write
+        ppuState.tblName = PagedMemory();
+    }
+
+    {
+        StateHasher hasher;
+        if (bus.cart != nullptr && bus.cart->pMapper != nullptr) {
+            const Mapper &mapper = *bus.cart->pMapper;
+            for (uint32_t window = 0; window < 4; window++) {
+                hasher.value(mapper.prgBankBase(0x8000 + window * 0x2000));
+            }
+            for (uint32_t window = 0; window < 8; window++) {
+                hasher.value(mapper.chrBankBase(window * 0x0400));
+            }
+            hashPaged(hasher, mapper.prgRam());
+            hashPaged(hasher, bus.cart->vCHRRam);
+        }
+        parts[StatePart::CARTRIDGE] = hasher.digest();
+    }
+
+    {
+        // A frame buffer not allocated yet hashes as the blank one it stands for
+        static const std::array<Byte, SCREEN_WIDTH> BLANK_LINE{};
+        StateHasher hasher;
+        if (bus.ppu.hasFrame()) {
+            hasher.update(bus.ppu.frame(), SCREEN_WIDTH * SCREEN_HEIGHT);
+        } else {
+            for (uint16_t line = 0; line < SCREEN_HEIGHT; line++) {
+                hasher.update(BLANK_LINE.data(), BLANK_LINE.size());
+            }
+        }
+        parts[StatePart::FRAME] = hasher.digest();
+    }
+
+    return parts;
+}
+
+uint64_t StateHash::operator()(const Bus& bus, uint32_t nMask) {
+    return combine(parts(bus), nMask);
+}
+
+uint64_t StateHash::cpu(const Bus& bus) {
+    StateHasher hasher(registers(bus));
+    hasher.update(bus.cpuRam.data(), bus.cpuRam.size());
+    return hasher.digest();
+}
+
+uint64_t StateHash::registers(const Bus& bus) {
+    bus.cpu.SaveState(cpuState);
+    StateHasher hasher;
+    hasher.value(cpuState.Accumulator);
+    hasher.value(cpuState.X);
+    hasher.value(cpuState.Y);
+    hasher.value(cpuState.StackPointer);
+    hasher.value(cpuState.StatusRegister);
+    hasher.value(cpuState.ProgramCounter);
+    hasher.value(cpuState.CyclesLeft);
+    return hasher.digest();
+}
+
+uint64_t StateHash::combine(const Parts& parts, uint32_t nMask) {
+    StateHasher hasher;
+    for (uint32_t part = 0; part < StatePart::COUNT; part++) {
+        if (nMask & (1u << part)) {
+            hasher.value(parts[part]);
+        }
+    }
+    return hasher.digest();
+}
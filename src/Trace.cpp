@@ -0,0 +1,338 @@
+#include "../include/Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static constexpr uint32_t MAX_EVENTS = 1 << 16;
+static constexpr uint32_t MAX_FRAMES = 1 << 14;
+
+struct ZoneInfo {
+    const char *name;
+    bool bEvents; // Rare enough to keep every occurrence
+};
+
+static const ZoneInfo ZONES[TraceZone::COUNT] = {
+    { "Bus::clock", false },
+    { "CPU::Clock", false },
+    { "PPU::clock", false },
+    { "Bus dispatch", false },
+    { "Mapper", false },
+    { "Cartridge load", true },
+    { "Frame handoff", true }
+};
+
+struct TraceEvent {
+    uint64_t nStart;
+    uint64_t nEnd;
+    TraceZone::Zone zone;
+};
+
+struct FrameRecord {
+    uint64_t nStart;
+    uint64_t nEnd;
+    std::array<uint64_t, TraceZone::COUNT> ticks;
+    std::array<uint32_t, TraceZone::COUNT> calls;
+};
+
+// Written only by its own thread. Events and frames are published by storing
+// their count after the entry, so a reader sees complete entries only.
+struct ThreadTrace {
+    uint32_t nThread = 0;
+    TraceScope *pCurrent = nullptr;
+
+    // Outermost per-dot scopes seen, and how deep inside one that is not
+    // being sampled the thread is
+    uint32_t nSampleClock = 0;
+    uint32_t nSkipDepth = 0;
+
+    // The frame in progress
+    uint64_t nFrameStart = 0;
+    std::array<uint64_t, TraceZone::COUNT> ticks{};
+    std::array<uint32_t, TraceZone::COUNT> calls{};
+
+    std::vector<TraceEvent> vEvents;
+    std::atomic<uint32_t> nEvents{0};
+    std::vector<FrameRecord> vFrames;
+    std::atomic<uint32_t> nFrames{0};
+    std::atomic<uint64_t> nDropped{0};
+};
+
+std::atomic<bool> HostTrace::bEnabled{false};
+
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<ThreadTrace>> registry;
+static thread_local ThreadTrace *pThreadTrace = nullptr;
+
+// Measured by calibrate(): what a timed scope with nothing in it reads for
+// itself, and what it adds to its parent on top of that
+static std::atomic<uint64_t> nEmptyScopeTicks{0};
+static std::atomic<uint64_t> nScopeOverheadTicks{0};
+
+// Where time stamps start, and the steady clock at that moment to convert them
+static std::atomic<uint64_t> nOriginTicks{0};
+static std::chrono::steady_clock::time_point originTime;
+
+static ThreadTrace* threadTrace() {
+    if (pThreadTrace == nullptr) {
+        auto trace = std::make_unique<ThreadTrace>();
+        trace->vEvents.resize(MAX_EVENTS);
+        trace->vFrames.resize(MAX_FRAMES);
+        trace->nFrameStart = HostTrace::ticks();
+
+        std::lock_guard<std::mutex> lock(registryLock);
+        trace->nThread = (uint32_t)registry.size();
+        pThreadTrace = trace.get();
+        registry.push_back(std::move(trace));
+    }
+    return pThreadTrace;
+}
+
+void HostTrace::setEnabled(bool bOn) {
+    if (bOn && nOriginTicks.load() == 0) {
+        calibrate();
+
+        std::lock_guard<std::mutex> lock(registryLock);
+        if (nOriginTicks.load() == 0) {
+            originTime = std::chrono::steady_clock::now();
+            nOriginTicks.store(ticks());
+        }
+    }
+    bEnabled.store(bOn);
+}
+
+void HostTrace::calibrate() {
+    constexpr uint32_t nScopes = 1000;
+
+    // Empty scopes nested in a coarse one, which is always timed, on this
+    // thread's own buffer; the best of a few rounds, then put back as it was
+    ThreadTrace *trace = threadTrace();
+    std::array<uint64_t, TraceZone::COUNT> ticks = trace->ticks;
+    std::array<uint32_t, TraceZone::COUNT> calls = trace->calls;
+    uint32_t nEvents = trace->nEvents.load();
+
+    uint64_t nEmpty = UINT64_MAX;
+    uint64_t nOverhead = UINT64_MAX;
+    for (int round = 0; round < 5; round++) {
+        trace->ticks.fill(0);
+
+        TraceScope outer(TraceZone::CARTRIDGE_LOAD);
+        outer.begin(TraceZone::CARTRIDGE_LOAD);
+        for (uint32_t i = 0; i < nScopes; i++) {
+            TraceScope inner(TraceZone::PPU_DOT);
+            inner.begin(TraceZone::PPU_DOT);
+            inner.end();
+            inner.pThread = nullptr;
+        }
+        outer.end();
+        outer.pThread = nullptr;
+
+        nEmpty = std::min(nEmpty, trace->ticks[TraceZone::PPU_DOT] / nScopes);
+        nOverhead = std::min(nOverhead, trace->ticks[TraceZone::CARTRIDGE_LOAD] / nScopes);
+    }
+
+    trace->ticks = ticks;
+    trace->calls = calls;
+    trace->nEvents.store(nEvents);
+
+    nEmptyScopeTicks.store(nEmpty);
+    nScopeOverheadTicks.store(nOverhead);
+}
+
+void TraceScope::begin(TraceZone::Zone z) {
+    pThread = threadTrace();
+    pParent = pThread->pCurrent;
+
+    bSkipped = pThread->nSkipDepth != 0;
+    if (!bSkipped && pParent == nullptr && !ZONES[z].bEvents) {
+        bSkipped = ++pThread->nSampleClock % HostTrace::SAMPLE_PERIOD != 0;
+    }
+    if (bSkipped) {
+        pThread->nSkipDepth++;
+        return;
+    }
+
+    pThread->pCurrent = this;
+    zone = z;
+    if (pParent != nullptr) {
+        nWeight = pParent->nWeight;
+    } else {
+        nWeight = ZONES[z].bEvents ? 1 : HostTrace::SAMPLE_PERIOD;
+    }
+    nChildTicks = 0;
+    nStart = HostTrace::ticks();
+}
+
+void TraceScope::end() {
+    if (bSkipped) {
+        pThread->nSkipDepth--;
+        return;
+    }
+
+    uint64_t nEnd = HostTrace::ticks();
+    uint64_t nElapsed = nEnd - nStart;
+
+    uint64_t nOwn = nChildTicks + nEmptyScopeTicks.load(std::memory_order_relaxed);
+    pThread->ticks[zone] += (nElapsed > nOwn ? nElapsed - nOwn : 0) * nWeight;
+    pThread->calls[zone] += nWeight;
+    if (pParent != nullptr) {
+        pParent->nChildTicks += nElapsed + nScopeOverheadTicks.load(std::memory_order_relaxed);
+    }
+    pThread->pCurrent = pParent;
+
+    if (ZONES[zone].bEvents) {
+        uint32_t n = pThread->nEvents.load(std::memory_order_relaxed);
+        if (n < MAX_EVENTS) {
+            pThread->vEvents[n] = { nStart, nEnd, zone };
+            pThread->nEvents.store(n + 1, std::memory_order_release);
+        } else {
+            pThread->nDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void HostTrace::endFrame() {
+    ThreadTrace *trace = threadTrace();
+    uint64_t nNow = ticks();
+
+    uint32_t n = trace->nFrames.load(std::memory_order_relaxed);
+    if (n < MAX_FRAMES) {
+        // A frame that began before tracing was first switched on starts with it
+        uint64_t nStart = std::max(trace->nFrameStart, nOriginTicks.load(std::memory_order_relaxed));
+        trace->vFrames[n] = { nStart, nNow, trace->ticks, trace->calls };
+        trace->nFrames.store(n + 1, std::memory_order_release);
+    } else {
+        trace->nDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    trace->ticks.fill(0);
+    trace->calls.fill(0);
+    trace->nFrameStart = nNow;
+}
+
+void HostTrace::clear() {
+    std::lock_guard<std::mutex> lock(registryLock);
+    for (auto &trace : registry) {
+        trace->ticks.fill(0);
+        trace->calls.fill(0);
+        trace->nFrameStart = ticks();
+        trace->nEvents.store(0);
+        trace->nFrames.store(0);
+        trace->nDropped.store(0);
+    }
+}
+
+// Time stamp counter ticks per microsecond, measured against the steady clock
+// over everything since tracing was first switched on
+static double ticksPerMicrosecond() {
+    uint64_t nOrigin = nOriginTicks.load();
+    if (nOrigin == 0) {
+        return 1.0;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - originTime).count();
+    return us <= 0.0 ? 1.0 : (HostTrace::ticks() - nOrigin) / us;
+}
+
+void HostTrace::writeChromeTrace(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryLock);
+    double rate = ticksPerMicrosecond();
+    uint64_t nOrigin = nOriginTicks.load();
+    auto micros = [&](uint64_t t) { return ((double)t - (double)nOrigin) / rate; };
+
+    char line[256];
+    bool bFirst = true;
+    auto emit = [&]() {
+        out << (bFirst ? "\n" : ",\n") << line;
+        bFirst = false;
+    };
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (auto &trace : registry) {
+        uint32_t tid = trace->nThread;
+        std::snprintf(line, sizeof(line),
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"emulator %u\"}}", tid, tid);
+        emit();
+
+        uint32_t nEvents = trace->nEvents.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < nEvents; i++) {
+            const TraceEvent &event = trace->vEvents[i];
+            std::snprintf(line, sizeof(line),
+                "{\"name\":\"%s\",\"cat\":\"nes\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                ZONES[event.zone].name, micros(event.nStart), (event.nEnd - event.nStart) / rate, tid);
+            emit();
+        }
+
+        uint32_t nFrames = trace->nFrames.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < nFrames; i++) {
+            const FrameRecord &frame = trace->vFrames[i];
+            std::snprintf(line, sizeof(line),
+                "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"frame\":%u}}",
+                micros(frame.nStart), (frame.nEnd - frame.nStart) / rate, tid, i);
+            emit();
+
+            // One counter track per thread, stacked by zone
+            out << ",\n{\"name\":\"host time " << tid << " (us)\",\"ph\":\"C\",\"pid\":1,\"ts\":";
+            std::snprintf(line, sizeof(line), "%.3f", micros(frame.nStart));
+            out << line << ",\"args\":{";
+            for (int zone = 0; zone < TraceZone::COUNT; zone++) {
+                std::snprintf(line, sizeof(line), "%s\"%s\":%.3f", zone == 0 ? "" : ",", ZONES[zone].name, frame.ticks[zone] / rate);
+                out << line;
+            }
+            out << "}}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+void HostTrace::writeFrameSummary(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryLock);
+    double rate = ticksPerMicrosecond();
+
+    char line[160];
+    for (auto &trace : registry) {
+        uint32_t nFrames = trace->nFrames.load(std::memory_order_acquire);
+        if (nFrames == 0) {
+            continue;
+        }
+
+        uint64_t nFrameTicks = 0;
+        uint64_t nLongest = 0;
+        std::array<uint64_t, TraceZone::COUNT> ticks{};
+        std::array<uint64_t, TraceZone::COUNT> calls{};
+        for (uint32_t i = 0; i < nFrames; i++) {
+            const FrameRecord &frame = trace->vFrames[i];
+            nFrameTicks += frame.nEnd - frame.nStart;
+            nLongest = std::max(nLongest, frame.nEnd - frame.nStart);
+            for (int zone = 0; zone < TraceZone::COUNT; zone++) {
+                ticks[zone] += frame.ticks[zone];
+                calls[zone] += frame.calls[zone];
+            }
+        }
+
+        std::snprintf(line, sizeof(line), "thread %u: %u frames, %.1f us mean, %.1f us longest, %llu dropped\n",
+            trace->nThread, nFrames, nFrameTicks / rate / nFrames, nLongest / rate,
+            (unsigned long long)trace->nDropped.load());
+        out << line;
+
+        uint64_t nTraced = 0;
+        for (int zone = 0; zone < TraceZone::COUNT; zone++) {
+            nTraced += ticks[zone];
+            if (calls[zone] == 0) {
+                continue;
+            }
+            std::snprintf(line, sizeof(line), "  %-16s %10.1f us/frame %10.0f calls/frame %6.2f%%\n",
+                ZONES[zone].name, ticks[zone] / rate / nFrames, (double)calls[zone] / nFrames,
+                nFrameTicks == 0 ? 0.0 : 100.0 * ticks[zone] / nFrameTicks);
+            out << line;
+        }
+
+        uint64_t nOther = nFrameTicks > nTraced ? nFrameTicks - nTraced : 0;
+        std::snprintf(line, sizeof(line), "  %-16s %10.1f us/frame %21s %6.2f%%\n",
+            "(untraced)", nOther / rate / nFrames, "", nFrameTicks == 0 ? 0.0 : 100.0 * nOther / nFrameTicks);
+        out << line;
+    }
+}
@@ -0,0 +1,338 @@
+#define NES_BUILD_LIBRARY
+#include "../include/nes.h"
+#include "../include/Bus.hpp"
+#include "../include/Cartridge.hpp"
+#include "../include/PPU.hpp"
+#include "../include/RunAhead.hpp"
+#include "../include/Observation.hpp"
+#include "../include/Trace.hpp"
+#include "../include/CodeDataLogger.hpp"
+#include "../include/Cheats.hpp"
+#include "../include/StateHash.hpp"
+
+#include <fstream>
+#include <memory>
+
+static_assert(NES_SCREEN_WIDTH == SCREEN_WIDTH && NES_SCREEN_HEIGHT == SCREEN_HEIGHT, "C API screen size out of sync");
+
+struct nes_instance
+{
+    Bus bus;
+    std::shared_ptr<Cartridge> cart;
+    RunAhead runAhead{bus};
+    std::unique_ptr<ObservationStage> observation;
+    std::unique_ptr<CodeDataLogger> cdl;
+    Cheats cheats{bus};
+    StateHash stateHash;
+    bool bVideoOutput = true;
+    uint64_t nFrames = 0;
+};
+
+static nes_result insertImage(nes_instance* nes, const std::shared_ptr<Cartridge>& cart) {
+    if (!cart->ImageValid()) {
+        return NES_ERROR_BAD_ROM;
+    }
+
+    nes->cart = cart;
+    nes->bus.insertCartridge(cart);
+    if (nes->cdl != nullptr) {
+        nes->cdl->attach(nes->bus);
+    }
+    nes->cheats.refresh();
+    nes->bus.reset();
+    nes->nFrames = 0;
+    if (nes->observation != nullptr) {
+        nes->observation->clear();
+    }
+    return NES_OK;
+}
+
+// No exception may unwind into a C caller. Whatever the core throws, most
+// likely std::bad_alloc, comes back as onError instead.
+template <typename Result, typename Body>
+static Result guard(Result onError, Body body) noexcept {
+    try {
+        return body();
+    } catch (...) {
+        return onError;
+    }
+}
+
+extern "C" {
+
+uint32_t nes_abi_version(void) {
+    return NES_ABI_VERSION;
+}
+
+nes_instance* nes_create(void) {
+    return guard<nes_instance*>(nullptr, [] { return new nes_instance(); });
+}
+
+void nes_destroy(nes_instance* nes) {
+    delete nes;
+}
+
+nes_result nes_load_rom_file(nes_instance* nes, const char* path) {
+    if (nes == nullptr || path == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] { return insertImage(nes, std::make_shared<Cartridge>(std::string(path))); });
+}
+
+nes_result nes_load_rom_memory(nes_instance* nes, const uint8_t* image, size_t size) {
+    if (nes == nullptr || image == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] { return insertImage(nes, std::make_shared<Cartridge>(image, size)); });
+}
+
+nes_result nes_reset(nes_instance* nes) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (nes->cart == nullptr) {
+        return NES_ERROR_NO_ROM;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] {
+        nes->bus.reset();
+        nes->nFrames = 0;
+        if (nes->observation != nullptr) {
+            nes->observation->clear();
+        }
+        return NES_OK;
+    });
+}
+
+nes_result nes_step_frames(nes_instance* nes, uint32_t nFrames, const uint8_t* inputs) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (nes->cart == nullptr) {
+        return NES_ERROR_NO_ROM;
+    }
+
+    return guard(NES_ERROR_INTERNAL, [&] {
+        Bus &bus = nes->bus;
+        for (uint32_t frame = 0; frame < nFrames; frame++) {
+            if (inputs != nullptr) {
+                bus.controller[0] = inputs[frame * 2];
+                bus.controller[1] = inputs[frame * 2 + 1];
+            }
+
+            // The last two frames of a step feed the observation, so they are
+            // drawn even with video output off
+            ObservationStage* observation = nes->observation.get();
+            bool bObserved = observation != nullptr && frame + 2 >= nFrames;
+            bus.ppu.outputEnabled = nes->bVideoOutput || bObserved;
+
+            nes->runAhead.frame();
+
+            if (bObserved) {
+                TraceScope trace(TraceZone::FRAME_HANDOFF);
+                if (frame + 1 == nFrames) {
+                    observation->observe(bus.ppu.frame());
+                } else {
+                    observation->pool(bus.ppu.frame());
+                }
+            }
+        }
+
+        nes->nFrames += nFrames;
+        return NES_OK;
+    });
+}
+
+nes_result nes_set_video_output(nes_instance* nes, int enabled) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    nes->bVideoOutput = enabled != 0;
+    nes->bus.ppu.outputEnabled = nes->bVideoOutput;
+    return NES_OK;
+}
+
+nes_result nes_set_observation(nes_instance* nes, uint32_t width, uint32_t height, uint32_t nStack, uint8_t* ring) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (ring == nullptr) {
+        nes->observation.reset();
+        return NES_OK;
+    }
+    if (width == 0 || width > NES_SCREEN_WIDTH || height == 0 || height > NES_SCREEN_HEIGHT
+        || nStack == 0 || nStack > 0xFFFF) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+
+    return guard(NES_ERROR_INTERNAL, [&] {
+        nes->observation = std::make_unique<ObservationStage>(width, height, nStack, ring);
+        return NES_OK;
+    });
+}
+
+int32_t nes_observation_slot(const nes_instance* nes) {
+    if (nes == nullptr || nes->observation == nullptr) {
+        return -1;
+    }
+    return nes->observation->newestSlot();
+}
+
+nes_result nes_set_run_ahead(nes_instance* nes, uint32_t nFrames) {
+    if (nes == nullptr || nFrames > NES_MAX_RUN_AHEAD) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] {
+        nes->runAhead.setFrames(nFrames);
+        return NES_OK;
+    });
+}
+
+nes_result nes_run_ahead_stats(const nes_instance* nes, double* realFrameUs, double* extraUsPerLagFrame) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (realFrameUs != nullptr) {
+        *realFrameUs = nes->runAhead.realFrameMicroseconds();
+    }
+    if (extraUsPerLagFrame != nullptr) {
+        *extraUsPerLagFrame = nes->runAhead.extraMicrosecondsPerLagFrame();
+    }
+    return NES_OK;
+}
+
+void nes_set_host_trace(int enabled) {
+    HostTrace::setEnabled(enabled != 0);
+}
+
+nes_result nes_write_host_trace(const char* chromeTracePath, const char* summaryPath) {
+    return guard(NES_ERROR_INTERNAL, [&] {
+        if (chromeTracePath != nullptr) {
+            std::ofstream out(chromeTracePath);
+            if (!out) {
+                return NES_ERROR_INVALID_ARGUMENT;
+            }
+            HostTrace::writeChromeTrace(out);
+        }
+        if (summaryPath != nullptr) {
+            std::ofstream out(summaryPath);
+            if (!out) {
+                return NES_ERROR_INVALID_ARGUMENT;
+            }
+            HostTrace::writeFrameSummary(out);
+        }
+        return NES_OK;
+    });
+}
+
+nes_result nes_set_code_data_log(nes_instance* nes, int enabled) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (enabled == 0) {
+        if (nes->cdl != nullptr) {
+            nes->cdl->detach();
+        }
+        return NES_OK;
+    }
+
+    return guard(NES_ERROR_INTERNAL, [&] {
+        if (nes->cdl == nullptr) {
+            nes->cdl = std::make_unique<CodeDataLogger>();
+        }
+        if (nes->cart != nullptr) {
+            nes->cdl->attach(nes->bus);
+        }
+        return NES_OK;
+    });
+}
+
+nes_result nes_load_code_data_log(nes_instance* nes, const char* path) {
+    if (nes == nullptr || path == nullptr || nes->cdl == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    if (nes->cart == nullptr) {
+        return NES_ERROR_NO_ROM;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] { return nes->cdl->load(path) ? NES_OK : NES_ERROR_INVALID_ARGUMENT; });
+}
+
+nes_result nes_save_code_data_log(const nes_instance* nes, const char* path) {
+    if (nes == nullptr || path == nullptr || nes->cdl == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] { return nes->cdl->save(path) ? NES_OK : NES_ERROR_INVALID_ARGUMENT; });
+}
+
+int32_t nes_add_game_genie(nes_instance* nes, const char* code) {
+    if (nes == nullptr || code == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    uint32_t nId = guard(0u, [&] { return nes->cheats.addGameGenie(code); });
+    return nId == 0 ? NES_ERROR_INVALID_ARGUMENT : (int32_t)nId;
+}
+
+int32_t nes_add_ram_freeze(nes_instance* nes, uint16_t address, uint8_t value) {
+    if (nes == nullptr || address >= 0x8000) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    Cheats::Cheat cheat;
+    cheat.address = address;
+    cheat.value = value;
+    uint32_t nId = guard(0u, [&] { return nes->cheats.add(cheat); });
+    return nId == 0 ? NES_ERROR_INVALID_ARGUMENT : (int32_t)nId;
+}
+
+nes_result nes_remove_cheat(nes_instance* nes, int32_t id) {
+    if (nes == nullptr || id <= 0) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] {
+        return nes->cheats.remove((uint32_t)id) ? NES_OK : NES_ERROR_INVALID_ARGUMENT;
+    });
+}
+
+nes_result nes_clear_cheats(nes_instance* nes) {
+    if (nes == nullptr) {
+        return NES_ERROR_INVALID_ARGUMENT;
+    }
+    return guard(NES_ERROR_INTERNAL, [&] {
+        nes->cheats.clear();
+        return NES_OK;
+    });
+}
+
+uint64_t nes_state_hash(nes_instance* nes) {
+    if (nes == nullptr || nes->cart == nullptr) {
+        return 0;
+    }
+    return guard<uint64_t>(0, [&] { return nes->stateHash(nes->bus); });
+}
+
+const uint8_t* nes_framebuffer(const nes_instance* nes) {
+    if (nes == nullptr) {
+        return nullptr;
+    }
+    // The frame is allocated on first use
+    return guard<const uint8_t*>(nullptr, [&] { return nes->bus.ppu.frame(); });
+}
+
+const uint8_t* nes_palette_rgb(void) {
+    return &PPU::PALETTE_RGB[0][0];
+}
+
+const uint8_t* nes_cpu_ram(const nes_instance* nes) {
+    return nes == nullptr ? nullptr : nes->bus.cpuRam.data();
+}
+
+const int16_t* nes_audio_buffer(const nes_instance*, size_t* count) {
+    if (count != nullptr) {
+        *count = 0;
+    }
+    return nullptr;
+}
+
+uint64_t nes_frame_count(const nes_instance* nes) {
+    return nes == nullptr ? 0 : nes->nFrames;
+}
+
+}